@@ -337,12 +337,12 @@ void GuillotineBinPack::InsertMaxFitting(std::vector<RectSize> &rects, std::vect
 }
 */
 
-Rect GuillotineBinPack::Insert(int width, int height, bool merge, FreeRectChoiceHeuristic rectChoice, 
+Rect GuillotineBinPack::Insert(int width, int height, bool rot, bool merge, FreeRectChoiceHeuristic rectChoice, 
 	GuillotineSplitHeuristic splitMethod)
 {
 	// Find where to put the new rectangle.
 	int freeNodeIndex = 0;
-	Rect newRect = FindPositionForNewNode(width, height, rectChoice, &freeNodeIndex);
+	Rect newRect = FindPositionForNewNode(width, height, rot, rectChoice, &freeNodeIndex);
 
 	// Abort if we didn't have enough space in the bin.
 	if (newRect.height == 0)
@@ -428,7 +428,7 @@ int GuillotineBinPack::ScoreWorstLongSideFit(int width, int height, const Rect &
 	return -ScoreBestLongSideFit(width, height, freeRect);
 }
 
-Rect GuillotineBinPack::FindPositionForNewNode(int width, int height, FreeRectChoiceHeuristic rectChoice, int *nodeIndex)
+Rect GuillotineBinPack::FindPositionForNewNode(int width, int height, bool rot, FreeRectChoiceHeuristic rectChoice, int *nodeIndex)
 {
 	Rect bestNode;
 	memset(&bestNode, 0, sizeof(Rect));
@@ -451,7 +451,7 @@ Rect GuillotineBinPack::FindPositionForNewNode(int width, int height, FreeRectCh
 			break;
 		}
 		// If this is a perfect fit sideways, choose it.
-		else if (height == freeRectangles[i].width && width == freeRectangles[i].height)
+		else if (rot && height == freeRectangles[i].width && width == freeRectangles[i].height)
 		{
 			bestNode.x = freeRectangles[i].x;
 			bestNode.y = freeRectangles[i].y;
@@ -479,7 +479,7 @@ Rect GuillotineBinPack::FindPositionForNewNode(int width, int height, FreeRectCh
 			}
 		}
 		// Does the rectangle fit sideways?
-		else if (height <= freeRectangles[i].width && width <= freeRectangles[i].height)
+		else if (rot && height <= freeRectangles[i].width && width <= freeRectangles[i].height)
 		{
 			int score = ScoreByHeuristic(height, width, freeRectangles[i], rectChoice);
 
@@ -22,7 +22,8 @@ using namespace std;
 
 MaxRectsBinPack::MaxRectsBinPack()
 :binWidth(0),
-binHeight(0)
+binHeight(0),
+nextSerial(0)
 {
 }
 
@@ -45,7 +46,9 @@ void MaxRectsBinPack::Init(int width, int height)
 	usedRectangles.clear();
 
 	freeRectangles.clear();
-	freeRectangles.push_back(n);
+	freeSerials.clear();
+	nextSerial = 0;
+	AddFreeRect(n);
 }
 
 Rect MaxRectsBinPack::Insert(int width, int height, bool rot, FreeRectChoiceHeuristic method)
@@ -66,74 +69,311 @@ Rect MaxRectsBinPack::Insert(int width, int height, bool rot, FreeRectChoiceHeur
 	if (newNode.height == 0)
 		return newNode;
 
-	size_t numRectanglesToProcess = freeRectangles.size();
-	for(size_t i = 0; i < numRectanglesToProcess; ++i)
-	{
-		if (SplitFreeNode(freeRectangles[i], newNode))
-		{
-			freeRectangles.erase(freeRectangles.begin() + i);
-			--i;
-			--numRectanglesToProcess;
-		}
-	}
+	PlaceRect(newNode);
+	return newNode;
+}
 
-	PruneFreeList();
+namespace {
 
-	usedRectangles.push_back(newNode);
-	return newNode;
+/// One place a rectangle of a batch Insert could go.
+struct BatchCandidate
+{
+	int score1;
+	int score2;
+	/// The number of the free rectangle node lies in, which breaks ties the same way the
+	/// FindPositionForNewNode functions do. The score stays valid for as long as that one is free.
+	unsigned freeSerial;
+	Rect node;
+};
+
+bool CandidateLess(int a1, int a2, unsigned aSerial, int b1, int b2, unsigned bSerial)
+{
+	return a1 < b1 || (a1 == b1 && (a2 < b2 || (a2 == b2 && aSerial < bSerial)));
 }
 
-void MaxRectsBinPack::Insert(std::vector<RectSize> &rects, std::vector<Rect> &dst, bool rot, FreeRectChoiceHeuristic method)
+/// The few best places one of the rectangles of a batch Insert could go, best first. No place that
+/// isn't listed scores better than limit, so the first one is the best there is for as long as any
+/// are left, and a full rescore is only needed once all of them have been taken away.
+struct BatchScore
 {
-	dst.clear();
+	static const int maxCandidates = 8;
 
-	while(rects.size() > 0)
+	size_t index;
+	int numCandidates;
+	BatchCandidate candidates[maxCandidates];
+	int limit1;
+	int limit2;
+	unsigned limitSerial;
+
+	void Clear()
 	{
-		int bestScore1 = std::numeric_limits<int>::max();
-		int bestScore2 = std::numeric_limits<int>::max();
-		int bestRectIndex = -1;
-		Rect bestNode;
+		numCandidates = 0;
+		limit1 = std::numeric_limits<int>::max();
+		limit2 = std::numeric_limits<int>::max();
+		limitSerial = std::numeric_limits<unsigned>::max();
+	}
 
-		for(size_t i = 0; i < rects.size(); ++i)
+	/// @return False if a place with this score would be turned away by Offer anyway.
+	bool Wants(int score1, int score2, unsigned freeSerial) const
+	{
+		if (numCandidates == maxCandidates)
 		{
-			int score1;
-			int score2;
-			Rect newNode = ScoreRect(rects[i].width, rects[i].height, rot, method, score1, score2);
+			const BatchCandidate &last = candidates[maxCandidates-1];
+			return CandidateLess(score1, score2, freeSerial, last.score1, last.score2, last.freeSerial);
+		}
+		return !CandidateLess(limit1, limit2, limitSerial, score1, score2, freeSerial);
+	}
 
-			if (score1 < bestScore1 || (score1 == bestScore1 && score2 < bestScore2))
+	void Offer(const BatchCandidate &c)
+	{
+		if (!Wants(c.score1, c.score2, c.freeSerial))
+			return;
+		// After the ones that score the same, so the upright place wins ties with the rotated one.
+		int pos = numCandidates;
+		while(pos > 0 && CandidateLess(c.score1, c.score2, c.freeSerial,
+			candidates[pos-1].score1, candidates[pos-1].score2, candidates[pos-1].freeSerial))
+			--pos;
+		const BatchCandidate *dropped = 0;
+		if (numCandidates == maxCandidates)
+			dropped = pos == maxCandidates ? &c : &candidates[maxCandidates-1];
+		if (dropped)
+		{
+			if (CandidateLess(dropped->score1, dropped->score2, dropped->freeSerial, limit1, limit2, limitSerial))
 			{
-				bestScore1 = score1;
-				bestScore2 = score2;
-				bestNode = newNode;
-				bestRectIndex = i;
+				limit1 = dropped->score1;
+				limit2 = dropped->score2;
+				limitSerial = dropped->freeSerial;
 			}
+			if (pos == maxCandidates)
+				return;
 		}
+		else
+			++numCandidates;
+		for(int i = numCandidates - 1; i > pos; --i)
+			candidates[i] = candidates[i-1];
+		candidates[pos] = c;
+	}
 
-		if (bestRectIndex == -1)
-			return;
+	/// Takes away the places in any of the removed free rectangles, given by their (sorted) numbers.
+	void Remove(const std::vector<unsigned> &removed)
+	{
+		int n = 0;
+		for(int i = 0; i < numCandidates; ++i)
+			if (!binary_search(removed.begin(), removed.end(), candidates[i].freeSerial))
+				candidates[n++] = candidates[i];
+		numCandidates = n;
+	}
+};
+
+/// Scores placing a width x height rectangle into freeRect, the same way the FindPositionForNewNode
+/// functions do. Not for -CP, whose score depends on the used rectangles too.
+/// @return False if it doesn't fit.
+bool ScoreFit(const Rect &freeRect, int width, int height, MaxRectsBinPack::FreeRectChoiceHeuristic method,
+	int &score1, int &score2)
+{
+	if (freeRect.width < width || freeRect.height < height)
+		return false;
 
-		PlaceRect(bestNode);
-		rects.erase(rects.begin() + bestRectIndex);
+	int leftoverHoriz = freeRect.width - width;
+	int leftoverVert = freeRect.height - height;
+	switch(method)
+	{
+	case MaxRectsBinPack::RectBestShortSideFit:
+		score1 = min(leftoverHoriz, leftoverVert);
+		score2 = max(leftoverHoriz, leftoverVert);
+		break;
+	case MaxRectsBinPack::RectBestLongSideFit:
+		score1 = max(leftoverHoriz, leftoverVert);
+		score2 = min(leftoverHoriz, leftoverVert);
+		break;
+	case MaxRectsBinPack::RectBestAreaFit:
+		score1 = freeRect.width * freeRect.height - width * height;
+		score2 = min(leftoverHoriz, leftoverVert);
+		break;
+	default:
+		score1 = freeRect.y + height;
+		score2 = freeRect.x;
+		break;
 	}
+	return true;
+}
+
+/// Offers score every place in the given free rectangles the rectangle (or its rotation) fits.
+void ScoreFreeRects(const Rect *freeRects, const unsigned *freeSerials, size_t numFreeRects, const RectSize &size,
+	bool rot, MaxRectsBinPack::FreeRectChoiceHeuristic method, BatchScore &score)
+{
+	for(size_t i = 0; i < numFreeRects; ++i)
+		for(int flip = 0; flip <= (rot ? 1 : 0); ++flip)
+		{
+			BatchCandidate c;
+			c.freeSerial = freeSerials[i];
+			c.node.width = flip ? size.height : size.width;
+			c.node.height = flip ? size.width : size.height;
+			if (!ScoreFit(freeRects[i], c.node.width, c.node.height, method, c.score1, c.score2) ||
+				!score.Wants(c.score1, c.score2, c.freeSerial))
+				continue;
+			c.node.x = freeRects[i].x;
+			c.node.y = freeRects[i].y;
+			score.Offer(c);
+		}
 }
 
-void MaxRectsBinPack::PlaceRect(const Rect &node)
+}
+
+size_t MaxRectsBinPack::Insert(const std::vector<RectSize> &rects, std::vector<Rect> &dst, bool rot, FreeRectChoiceHeuristic method)
 {
-	size_t numRectanglesToProcess = freeRectangles.size();
-	for(size_t i = 0; i < numRectanglesToProcess; ++i)
+	Rect none;
+	memset(&none, 0, sizeof(Rect));
+	dst.assign(rects.size(), none);
+
+	// Scores everything from scratch. Free rectangles only ever get smaller, so a rectangle
+	// that doesn't fit anywhere now never will, and is dropped.
+	auto rescore = [&](BatchScore &score) {
+		score.Clear();
+		if (method == RectContactPointRule)
+		{
+			BatchCandidate c;
+			c.freeSerial = 0;
+			c.node = ScoreRect(rects[score.index].width, rects[score.index].height, rot, method, c.score1, c.score2);
+			if (c.node.height != 0)
+				score.Offer(c);
+			return;
+		}
+		ScoreFreeRects(freeRectangles.data(), freeSerials.data(), freeRectangles.size(), rects[score.index], rot, method, score);
+	};
+
+	std::vector<BatchScore> pending;
+	pending.reserve(rects.size());
+	for(size_t i = 0; i < rects.size(); ++i)
 	{
-		if (SplitFreeNode(freeRectangles[i], node))
+		BatchScore score;
+		score.index = i;
+		rescore(score);
+		if (score.numCandidates > 0)
+			pending.push_back(score);
+	}
+
+	std::vector<unsigned> removed;
+	std::vector<Rect> added;
+	std::vector<unsigned> addedSerials;
+	size_t numPlaced = 0;
+	while(pending.size() > 0)
+	{
+		// Ties go to the earlier rectangle, so the order of pending doesn't matter.
+		size_t best = 0;
+		for(size_t i = 1; i < pending.size(); ++i)
+		{
+			const BatchCandidate &a = pending[i].candidates[0];
+			const BatchCandidate &b = pending[best].candidates[0];
+			if (a.score1 < b.score1 || (a.score1 == b.score1 && (a.score2 < b.score2 ||
+				(a.score2 == b.score2 && pending[i].index < pending[best].index))))
+				best = i;
+		}
+		const Rect node = pending[best].candidates[0].node;
+		dst[pending[best].index] = node;
+		pending[best] = pending.back();
+		pending.pop_back();
+
+		const unsigned firstNewSerial = nextSerial;
+		removed.clear();
+		PlaceRect(node, &removed);
+		++numPlaced;
+
+		// Only the places in free rectangles that were split or pruned away are gone; the rest
+		// keep their scores, so they only need comparing against the new free rectangles.
+		// -CP scores depend on where everything else is, so those are always done again.
+		sort(removed.begin(), removed.end());
+		added.clear();
+		addedSerials.clear();
+		for(size_t i = 0; i < freeRectangles.size(); ++i)
+			if (freeSerials[i] >= firstNewSerial)
+			{
+				added.push_back(freeRectangles[i]);
+				addedSerials.push_back(freeSerials[i]);
+			}
+		for(size_t i = 0; i < pending.size(); ++i)
+		{
+			BatchScore &score = pending[i];
+			if (method == RectContactPointRule)
+				rescore(score);
+			else
+			{
+				score.Remove(removed);
+				if (score.numCandidates > 0)
+					ScoreFreeRects(added.data(), addedSerials.data(), added.size(), rects[score.index], rot, method, score);
+				else
+					rescore(score);
+			}
+			if (score.numCandidates == 0)
+			{
+				pending[i] = pending.back();
+				pending.pop_back();
+				--i;
+			}
+		}
+	}
+	return numPlaced;
+}
+
+bool MaxRectsBinPack::Occupy(const Rect &rect)
+{
+	// Every free area is contained in at least one of the maximal free rectangles.
+	for(size_t i = 0; i < freeRectangles.size(); ++i)
+		if (IsContainedIn(rect, freeRectangles[i]))
 		{
-			freeRectangles.erase(freeRectangles.begin() + i);
-			--i;
-			--numRectanglesToProcess;
+			PlaceRect(rect);
+			return true;
 		}
+	return false;
+}
+
+void MaxRectsBinPack::PlaceRect(const Rect &node, std::vector<unsigned> *removedSerials)
+{
+	// Split the free rectangles the node overlaps in the order they were made, so the pieces get
+	// numbered in the order they always have been.
+	std::vector<std::pair<unsigned, size_t> > overlapped;
+	for(size_t i = 0; i < freeRectangles.size(); ++i)
+	{
+		const Rect &freeNode = freeRectangles[i];
+		if (node.x < freeNode.x + freeNode.width && node.x + node.width > freeNode.x &&
+			node.y < freeNode.y + freeNode.height && node.y + node.height > freeNode.y)
+			overlapped.push_back(std::make_pair(freeSerials[i], i));
 	}
+	sort(overlapped.begin(), overlapped.end());
 
-	PruneFreeList();
+	const unsigned firstNewSerial = nextSerial;
+	for(size_t i = 0; i < overlapped.size(); ++i)
+		SplitFreeNode(freeRectangles[overlapped[i].second], node);
+
+	// Highest index first, so the ones still to go don't get moved.
+	std::vector<size_t> splitIndices;
+	for(size_t i = 0; i < overlapped.size(); ++i)
+	{
+		splitIndices.push_back(overlapped[i].second);
+		if (removedSerials)
+			removedSerials->push_back(overlapped[i].first);
+	}
+	sort(splitIndices.begin(), splitIndices.end());
+	for(size_t i = splitIndices.size(); i-- > 0;)
+		RemoveFreeRect(splitIndices[i]);
+
+	PruneFreeList(firstNewSerial, removedSerials);
 
 	usedRectangles.push_back(node);
-	//		dst.push_back(bestNode); ///\todo Refactor so that this compiles.
+}
+
+void MaxRectsBinPack::AddFreeRect(const Rect &rect)
+{
+	freeRectangles.push_back(rect);
+	freeSerials.push_back(nextSerial++);
+}
+
+void MaxRectsBinPack::RemoveFreeRect(size_t i)
+{
+	freeRectangles[i] = freeRectangles.back();
+	freeRectangles.pop_back();
+	freeSerials[i] = freeSerials.back();
+	freeSerials.pop_back();
 }
 
 Rect MaxRectsBinPack::ScoreRect(int width, int height, bool rot, FreeRectChoiceHeuristic method, int &score1, int &score2) const
@@ -176,6 +416,7 @@ Rect MaxRectsBinPack::FindPositionForNewNodeBottomLeft(bool rot, int width, int
 {
 	Rect bestNode;
 	memset(&bestNode, 0, sizeof(Rect));
+	unsigned bestSerial = std::numeric_limits<unsigned>::max();
 
 	bestY = std::numeric_limits<int>::max();
 	bestX = std::numeric_limits<int>::max();
@@ -186,9 +427,11 @@ Rect MaxRectsBinPack::FindPositionForNewNodeBottomLeft(bool rot, int width, int
 		if (freeRectangles[i].width >= width && freeRectangles[i].height >= height)
 		{
 			int topSideY = freeRectangles[i].y + height;
-			if (topSideY < bestY || (topSideY == bestY && freeRectangles[i].x < bestX))
+			if (topSideY < bestY || (topSideY == bestY && freeRectangles[i].x < bestX) ||
+				(topSideY == bestY && freeRectangles[i].x == bestX && freeSerials[i] < bestSerial))
 			{
 				bestNode.x = freeRectangles[i].x;
+				bestSerial = freeSerials[i];
 				bestNode.y = freeRectangles[i].y;
 				bestNode.width = width;
 				bestNode.height = height;
@@ -201,9 +444,11 @@ Rect MaxRectsBinPack::FindPositionForNewNodeBottomLeft(bool rot, int width, int
             if (freeRectangles[i].width >= height && freeRectangles[i].height >= width)
             {
                 int topSideY = freeRectangles[i].y + width;
-                if (topSideY < bestY || (topSideY == bestY && freeRectangles[i].x < bestX))
+                if (topSideY < bestY || (topSideY == bestY && freeRectangles[i].x < bestX) ||
+                    (topSideY == bestY && freeRectangles[i].x == bestX && freeSerials[i] < bestSerial))
                 {
                     bestNode.x = freeRectangles[i].x;
+                    bestSerial = freeSerials[i];
                     bestNode.y = freeRectangles[i].y;
                     bestNode.width = height;
                     bestNode.height = width;
@@ -221,6 +466,7 @@ Rect MaxRectsBinPack::FindPositionForNewNodeBestShortSideFit(bool rot, int width
 {
 	Rect bestNode;
 	memset(&bestNode, 0, sizeof(Rect));
+	unsigned bestSerial = std::numeric_limits<unsigned>::max();
 
 	bestShortSideFit = std::numeric_limits<int>::max();
 	bestLongSideFit = std::numeric_limits<int>::max();
@@ -235,9 +481,11 @@ Rect MaxRectsBinPack::FindPositionForNewNodeBestShortSideFit(bool rot, int width
 			int shortSideFit = min(leftoverHoriz, leftoverVert);
 			int longSideFit = max(leftoverHoriz, leftoverVert);
 
-			if (shortSideFit < bestShortSideFit || (shortSideFit == bestShortSideFit && longSideFit < bestLongSideFit))
+			if (shortSideFit < bestShortSideFit || (shortSideFit == bestShortSideFit && longSideFit < bestLongSideFit) ||
+				(shortSideFit == bestShortSideFit && longSideFit == bestLongSideFit && freeSerials[i] < bestSerial))
 			{
 				bestNode.x = freeRectangles[i].x;
+				bestSerial = freeSerials[i];
 				bestNode.y = freeRectangles[i].y;
 				bestNode.width = width;
 				bestNode.height = height;
@@ -255,9 +503,11 @@ Rect MaxRectsBinPack::FindPositionForNewNodeBestShortSideFit(bool rot, int width
                 int flippedShortSideFit = min(flippedLeftoverHoriz, flippedLeftoverVert);
                 int flippedLongSideFit = max(flippedLeftoverHoriz, flippedLeftoverVert);
 
-                if (flippedShortSideFit < bestShortSideFit || (flippedShortSideFit == bestShortSideFit && flippedLongSideFit < bestLongSideFit))
+                if (flippedShortSideFit < bestShortSideFit || (flippedShortSideFit == bestShortSideFit && flippedLongSideFit < bestLongSideFit) ||
+                    (flippedShortSideFit == bestShortSideFit && flippedLongSideFit == bestLongSideFit && freeSerials[i] < bestSerial))
                 {
                     bestNode.x = freeRectangles[i].x;
+                    bestSerial = freeSerials[i];
                     bestNode.y = freeRectangles[i].y;
                     bestNode.width = height;
                     bestNode.height = width;
@@ -275,6 +525,7 @@ Rect MaxRectsBinPack::FindPositionForNewNodeBestLongSideFit(bool rot, int width,
 {
 	Rect bestNode;
 	memset(&bestNode, 0, sizeof(Rect));
+	unsigned bestSerial = std::numeric_limits<unsigned>::max();
 
 	bestShortSideFit = std::numeric_limits<int>::max();
 	bestLongSideFit = std::numeric_limits<int>::max();
@@ -289,9 +540,11 @@ Rect MaxRectsBinPack::FindPositionForNewNodeBestLongSideFit(bool rot, int width,
 			int shortSideFit = min(leftoverHoriz, leftoverVert);
 			int longSideFit = max(leftoverHoriz, leftoverVert);
 
-			if (longSideFit < bestLongSideFit || (longSideFit == bestLongSideFit && shortSideFit < bestShortSideFit))
+			if (longSideFit < bestLongSideFit || (longSideFit == bestLongSideFit && shortSideFit < bestShortSideFit) ||
+				(longSideFit == bestLongSideFit && shortSideFit == bestShortSideFit && freeSerials[i] < bestSerial))
 			{
 				bestNode.x = freeRectangles[i].x;
+				bestSerial = freeSerials[i];
 				bestNode.y = freeRectangles[i].y;
 				bestNode.width = width;
 				bestNode.height = height;
@@ -309,9 +562,11 @@ Rect MaxRectsBinPack::FindPositionForNewNodeBestLongSideFit(bool rot, int width,
                 int shortSideFit = min(leftoverHoriz, leftoverVert);
                 int longSideFit = max(leftoverHoriz, leftoverVert);
                 
-                if (longSideFit < bestLongSideFit || (longSideFit == bestLongSideFit && shortSideFit < bestShortSideFit))
+                if (longSideFit < bestLongSideFit || (longSideFit == bestLongSideFit && shortSideFit < bestShortSideFit) ||
+                    (longSideFit == bestLongSideFit && shortSideFit == bestShortSideFit && freeSerials[i] < bestSerial))
                 {
                     bestNode.x = freeRectangles[i].x;
+                    bestSerial = freeSerials[i];
                     bestNode.y = freeRectangles[i].y;
                     bestNode.width = height;
                     bestNode.height = width;
@@ -329,6 +584,7 @@ Rect MaxRectsBinPack::FindPositionForNewNodeBestAreaFit(bool rot, int width, int
 {
 	Rect bestNode;
 	memset(&bestNode, 0, sizeof(Rect));
+	unsigned bestSerial = std::numeric_limits<unsigned>::max();
 
 	bestAreaFit = std::numeric_limits<int>::max();
 	bestShortSideFit = std::numeric_limits<int>::max();
@@ -344,9 +600,11 @@ Rect MaxRectsBinPack::FindPositionForNewNodeBestAreaFit(bool rot, int width, int
 			int leftoverVert = abs(freeRectangles[i].height - height);
 			int shortSideFit = min(leftoverHoriz, leftoverVert);
 
-			if (areaFit < bestAreaFit || (areaFit == bestAreaFit && shortSideFit < bestShortSideFit))
+			if (areaFit < bestAreaFit || (areaFit == bestAreaFit && shortSideFit < bestShortSideFit) ||
+				(areaFit == bestAreaFit && shortSideFit == bestShortSideFit && freeSerials[i] < bestSerial))
 			{
 				bestNode.x = freeRectangles[i].x;
+				bestSerial = freeSerials[i];
 				bestNode.y = freeRectangles[i].y;
 				bestNode.width = width;
 				bestNode.height = height;
@@ -363,9 +621,11 @@ Rect MaxRectsBinPack::FindPositionForNewNodeBestAreaFit(bool rot, int width, int
                 int leftoverVert = abs(freeRectangles[i].height - width);
                 int shortSideFit = min(leftoverHoriz, leftoverVert);
                 
-                if (areaFit < bestAreaFit || (areaFit == bestAreaFit && shortSideFit < bestShortSideFit))
+                if (areaFit < bestAreaFit || (areaFit == bestAreaFit && shortSideFit < bestShortSideFit) ||
+                    (areaFit == bestAreaFit && shortSideFit == bestShortSideFit && freeSerials[i] < bestSerial))
                 {
                     bestNode.x = freeRectangles[i].x;
+                    bestSerial = freeSerials[i];
                     bestNode.y = freeRectangles[i].y;
                     bestNode.width = height;
                     bestNode.height = width;
@@ -409,6 +669,7 @@ Rect MaxRectsBinPack::FindPositionForNewNodeContactPoint(bool rot, int width, in
 {
 	Rect bestNode;
 	memset(&bestNode, 0, sizeof(Rect));
+	unsigned bestSerial = std::numeric_limits<unsigned>::max();
 
 	bestContactScore = -1;
 
@@ -418,9 +679,11 @@ Rect MaxRectsBinPack::FindPositionForNewNodeContactPoint(bool rot, int width, in
 		if (freeRectangles[i].width >= width && freeRectangles[i].height >= height)
 		{
 			int score = ContactPointScoreNode(freeRectangles[i].x, freeRectangles[i].y, width, height);
-			if (score > bestContactScore)
+			if (score > bestContactScore ||
+				(score == bestContactScore && freeSerials[i] < bestSerial))
 			{
 				bestNode.x = freeRectangles[i].x;
+				bestSerial = freeSerials[i];
 				bestNode.y = freeRectangles[i].y;
 				bestNode.width = width;
 				bestNode.height = height;
@@ -433,9 +696,11 @@ Rect MaxRectsBinPack::FindPositionForNewNodeContactPoint(bool rot, int width, in
             if (freeRectangles[i].width >= height && freeRectangles[i].height >= width)
             {
                 int score = ContactPointScoreNode(freeRectangles[i].x, freeRectangles[i].y, height, width);
-                if (score > bestContactScore)
+                if (score > bestContactScore ||
+                    (score == bestContactScore && freeSerials[i] < bestSerial))
                 {
                     bestNode.x = freeRectangles[i].x;
+                    bestSerial = freeSerials[i];
                     bestNode.y = freeRectangles[i].y;
                     bestNode.width = height;
                     bestNode.height = width;
@@ -461,7 +726,7 @@ bool MaxRectsBinPack::SplitFreeNode(Rect freeNode, const Rect &usedNode)
 		{
 			Rect newNode = freeNode;
 			newNode.height = usedNode.y - newNode.y;
-			freeRectangles.push_back(newNode);
+			AddFreeRect(newNode);
 		}
 
 		// New node at the bottom side of the used node.
@@ -470,7 +735,7 @@ bool MaxRectsBinPack::SplitFreeNode(Rect freeNode, const Rect &usedNode)
 			Rect newNode = freeNode;
 			newNode.y = usedNode.y + usedNode.height;
 			newNode.height = freeNode.y + freeNode.height - (usedNode.y + usedNode.height);
-			freeRectangles.push_back(newNode);
+			AddFreeRect(newNode);
 		}
 	}
 
@@ -481,7 +746,7 @@ bool MaxRectsBinPack::SplitFreeNode(Rect freeNode, const Rect &usedNode)
 		{
 			Rect newNode = freeNode;
 			newNode.width = usedNode.x - newNode.x;
-			freeRectangles.push_back(newNode);
+			AddFreeRect(newNode);
 		}
 
 		// New node at the right side of the used node.
@@ -490,50 +755,33 @@ bool MaxRectsBinPack::SplitFreeNode(Rect freeNode, const Rect &usedNode)
 			Rect newNode = freeNode;
 			newNode.x = usedNode.x + usedNode.width;
 			newNode.width = freeNode.x + freeNode.width - (usedNode.x + usedNode.width);
-			freeRectangles.push_back(newNode);
+			AddFreeRect(newNode);
 		}
 	}
 
 	return true;
 }
 
-void MaxRectsBinPack::PruneFreeList()
+void MaxRectsBinPack::PruneFreeList(unsigned firstNewSerial, std::vector<unsigned> *removedSerials)
 {
-	/* 
-	///  Would be nice to do something like this, to avoid a Theta(n^2) loop through each pair.
-	///  But unfortunately it doesn't quite cut it, since we also want to detect containment. 
-	///  Perhaps there's another way to do this faster than Theta(n^2).
-
-	if (freeRectangles.size() > 0)
-		clb::sort::QuickSort(&freeRectangles[0], freeRectangles.size(), NodeSortCmp);
-
-	for(size_t i = 0; i < freeRectangles.size()-1; ++i)
-		if (freeRectangles[i].x == freeRectangles[i+1].x &&
-		    freeRectangles[i].y == freeRectangles[i+1].y &&
-		    freeRectangles[i].width == freeRectangles[i+1].width &&
-		    freeRectangles[i].height == freeRectangles[i+1].height)
-		{
-			freeRectangles.erase(freeRectangles.begin() + i);
-			--i;
-		}
-	*/
-
-	/// Go through each pair and remove any rectangle that is redundant.
-	for(size_t i = 0; i < freeRectangles.size(); ++i)
-		for(size_t j = i+1; j < freeRectangles.size(); ++j)
+	// Only the new pieces need checking, against everything else, rather than every pair. Of two
+	// identical rectangles, the newer one is kept, as the old pairwise loop did.
+	for(size_t i = 0; i < freeRectangles.size();)
+	{
+		bool redundant = false;
+		if (freeSerials[i] >= firstNewSerial)
+			for(size_t j = 0; j < freeRectangles.size() && !redundant; ++j)
+				redundant = j != i && IsContainedIn(freeRectangles[i], freeRectangles[j]) &&
+					!(IsContainedIn(freeRectangles[j], freeRectangles[i]) && freeSerials[j] < freeSerials[i]);
+		if (!redundant)
 		{
-			if (IsContainedIn(freeRectangles[i], freeRectangles[j]))
-			{
-				freeRectangles.erase(freeRectangles.begin()+i);
-				--i;
-				break;
-			}
-			if (IsContainedIn(freeRectangles[j], freeRectangles[i]))
-			{
-				freeRectangles.erase(freeRectangles.begin()+j);
-				--j;
-			}
+			++i;
+			continue;
 		}
+		if (removedSerials)
+			removedSerials->push_back(freeSerials[i]);
+		RemoveFreeRect(i);
+	}
 }
 
 }
@@ -38,15 +38,21 @@ public:
 		RectContactPointRule ///< -CP: Choosest the placement where the rectangle touches other rects as much as possible.
 	};
 
-	/// Inserts the given list of rectangles in an offline/batch mode, possibly rotated.
-	/// @param rects The list of rectangles to insert. This vector will be destroyed in the process.
-	/// @param dst [out] This list will contain the packed rectangles. The indices will not correspond to that of rects.
+	/// Inserts the given list of rectangles in an offline/batch mode, possibly rotated. At each step, the
+	/// rectangle that fits best out of all those left is placed.
+	/// @param rects The list of rectangles to insert.
+	/// @param dst [out] dst[i] is where rects[i] was placed, or a rectangle of size 0 if it didn't fit.
 	/// @param method The rectangle placement rule to use when packing.
-	void Insert(std::vector<RectSize> &rects, std::vector<Rect> &dst, bool rot, FreeRectChoiceHeuristic method);
+	/// @return The number of rectangles that were placed.
+	size_t Insert(const std::vector<RectSize> &rects, std::vector<Rect> &dst, bool rot, FreeRectChoiceHeuristic method);
 
 	/// Inserts a single rectangle into the bin, possibly rotated.
 	Rect Insert(int width, int height, bool rot, FreeRectChoiceHeuristic method);
 
+	/// Marks the given rectangle as used, e.g. to put back a rectangle packed by an earlier run.
+	/// @return False (and leaves the bin untouched) if the rectangle isn't entirely free space.
+	bool Occupy(const Rect &rect);
+
 	/// Computes the ratio of used surface area to the total bin area.
 	float Occupancy() const;
 
@@ -56,6 +62,11 @@ private:
 
 	std::vector<Rect> usedRectangles;
 	std::vector<Rect> freeRectangles;
+	/// freeSerials[i] numbers freeRectangles[i] in the order the free rectangles were made. Free rectangles are
+	/// removed by swapping in the last one, so the list isn't kept in that order; instead, of two equally good
+	/// spots, the one in the lower numbered free rectangle is picked, same as when the list was kept in order.
+	std::vector<unsigned> freeSerials;
+	unsigned nextSerial;
 
 	/// Computes the placement score for placing the given rectangle with the given method.
 	/// @param score1 [out] The primary placement score will be outputted here.
@@ -64,7 +75,15 @@ private:
 	Rect ScoreRect(int width, int height, bool rot, FreeRectChoiceHeuristic method, int &score1, int &score2) const;
 
 	/// Places the given rectangle into the bin.
-	void PlaceRect(const Rect &node);
+	/// @param removedSerials [out] If given, the numbers of the free rectangles that were split or pruned away
+	///   are added to this.
+	void PlaceRect(const Rect &node, std::vector<unsigned> *removedSerials = 0);
+
+	/// Appends a free rectangle, numbered after all the others.
+	void AddFreeRect(const Rect &rect);
+
+	/// Removes the i'th free rectangle by moving the last one into its place.
+	void RemoveFreeRect(size_t i);
 
 	/// Computes the placement score for the -CP variant.
 	int ContactPointScoreNode(int x, int y, int width, int height) const;
@@ -78,8 +97,9 @@ private:
 	/// @return True if the free node was split.
 	bool SplitFreeNode(Rect freeNode, const Rect &usedNode);
 
-	/// Goes through the free rectangle list and removes any redundant entries.
-	void PruneFreeList();
+	/// Removes the free rectangles numbered firstNewSerial or above that are contained in another one.
+	/// The others are all maximal rectangles that were there before the split, so none of them can be.
+	void PruneFreeList(unsigned firstNewSerial, std::vector<unsigned> *removedSerials);
 };
 
 }
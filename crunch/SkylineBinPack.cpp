@@ -0,0 +1,311 @@
+/** @file SkylineBinPack.cpp
+	@author Jukka Jylnki
+
+	@brief Implements different bin packer algorithms that use the SKYLINE data structure.
+
+	This work is released to Public Domain, do whatever you want with it.
+*/
+#include <utility>
+#include <iostream>
+#include <limits>
+
+#include <cassert>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "SkylineBinPack.h"
+
+namespace rbp {
+
+using namespace std;
+
+SkylineBinPack::SkylineBinPack()
+:binWidth(0),
+binHeight(0),
+usedSurfaceArea(0),
+useWasteMap(false)
+{
+}
+
+SkylineBinPack::SkylineBinPack(int width, int height, bool useWasteMap)
+{
+	Init(width, height, useWasteMap);
+}
+
+void SkylineBinPack::Init(int width, int height, bool useWasteMap_)
+{
+	binWidth = width;
+	binHeight = height;
+
+	useWasteMap = useWasteMap_;
+
+	usedSurfaceArea = 0;
+	skyLine.clear();
+	SkylineNode node;
+	node.x = 0;
+	node.y = 0;
+	node.width = binWidth;
+	skyLine.push_back(node);
+
+	if (useWasteMap)
+	{
+		wasteMap.Init(width, height);
+		wasteMap.GetFreeRectangles().clear();
+	}
+}
+
+Rect SkylineBinPack::Insert(int width, int height, bool rot, LevelChoiceHeuristic method)
+{
+	// First try to pack this rectangle into the waste map, if it fits.
+	if (useWasteMap)
+	{
+		Rect node = wasteMap.Insert(width, height, rot, true, GuillotineBinPack::RectBestShortSideFit,
+			GuillotineBinPack::SplitMaximizeArea);
+
+		if (node.height != 0)
+		{
+			usedSurfaceArea += width * height;
+			return node;
+		}
+	}
+
+	// The placement's top edge, and the skyline segment width (-BL) or wasted area (-MW) that breaks ties.
+	int bestHeight;
+	int tieBreak;
+	int bestIndex = -1;
+	Rect newNode;
+	memset(&newNode, 0, sizeof(Rect));
+
+	switch(method)
+	{
+	case LevelBottomLeft: newNode = FindPositionForNewNodeBottomLeft(width, height, rot, bestHeight, tieBreak, bestIndex); break;
+	case LevelMinWasteFit: newNode = FindPositionForNewNodeMinWaste(width, height, rot, bestHeight, tieBreak, bestIndex); break;
+	default: assert(false); break;
+	}
+
+	if (bestIndex != -1)
+	{
+		AddSkylineLevel(bestIndex, newNode);
+		usedSurfaceArea += width * height;
+	}
+
+	return newNode;
+}
+
+bool SkylineBinPack::RectangleFits(int skylineNodeIndex, int width, int height, int &y) const
+{
+	int x = skyLine[skylineNodeIndex].x;
+	if (x + width > binWidth)
+		return false;
+	int widthLeft = width;
+	int i = skylineNodeIndex;
+	y = skyLine[skylineNodeIndex].y;
+	while(widthLeft > 0)
+	{
+		y = max(y, skyLine[i].y);
+		if (y + height > binHeight)
+			return false;
+		widthLeft -= skyLine[i].width;
+		++i;
+		assert(i < (int)skyLine.size() || widthLeft <= 0);
+	}
+	return true;
+}
+
+int SkylineBinPack::ComputeWastedArea(int skylineNodeIndex, int width, int y) const
+{
+	int wastedArea = 0;
+	const int rectLeft = skyLine[skylineNodeIndex].x;
+	const int rectRight = rectLeft + width;
+	for(; skylineNodeIndex < (int)skyLine.size() && skyLine[skylineNodeIndex].x < rectRight; ++skylineNodeIndex)
+	{
+		if (skyLine[skylineNodeIndex].x >= rectRight || skyLine[skylineNodeIndex].x + skyLine[skylineNodeIndex].width <= rectLeft)
+			break;
+
+		int leftSide = skyLine[skylineNodeIndex].x;
+		int rightSide = min(rectRight, leftSide + skyLine[skylineNodeIndex].width);
+		assert(y >= skyLine[skylineNodeIndex].y);
+		wastedArea += (rightSide - leftSide) * (y - skyLine[skylineNodeIndex].y);
+	}
+	return wastedArea;
+}
+
+bool SkylineBinPack::RectangleFits(int skylineNodeIndex, int width, int height, int &y, int &wastedArea) const
+{
+	bool fits = RectangleFits(skylineNodeIndex, width, height, y);
+	if (fits)
+		wastedArea = ComputeWastedArea(skylineNodeIndex, width, y);
+
+	return fits;
+}
+
+void SkylineBinPack::AddWasteMapArea(int skylineNodeIndex, int width, int y)
+{
+	const int rectLeft = skyLine[skylineNodeIndex].x;
+	const int rectRight = rectLeft + width;
+	for(; skylineNodeIndex < (int)skyLine.size() && skyLine[skylineNodeIndex].x < rectRight; ++skylineNodeIndex)
+	{
+		if (skyLine[skylineNodeIndex].x >= rectRight || skyLine[skylineNodeIndex].x + skyLine[skylineNodeIndex].width <= rectLeft)
+			break;
+
+		int leftSide = skyLine[skylineNodeIndex].x;
+		int rightSide = min(rectRight, leftSide + skyLine[skylineNodeIndex].width);
+		assert(y >= skyLine[skylineNodeIndex].y);
+
+		Rect waste;
+		waste.x = leftSide;
+		waste.y = skyLine[skylineNodeIndex].y;
+		waste.width = rightSide - leftSide;
+		waste.height = y - skyLine[skylineNodeIndex].y;
+
+		// The segment the rectangle rests on leaves no gap under it.
+		if (waste.height > 0)
+			wasteMap.GetFreeRectangles().push_back(waste);
+	}
+}
+
+void SkylineBinPack::AddSkylineLevel(int skylineNodeIndex, const Rect &rect)
+{
+	// First track all wasted areas and mark them into the waste map if we're using one.
+	if (useWasteMap)
+		AddWasteMapArea(skylineNodeIndex, rect.width, rect.y);
+
+	SkylineNode newNode;
+	newNode.x = rect.x;
+	newNode.y = rect.y + rect.height;
+	newNode.width = rect.width;
+	skyLine.insert(skyLine.begin() + skylineNodeIndex, newNode);
+
+	assert(newNode.x + newNode.width <= binWidth);
+	assert(newNode.y <= binHeight);
+
+	// Cut the segments the new one covers (wholly or partly) out of the skyline.
+	for(size_t i = skylineNodeIndex+1; i < skyLine.size(); ++i)
+	{
+		assert(skyLine[i-1].x <= skyLine[i].x);
+
+		if (skyLine[i].x < skyLine[i-1].x + skyLine[i-1].width)
+		{
+			int shrink = skyLine[i-1].x + skyLine[i-1].width - skyLine[i].x;
+
+			skyLine[i].x += shrink;
+			skyLine[i].width -= shrink;
+
+			if (skyLine[i].width <= 0)
+			{
+				skyLine.erase(skyLine.begin() + i);
+				--i;
+			}
+			else
+				break;
+		}
+		else
+			break;
+	}
+	MergeSkylines();
+}
+
+void SkylineBinPack::MergeSkylines()
+{
+	for(size_t i = 0; i + 1 < skyLine.size(); ++i)
+		if (skyLine[i].y == skyLine[i+1].y)
+		{
+			skyLine[i].width += skyLine[i+1].width;
+			skyLine.erase(skyLine.begin() + (i+1));
+			--i;
+		}
+}
+
+Rect SkylineBinPack::FindPositionForNewNodeBottomLeft(int width, int height, bool rot, int &bestHeight, int &bestWidth, int &bestIndex) const
+{
+	bestHeight = std::numeric_limits<int>::max();
+	bestIndex = -1;
+	// Used to break ties if there are nodes at the same level. Then pick the narrowest one.
+	bestWidth = std::numeric_limits<int>::max();
+	Rect newNode;
+	memset(&newNode, 0, sizeof(newNode));
+	for(size_t i = 0; i < skyLine.size(); ++i)
+	{
+		int y;
+		if (RectangleFits(i, width, height, y))
+		{
+			if (y + height < bestHeight || (y + height == bestHeight && skyLine[i].width < bestWidth))
+			{
+				bestHeight = y + height;
+				bestIndex = i;
+				bestWidth = skyLine[i].width;
+				newNode.x = skyLine[i].x;
+				newNode.y = y;
+				newNode.width = width;
+				newNode.height = height;
+			}
+		}
+		if (rot && RectangleFits(i, height, width, y))
+		{
+			if (y + width < bestHeight || (y + width == bestHeight && skyLine[i].width < bestWidth))
+			{
+				bestHeight = y + width;
+				bestIndex = i;
+				bestWidth = skyLine[i].width;
+				newNode.x = skyLine[i].x;
+				newNode.y = y;
+				newNode.width = height;
+				newNode.height = width;
+			}
+		}
+	}
+
+	return newNode;
+}
+
+Rect SkylineBinPack::FindPositionForNewNodeMinWaste(int width, int height, bool rot, int &bestHeight, int &bestWastedArea, int &bestIndex) const
+{
+	bestHeight = std::numeric_limits<int>::max();
+	bestWastedArea = std::numeric_limits<int>::max();
+	bestIndex = -1;
+	Rect newNode;
+	memset(&newNode, 0, sizeof(newNode));
+	for(size_t i = 0; i < skyLine.size(); ++i)
+	{
+		int y;
+		int wastedArea;
+
+		if (RectangleFits(i, width, height, y, wastedArea))
+		{
+			if (wastedArea < bestWastedArea || (wastedArea == bestWastedArea && y + height < bestHeight))
+			{
+				bestHeight = y + height;
+				bestWastedArea = wastedArea;
+				bestIndex = i;
+				newNode.x = skyLine[i].x;
+				newNode.y = y;
+				newNode.width = width;
+				newNode.height = height;
+			}
+		}
+		if (rot && RectangleFits(i, height, width, y, wastedArea))
+		{
+			if (wastedArea < bestWastedArea || (wastedArea == bestWastedArea && y + width < bestHeight))
+			{
+				bestHeight = y + width;
+				bestWastedArea = wastedArea;
+				bestIndex = i;
+				newNode.x = skyLine[i].x;
+				newNode.y = y;
+				newNode.width = height;
+				newNode.height = width;
+			}
+		}
+	}
+
+	return newNode;
+}
+
+/// Computes the ratio of used surface area to the total bin area.
+float SkylineBinPack::Occupancy() const
+{
+	return (float)usedSurfaceArea / (binWidth * binHeight);
+}
+
+}
@@ -0,0 +1,95 @@
+/** @file SkylineBinPack.h
+	@author Jukka Jylnki
+
+	@brief Implements different bin packer algorithms that use the SKYLINE data structure.
+
+	This work is released to Public Domain, do whatever you want with it.
+*/
+#pragma once
+
+#include <vector>
+
+#include "Rect.h"
+#include "GuillotineBinPack.h"
+
+namespace rbp {
+
+/** Implements bin packing algorithms that use the SKYLINE data structure to store the bin contents. Uses
+	GuillotineBinPack as the waste map. */
+class SkylineBinPack
+{
+public:
+	/// Instantiates a bin of size (0,0). Call Init to create a new bin.
+	SkylineBinPack();
+
+	/// Instantiates a bin of the given size.
+	SkylineBinPack(int binWidth, int binHeight, bool useWasteMap);
+
+	/// (Re)initializes the packer to an empty bin of width x height units. Call whenever
+	/// you need to restart with a new bin.
+	/// @param useWasteMap If true, the space left under the skyline by each placement is remembered, and later
+	///		rectangles that fit into it are placed there first.
+	void Init(int binWidth, int binHeight, bool useWasteMap);
+
+	/// Defines the different heuristic rules that can be used to decide how to make the rectangle placements.
+	enum LevelChoiceHeuristic
+	{
+		LevelBottomLeft, ///< -BL: Places the rectangle as low as possible, then on the narrowest skyline segment.
+		LevelMinWasteFit ///< -MW: Places the rectangle where it leaves the least space under it, then as low as possible.
+	};
+
+	/// Inserts a single rectangle into the bin, possibly rotated.
+	/// @return The placement of the rectangle, or a rectangle of height 0 if it didn't fit.
+	Rect Insert(int width, int height, bool rot, LevelChoiceHeuristic method);
+
+	/// Computes the ratio of used surface area to the total bin area.
+	float Occupancy() const;
+
+private:
+	int binWidth;
+	int binHeight;
+
+	/// Represents a single level (a horizontal line) of the skyline/horizon/envelope.
+	struct SkylineNode
+	{
+		/// The starting x-coordinate (leftmost).
+		int x;
+
+		/// The y-coordinate of the skyline level line.
+		int y;
+
+		/// The line width. The ending coordinate (inclusive) will be x+width-1.
+		int width;
+	};
+
+	/// The skyline, ordered left to right. The segments cover the whole width of the bin without gaps, and
+	/// neighbouring segments are always at different heights.
+	std::vector<SkylineNode> skyLine;
+
+	unsigned long usedSurfaceArea;
+
+	/// If true, we use the GuillotineBinPack structure to recover wasted areas into a waste map.
+	bool useWasteMap;
+	GuillotineBinPack wasteMap;
+
+	Rect FindPositionForNewNodeMinWaste(int width, int height, bool rot, int &bestHeight, int &bestWastedArea, int &bestIndex) const;
+	Rect FindPositionForNewNodeBottomLeft(int width, int height, bool rot, int &bestHeight, int &bestWidth, int &bestIndex) const;
+
+	/// Checks whether a rectangle of the given size can be placed with its left edge on the given skyline segment.
+	/// @param y [out] The height the rectangle would rest at: the highest skyline segment under it.
+	bool RectangleFits(int skylineNodeIndex, int width, int height, int &y) const;
+	/// Like the above, and also computes the area left empty under the rectangle.
+	bool RectangleFits(int skylineNodeIndex, int width, int height, int &y, int &wastedArea) const;
+	int ComputeWastedArea(int skylineNodeIndex, int width, int y) const;
+
+	/// Adds the area left empty under a rectangle placed at the given skyline segment to the waste map.
+	void AddWasteMapArea(int skylineNodeIndex, int width, int y);
+
+	/// Raises the skyline under the given (just placed) rectangle to its top edge.
+	void AddSkylineLevel(int skylineNodeIndex, const Rect &rect);
+
+	/// Merges all skyline nodes that are at the same level.
+	void MergeSkylines();
+};
+
+}
@@ -0,0 +1,256 @@
+/*
+ 
+ MIT License
+ 
+ Copyright (c) 2017 Chevy Ray Johnston
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+#include "binpacker.hpp"
+
+using namespace rbp;
+
+bool ParsePackEngine(string const& name, PackEngine& outEngine)
+{
+	for (PackEngine engine : { PackEngine::MaxRects, PackEngine::Skyline, PackEngine::Guillotine })
+	{
+		if (name == PackEngineName(engine))
+		{
+			outEngine = engine;
+			return true;
+		}
+	}
+	return false;
+}
+char const* PackEngineName(PackEngine engine)
+{
+	switch (engine)
+	{
+	case PackEngine::MaxRects: return "maxrects";
+	case PackEngine::Skyline: return "skyline";
+	case PackEngine::Guillotine: return "guillotine";
+	}
+	return "unknown";
+}
+
+bool ParseGuillotineFit(string const& name, GuillotineBinPack::FreeRectChoiceHeuristic& outFit)
+{
+	for (GuillotineBinPack::FreeRectChoiceHeuristic fit : { 
+		GuillotineBinPack::RectBestAreaFit, GuillotineBinPack::RectBestShortSideFit, 
+		GuillotineBinPack::RectBestLongSideFit, GuillotineBinPack::RectWorstAreaFit, 
+		GuillotineBinPack::RectWorstShortSideFit, GuillotineBinPack::RectWorstLongSideFit })
+	{
+		if (name == GuillotineFitName(fit))
+		{
+			outFit = fit;
+			return true;
+		}
+	}
+	return false;
+}
+char const* GuillotineFitName(GuillotineBinPack::FreeRectChoiceHeuristic fit)
+{
+	switch (fit)
+	{
+	case GuillotineBinPack::RectBestAreaFit: return "baf";
+	case GuillotineBinPack::RectBestShortSideFit: return "bssf";
+	case GuillotineBinPack::RectBestLongSideFit: return "blsf";
+	case GuillotineBinPack::RectWorstAreaFit: return "waf";
+	case GuillotineBinPack::RectWorstShortSideFit: return "wssf";
+	case GuillotineBinPack::RectWorstLongSideFit: return "wlsf";
+	}
+	return "unknown";
+}
+
+bool ParseGuillotineSplit(string const& name, GuillotineBinPack::GuillotineSplitHeuristic& outSplit)
+{
+	for (GuillotineBinPack::GuillotineSplitHeuristic split : { 
+		GuillotineBinPack::SplitShorterLeftoverAxis, GuillotineBinPack::SplitLongerLeftoverAxis, 
+		GuillotineBinPack::SplitMinimizeArea, GuillotineBinPack::SplitMaximizeArea, 
+		GuillotineBinPack::SplitShorterAxis, GuillotineBinPack::SplitLongerAxis })
+	{
+		if (name == GuillotineSplitName(split))
+		{
+			outSplit = split;
+			return true;
+		}
+	}
+	return false;
+}
+char const* GuillotineSplitName(GuillotineBinPack::GuillotineSplitHeuristic split)
+{
+	switch (split)
+	{
+	case GuillotineBinPack::SplitShorterLeftoverAxis: return "slas";
+	case GuillotineBinPack::SplitLongerLeftoverAxis: return "llas";
+	case GuillotineBinPack::SplitMinimizeArea: return "minas";
+	case GuillotineBinPack::SplitMaximizeArea: return "maxas";
+	case GuillotineBinPack::SplitShorterAxis: return "sas";
+	case GuillotineBinPack::SplitLongerAxis: return "las";
+	}
+	return "unknown";
+}
+
+bool ParseSkylineLevel(string const& name, SkylineBinPack::LevelChoiceHeuristic& outLevel)
+{
+	for (SkylineBinPack::LevelChoiceHeuristic level : { SkylineBinPack::LevelBottomLeft, SkylineBinPack::LevelMinWasteFit })
+	{
+		if (name == SkylineLevelName(level))
+		{
+			outLevel = level;
+			return true;
+		}
+	}
+	return false;
+}
+char const* SkylineLevelName(SkylineBinPack::LevelChoiceHeuristic level)
+{
+	switch (level)
+	{
+	case SkylineBinPack::LevelBottomLeft: return "bl";
+	case SkylineBinPack::LevelMinWasteFit: return "mw";
+	}
+	return "unknown";
+}
+
+char const* MaxRectsFitName(MaxRectsBinPack::FreeRectChoiceHeuristic fit)
+{
+	switch (fit)
+	{
+	case MaxRectsBinPack::RectBestShortSideFit: return "bssf";
+	case MaxRectsBinPack::RectBestLongSideFit: return "blsf";
+	case MaxRectsBinPack::RectBestAreaFit: return "baf";
+	case MaxRectsBinPack::RectBottomLeftRule: return "bl";
+	case MaxRectsBinPack::RectContactPointRule: return "cp";
+	}
+	return "unknown";
+}
+
+PackSettings::PackSettings()
+	:engine(PackEngine::MaxRects)
+	,maxRectsFit(MaxRectsBinPack::RectBestShortSideFit)
+	,globalFit(false)
+	,skylineLevel(SkylineBinPack::LevelMinWasteFit)
+	,skylineWasteMap(true)
+	,guillotineFit(GuillotineBinPack::RectBestShortSideFit)
+	,guillotineSplit(GuillotineBinPack::SplitShorterLeftoverAxis)
+	,guillotineMerge(true)
+{
+}
+
+string PackSettingsName(PackSettings const& settings)
+{
+	string name = PackEngineName(settings.engine);
+	switch (settings.engine)
+	{
+	case PackEngine::MaxRects:
+		name = name + ' ' + MaxRectsFitName(settings.maxRectsFit);
+		break;
+	case PackEngine::Skyline:
+		name = name + ' ' + SkylineLevelName(settings.skylineLevel);
+		if (!settings.skylineWasteMap)
+			name += " no waste map";
+		break;
+	case PackEngine::Guillotine:
+		name = name + ' ' + GuillotineFitName(settings.guillotineFit) + ' ' + GuillotineSplitName(settings.guillotineSplit);
+		if (!settings.guillotineMerge)
+			name += " no merge";
+		break;
+	}
+	if (settings.globalFit)
+		name += " global fit";
+	return name;
+}
+
+size_t BinPacker::Insert(vector<RectSize> const& rects, vector<Rect>& dst, bool rotate)
+{
+	dst.resize(rects.size());
+	size_t numFit = 0;
+	for (size_t i = 0; i < rects.size(); ++i)
+	{
+		dst[i] = Insert(rects[i].width, rects[i].height, rotate);
+		if (dst[i].width != 0 && dst[i].height != 0)
+			numFit++;
+	}
+	return numFit;
+}
+
+namespace
+{
+	class MaxRectsPacker : public BinPacker
+	{
+	public:
+		MaxRectsPacker(MaxRectsBinPack::FreeRectChoiceHeuristic fit) : fit(fit) {}
+		void Init(int width, int height) override { bin.Init(width, height); }
+		Rect Insert(int width, int height, bool rotate) override { return bin.Insert(width, height, rotate, fit); }
+		// the batch insert picks whichever rect fits best next
+		size_t Insert(vector<RectSize> const& rects, vector<Rect>& dst, bool rotate) override
+		{
+			return bin.Insert(rects, dst, rotate, fit);
+		}
+		bool Occupy(Rect const& rect) override { return bin.Occupy(rect); }
+	private:
+		MaxRectsBinPack bin;
+		MaxRectsBinPack::FreeRectChoiceHeuristic fit;
+	};
+	
+	class SkylinePacker : public BinPacker
+	{
+	public:
+		SkylinePacker(SkylineBinPack::LevelChoiceHeuristic level, bool wasteMap) : level(level), wasteMap(wasteMap) {}
+		void Init(int width, int height) override { bin.Init(width, height, wasteMap); }
+		Rect Insert(int width, int height, bool rotate) override { return bin.Insert(width, height, rotate, level); }
+		using BinPacker::Insert;
+	private:
+		SkylineBinPack bin;
+		SkylineBinPack::LevelChoiceHeuristic level;
+		bool wasteMap;
+	};
+	
+	class GuillotinePacker : public BinPacker
+	{
+	public:
+		GuillotinePacker(GuillotineBinPack::FreeRectChoiceHeuristic fit, 
+			GuillotineBinPack::GuillotineSplitHeuristic split, bool merge) : fit(fit), split(split), merge(merge) {}
+		void Init(int width, int height) override { bin.Init(width, height); }
+		Rect Insert(int width, int height, bool rotate) override { return bin.Insert(width, height, rotate, merge, fit, split); }
+		using BinPacker::Insert;
+	private:
+		GuillotineBinPack bin;
+		GuillotineBinPack::FreeRectChoiceHeuristic fit;
+		GuillotineBinPack::GuillotineSplitHeuristic split;
+		bool merge;
+	};
+}
+
+unique_ptr<BinPacker> MakeBinPacker(PackSettings const& settings)
+{
+	switch (settings.engine)
+	{
+	case PackEngine::Skyline:
+		return make_unique<SkylinePacker>(settings.skylineLevel, settings.skylineWasteMap);
+	case PackEngine::Guillotine:
+		return make_unique<GuillotinePacker>(settings.guillotineFit, settings.guillotineSplit, settings.guillotineMerge);
+	case PackEngine::MaxRects:
+		break;
+	}
+	return make_unique<MaxRectsPacker>(settings.maxRectsFit);
+}
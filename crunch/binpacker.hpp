@@ -0,0 +1,111 @@
+/*
+ 
+ MIT License
+ 
+ Copyright (c) 2017 Chevy Ray Johnston
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+#ifndef binpacker_hpp
+#define binpacker_hpp
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "MaxRectsBinPack.h"
+#include "SkylineBinPack.h"
+#include "GuillotineBinPack.h"
+
+using namespace std;
+
+// The bin packing algorithms a page can be packed w/, picked w/ --packer
+enum class PackEngine
+{
+	// free rectangles that may overlap: the tightest, & the slowest
+	MaxRects,
+	// only tracks the top edge of what's packed (plus a map of the gaps left 
+	//	under it): the fastest //
+	Skyline,
+	// splits the free space into disjoint rectangles
+	Guillotine
+};
+// returns false if name isn't one of "maxrects", "skyline" or "guillotine"
+bool ParsePackEngine(string const& name, PackEngine& outEngine);
+char const* PackEngineName(PackEngine engine);
+
+// The names below are the abbreviations the rbp headers document the 
+//	heuristics with, in lower case ("bssf", "slas", ...) //
+bool ParseGuillotineFit(string const& name, rbp::GuillotineBinPack::FreeRectChoiceHeuristic& outFit);
+char const* GuillotineFitName(rbp::GuillotineBinPack::FreeRectChoiceHeuristic fit);
+bool ParseGuillotineSplit(string const& name, rbp::GuillotineBinPack::GuillotineSplitHeuristic& outSplit);
+char const* GuillotineSplitName(rbp::GuillotineBinPack::GuillotineSplitHeuristic split);
+bool ParseSkylineLevel(string const& name, rbp::SkylineBinPack::LevelChoiceHeuristic& outLevel);
+char const* SkylineLevelName(rbp::SkylineBinPack::LevelChoiceHeuristic level);
+char const* MaxRectsFitName(rbp::MaxRectsBinPack::FreeRectChoiceHeuristic fit);
+
+// Which bin packer the pages are packed w/, and how it's tuned.  Only the 
+//	settings of the engine picked are used, apart from globalFit. //
+struct PackSettings
+{
+	PackEngine engine;
+	// maxrects: how a free spot is picked (best short side fit by default)
+	rbp::MaxRectsBinPack::FreeRectChoiceHeuristic maxRectsFit;
+	// Instead of taking the bitmaps in order, the page is packed w/ 
+	//	whichever one fits best next.  Slower, but usually tighter.  Engines 
+	//	that can't look ahead pack every bitmap that still fits instead. //
+	bool globalFit;
+	// skyline: where a rect goes on the skyline (min waste fit by default)
+	rbp::SkylineBinPack::LevelChoiceHeuristic skylineLevel;
+	// skyline: fill the gaps left under the skyline (on by default)
+	bool skylineWasteMap;
+	// guillotine: how a free rect is picked (best short side fit by default)
+	rbp::GuillotineBinPack::FreeRectChoiceHeuristic guillotineFit;
+	// guillotine: which way the rest of the free rect is cut (shorter 
+	//	leftover axis by default) //
+	rbp::GuillotineBinPack::GuillotineSplitHeuristic guillotineSplit;
+	// guillotine: merge neighbouring free rects after each insert (on by default)
+	bool guillotineMerge;
+	PackSettings();
+};
+// the engine & the settings of it that are used, eg. "guillotine baf slas"
+string PackSettingsName(PackSettings const& settings);
+
+// What Packer needs from a bin packing algorithm.  Sizes & rects here 
+//	include the padding; Packer takes care of that. //
+class BinPacker
+{
+public:
+	virtual ~BinPacker() {}
+	// empties the bin & resizes it
+	virtual void Init(int width, int height) = 0;
+	// returns a rect of 0 width & height if it doesn't fit
+	virtual rbp::Rect Insert(int width, int height, bool rotate) = 0;
+	// Inserts as many of rects as fit.  dst[i] is where rects[i] went, or 0 
+	//	width & height if it didn't fit.  Returns the number that fit.  By 
+	//	default they're inserted in order, skipping those that don't fit. //
+	virtual size_t Insert(vector<rbp::RectSize> const& rects, vector<rbp::Rect>& dst, bool rotate);
+	// Marks rect as used, for putting bitmaps back where an earlier run 
+	//	packed them.  Returns false if it isn't free, or the engine can't. //
+	virtual bool Occupy(rbp::Rect const&) { return false; }
+};
+unique_ptr<BinPacker> MakeBinPacker(PackSettings const& settings);
+
+#endif
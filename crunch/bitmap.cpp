@@ -29,10 +29,42 @@
 #define LODEPNG_NO_COMPILE_CPP
 #include "lodepng.h"
 #include <algorithm>
+#include <cstring>
 #include "hash.hpp"
+#include "xxhash.hpp"
+#include "simd.hpp"
+#include "pixelarena.hpp"
+#include "zlibbackend.hpp"
 #include <assert.h>
+#include <atomic>
 using namespace std;
-Bitmap::Bitmap(Bitmap const& other)
+static atomic<size_t> numHeapPixelBuffers(0);
+size_t GetNumHeapPixelBuffers()
+{
+	return numHeapPixelBuffers;
+}
+// takes ownership of a malloc'd/calloc'd pixel buffer //
+static shared_ptr<uint32_t> AdoptPixels(uint32_t* pixels)
+{
+	numHeapPixelBuffers++;
+	return shared_ptr<uint32_t>(pixels, free);
+}
+// returns a zeroed buffer of width x height pixels, from the arena if given
+//	and the buffer fits //
+static shared_ptr<uint32_t> AllocPixels(int width, int height, PixelArena* arena)
+{
+	const size_t count = static_cast<size_t>(width) * height;
+	if (arena)
+	{
+		shared_ptr<uint32_t> pixels = arena->Allocate(count);
+		if (pixels)
+		{
+			return pixels;
+		}
+	}
+	return AdoptPixels(reinterpret_cast<uint32_t*>(calloc(count, sizeof(uint32_t))));
+}
+Bitmap::Bitmap(Bitmap const& other, PixelArena* arena)
 	:name(other.name)
 	,width(other.width)
 	,height(other.height)
@@ -40,129 +72,199 @@ Bitmap::Bitmap(Bitmap const& other)
 	,frameY(other.frameY)
 	,frameW(other.frameW)
 	,frameH(other.frameH)
+	,stride(other.width)
+	,storage(AllocPixels(other.width, other.height, arena))
 	,hashValue(other.hashValue)
 {
-	data = reinterpret_cast<uint32_t*>(
-		calloc(width * height, sizeof(uint32_t)));
+	data = storage.get();
 	CopyPixels(&other, 0, 0, 0);
 }
-Bitmap::Bitmap(const string& file, const string& name, bool premultiply, bool trim)
-: name(name)
+unique_ptr<Bitmap> Bitmap::Load(const string& file, const string& name, bool premultiply, bool trim)
 {
     //Load the png file
     unsigned char* pdata;
     unsigned int pw, ph;
-    if (lodepng_decode32_file(&pdata, &pw, &ph, file.data()))
+    if (DecodePng32File(&pdata, &pw, &ph, file))
     {
         cerr << "failed to load png: " << file << endl;
-        exit(EXIT_FAILURE);
+        return nullptr;
     }
 	int w = static_cast<int>(pw);
 	int h = static_cast<int>(ph);
-	uint32_t*const pixels = reinterpret_cast<uint32_t*>(pdata);
-	postLoadProcess(file, premultiply, trim, pixels, w, h);
+	unique_ptr<Bitmap> bitmap(new Bitmap());
+	bitmap->name = name;
+	bitmap->postLoadProcess(file, premultiply, trim, 
+		AdoptPixels(reinterpret_cast<uint32_t*>(pdata)), w, h, nullptr);
+	return bitmap;
 }
 Bitmap::Bitmap(Bitmap const* bmSource, int sourceOffsetX, int sourceOffsetY,
 	int frameWidth, int frameHeight,
-	const string& name, bool premultiply, bool trim)
+	const string& name, bool premultiply, bool trim, PixelArena* arena)
 {
 	this->name = name;
-	// Create a new pixel data buffer and copy the desired subregion from 
-	//	bmSource into it //
-	uint32_t*const pixels = reinterpret_cast<uint32_t*>(
-		calloc(frameWidth * frameHeight, sizeof(uint32_t)));
-	for (int y = 0; y < frameHeight; y++)
+	uint32_t*const sourcePixels = bmSource->data + 
+		static_cast<size_t>(sourceOffsetY) * bmSource->stride + sourceOffsetX;
+	if (premultiply)
 	{
-		for (int x = 0; x < frameWidth; x++)
+		// we can't modify bmSource's pixels, so premultiply a copy of the
+		//	desired subregion & run post load processes on that instead //
+		shared_ptr<uint32_t> pixels = AllocPixels(frameWidth, frameHeight, arena);
+		for (int y = 0; y < frameHeight; y++)
 		{
-			const size_t i = y * frameWidth + x;
-			const size_t iSrc =
-				(sourceOffsetY + y) * bmSource->width + (sourceOffsetX + x);
-			pixels[i] = bmSource->data[iSrc];
+			memcpy(pixels.get() + static_cast<size_t>(y) * frameWidth, 
+				sourcePixels + static_cast<size_t>(y) * bmSource->stride,
+				sizeof(uint32_t) * frameWidth);
 		}
+		postLoadProcess(bmSource->name, premultiply, trim, move(pixels), frameWidth, frameHeight, arena);
+		return;
+	}
+	// Otherwise, trim the subregion in place and become a view into bmSource's
+	//	pixels, so the frame never needs a buffer of its own //
+	int minX = 0;
+	int minY = 0;
+	int maxX = frameWidth - 1;
+	int maxY = frameHeight - 1;
+	if (trim && !FindOpaqueBounds(sourcePixels, frameWidth, frameHeight, bmSource->stride,
+		minX, minY, maxX, maxY))
+	{
+		minX = 0;
+		minY = 0;
+		maxX = frameWidth - 1;
+		maxY = frameHeight - 1;
+		cout << "image is completely transparent: " << bmSource->name << endl;
 	}
-	// Then, run post load processes on the new pixel data 
-	//	just like the other contructor //
-	postLoadProcess(bmSource->name, premultiply, trim, pixels, frameWidth, frameHeight);
+	width = (maxX - minX) + 1;
+	height = (maxY - minY) + 1;
+	frameX = -minX;
+	frameY = -minY;
+	frameW = frameWidth;
+	frameH = frameHeight;
+	data = sourcePixels + static_cast<size_t>(minY) * bmSource->stride + minX;
+	stride = bmSource->stride;
+	storage = bmSource->storage;
+	computeHash();
 }
+// blank bitmaps are scratch space that is thrown away again, so they're
+//	kept out of the arena
 Bitmap::Bitmap(int width, int height)
-: width(width), height(height)
+: width(width), height(height), stride(width), storage(AllocPixels(width, height, nullptr))
+{
+    data = storage.get();
+}
+Bitmap::Bitmap(const string& name, int width, int height, 
+	uint32_t* data, int stride, shared_ptr<uint32_t> storage)
+: name(name), width(width), height(height), frameX(0), frameY(0), frameW(width), frameH(height)
+, data(data), stride(stride), storage(move(storage)), hashValue(0)
 {
-    data = reinterpret_cast<uint32_t*>(calloc(width * height, sizeof(uint32_t)));
 }
 
-Bitmap::~Bitmap()
+BitmapView Bitmap::view() const
 {
-    free(data);
+	return { data, width, height, stride };
 }
 
-void Bitmap::SaveAs(const string& file)
+void Bitmap::releasePixels()
 {
+	data = nullptr;
+	storage.reset();
+}
+
+bool Bitmap::SaveAs(const string& file)
+{
+	// lodepng wants tightly packed rows
+	if (stride != width)
+	{
+		return Bitmap(*this).SaveAs(file);
+	}
     unsigned char* pdata = reinterpret_cast<unsigned char*>(data);
     unsigned int pw = static_cast<unsigned int>(width);
     unsigned int ph = static_cast<unsigned int>(height);
-    if (lodepng_encode32_file(file.data(), pdata, pw, ph))
+    LodePNGState state;
+    lodepng_state_init(&state);
+    UseZlibBackend(state.encoder.zlibsettings);
+    unsigned char* png = nullptr;
+    size_t pngSize = 0;
+    unsigned error = lodepng_encode(&png, &pngSize, pdata, pw, ph, &state);
+    lodepng_state_cleanup(&state);
+    if (!error)
+    {
+        error = lodepng_save_file(png, pngSize, file.data());
+    }
+    free(png);
+    if (error)
     {
         cout << "failed to save png: " << file << endl;
-        exit(EXIT_FAILURE);
+        return false;
     }
+    return true;
 }
 
 void Bitmap::CopyPixels(const Bitmap* src, int tx, int ty, int edgePadSize)
 {
-	for (int y = -edgePadSize; y < src->height + edgePadSize; ++y)
+	const BitmapView srcView = src->view();
+	// rows that fall outside of this bitmap are skipped
+	const int yBegin = max(-edgePadSize, -ty);
+	const int yEnd = min(src->height + edgePadSize, height - ty);
+	for (int y = yBegin; y < yEnd; ++y)
 	{
+		uint32_t const*const srcRow = srcView.row(std::clamp(y, 0, src->height - 1));
+		uint32_t*const dstRow = data + static_cast<size_t>(ty + y) * stride + tx;
+		if (edgePadSize == 0)
+		{
+			memcpy(dstRow, srcRow, sizeof(uint32_t) * src->width);
+			continue;
+		}
 		for (int x = -edgePadSize; x < src->width + edgePadSize; ++x)
 		{
-			const int srcX = std::clamp(x, 0, src->width  - 1);
-			const int srcY = std::clamp(y, 0, src->height - 1);
-            data[(ty + y) * width + (tx + x)] = src->data[srcY * src->width + srcX];
+			dstRow[x] = srcRow[std::clamp(x, 0, src->width - 1)];
 		}
 	}
 }
 void Bitmap::CopyPixelsRot(const Bitmap* src, int tx, int ty, int edgePadSize)
 {
     int r = src->height - 1;
-	for (int y = -edgePadSize; y < src->width + edgePadSize; ++y)
+	// rows that fall outside of this bitmap are skipped
+	const int yBegin = max(-edgePadSize, -ty);
+	const int yEnd = min(src->width + edgePadSize, height - ty);
+	for (int y = yBegin; y < yEnd; ++y)
 	{
 		for (int x = -edgePadSize; x < src->height + edgePadSize; ++x)
 		{
-			const int srcX = std::clamp(x, 0, src->width  - 1);
-			const int srcY = std::clamp(y, 0, src->height - 1);
-            data[(ty + y) * width + (tx + x)] = src->data[(r - srcX) * src->width + srcY];
+			// destination x walks up the source's rows & y along its columns
+			const int srcRow = r - std::clamp(x, 0, src->height - 1);
+			const int srcCol = std::clamp(y, 0, src->width - 1);
+            data[(ty + y) * stride + (tx + x)] = src->data[srcRow * src->stride + srcCol];
 		}
 	}
 }
 
 bool Bitmap::Equals(const Bitmap* other) const
 {
-    if (width == other->width && height == other->height)
-        return memcmp(data, other->data, sizeof(uint32_t) * width * height) == 0;
-    return false;
+	if (width != other->width || height != other->height)
+	{
+		return false;
+	}
+	const BitmapView a = view();
+	const BitmapView b = other->view();
+	for (int y = 0; y < height; y++)
+	{
+		if (memcmp(a.row(y), b.row(y), sizeof(uint32_t) * width) != 0)
+		{
+			return false;
+		}
+	}
+	return true;
 }
 void Bitmap::postLoadProcess(string const& fileName, bool premultiply, 
-	bool trim, uint32_t* pixels, int w, int h)
+	bool trim, shared_ptr<uint32_t> pixelStorage, int w, int h, PixelArena* arena)
 {
+	uint32_t*const pixels = pixelStorage.get();
 	//Premultiply all the pixels by their alpha
 	if (premultiply)
 	{
-		int count = w * h;
-		uint32_t c, a, r, g, b;
-		float m;
-		for (int i = 0; i < count; ++i)
-		{
-			c = pixels[i];
-			a = c >> 24;
-			m = static_cast<float>(a) / 255.0f;
-			r = static_cast<uint32_t>((c & 0xff) * m);
-			g = static_cast<uint32_t>(((c >> 8) & 0xff) * m);
-			b = static_cast<uint32_t>(((c >> 16) & 0xff) * m);
-			pixels[i] = (a << 24) | (b << 16) | (g << 8) | r;
-		}
+		PremultiplyPixels(pixels, static_cast<size_t>(w) * h);
 	}
 
-	//TODO: skip if all corners contain opaque pixels?
-
 	//Get pixel bounds
 	int minX = w - 1;
 	int minY = h - 1;
@@ -170,22 +272,7 @@ void Bitmap::postLoadProcess(string const& fileName, bool premultiply,
 	int maxY = 0;
 	if (trim)
 	{
-		uint32_t p;
-		for (int y = 0; y < h; ++y)
-		{
-			for (int x = 0; x < w; ++x)
-			{
-				p = pixels[y * w + x];
-				if ((p >> 24) > 0)
-				{
-					minX = min(x, minX);
-					minY = min(y, minY);
-					maxX = max(x, maxX);
-					maxY = max(y, maxY);
-				}
-			}
-		}
-		if (maxX < minX || maxY < minY)
+		if (!FindOpaqueBounds(pixels, w, h, w, minX, minY, maxX, maxY))
 		{
 			minX = 0;
 			minY = 0;
@@ -213,12 +300,14 @@ void Bitmap::postLoadProcess(string const& fileName, bool premultiply,
 		//If we aren't trimmed, use the loaded image data
 		frameX = 0;
 		frameY = 0;
+		storage = move(pixelStorage);
 		data = pixels;
 	}
 	else
 	{
 		//Create the trimmed image data
-		data = reinterpret_cast<uint32_t*>(calloc(width * height, sizeof(uint32_t)));
+		storage = AllocPixels(width, height, arena);
+		data = storage.get();
 		frameX = -minX;
 		frameY = -minY;
 
@@ -227,100 +316,110 @@ void Bitmap::postLoadProcess(string const& fileName, bool premultiply,
 			for (int x = minX; x <= maxX; ++x)
 				data[(y - minY) * width + (x - minX)] = pixels[y * w + x];
 
-		//Free the untrimmed pixels
-		free(pixels);
+		//The untrimmed pixels are freed along with pixelStorage
 	}
 
+	stride = width;
+
 	//Generate a hash for the bitmap
-	hashValue = 0;
-	HashCombine(hashValue, static_cast<size_t>(width));
-	HashCombine(hashValue, static_cast<size_t>(height));
-	HashData(hashValue, reinterpret_cast<char*>(data), sizeof(uint32_t) * width * height);
-}
-void Bitmap::maskPixels(string const& newFileName)
-{
-	name = newFileName;
-	const int numPixels = width * height;
-	uint32_t p, a;
-	for (int i = 0; i < numPixels; i++)
+	computeHash();
+}
+void Bitmap::computeHash()
+{
+	// stream row by row so that views & packed copies of the same pixels agree
+	XXH64Hasher hasher;
+	const BitmapView v = view();
+	for (int y = 0; y < height; y++)
 	{
-		p = data[i];
-		a = p >> 24;
-		if (a == 0)
-		{
-			continue;
-		}
-		data[i] = 0xFFFFFFFF;
+		hasher.Update(v.row(y), sizeof(uint32_t) * width);
 	}
+	hashValue = hasher.Digest();
+	HashCombine(hashValue, static_cast<uint64_t>(width));
+	HashCombine(hashValue, static_cast<uint64_t>(height));
+}
+void Bitmap::maskPixels(string const& newFileName)
+{
+	name = newFileName;
+	assert(storage.use_count() == 1 && stride == width);
+	MaskPixels(data, static_cast<size_t>(width) * height);
 	// re-hash this new bitmap //
-	hashValue = 0;
-	HashCombine(hashValue, static_cast<size_t>(width));
-	HashCombine(hashValue, static_cast<size_t>(height));
-	HashData(hashValue, reinterpret_cast<char*>(data), sizeof(uint32_t)* width* height);
-}
-void Bitmap::outlinePixels(string const& newFileName)
-{
-	name = newFileName;
-	const int numPixels = width * height;
-	uint32_t p, a, b, g, r;
-	for (int i = 0; i < numPixels; i++)
-	{
-		p = data[i];
-		a = p >> 24;
-		b = (p >> 16) & 0xFF;
-		g = (p >> 8 ) & 0xFF;
-		r = p & 0xFF;
-		if (a == 0 || r != 0 || g != 0 || b != 0)
+	computeHash();
+}
+void Bitmap::outlinePixels(string const& newFileName)
+{
+	name = newFileName;
+	assert(storage.use_count() == 1 && stride == width);
+	OutlinePixels(data, static_cast<size_t>(width) * height);
+	// re-hash this new bitmap //
+	computeHash();
+}
+bool Bitmap::swapPalettes(PaletteLookup const& defaultPaletteLookup,
+	vector<vector<uint32_t> const*> const& newPalettes,
+	vector<string> const& newFileNames,
+	vector<unique_ptr<Bitmap>>& outBitmaps, PixelArena* arena) const
+{
+	assert(newPalettes.size() == newFileNames.size());
+	assert(all_of(newPalettes.begin(), newPalettes.end(), [&defaultPaletteLookup](vector<uint32_t> const* newPalette) {
+		return newPalette->size() == defaultPaletteLookup.numColors;
+	}));
+	const size_t firstOut = outBitmaps.size();
+	for (size_t p = 0; p < newPalettes.size(); p++)
+	{
+		outBitmaps.push_back(make_unique<Bitmap>(*this, arena));
+		outBitmaps.back()->name = newFileNames[p];
+	}
+	uint32_t p, a, paletteIndex;
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
 		{
-			data[i] = 0;
-			continue;
-		}
-		data[i] = 0xFFFFFFFF;
+			const size_t i = y * width + x;
+			p = data[y * stride + x];
+			a = p >> 24;
+			if (a == 0)
+			{
+				continue;
+			}
+			if (!defaultPaletteLookup.Find(p, paletteIndex))
+			{
+				// report the position relative to the untrimmed frame, since 
+				//	that's what the artist will be looking at //
+				cerr << "palette swap failed: color rgb(" << (p & 0xFF) << ", " << 
+					((p >> 8) & 0xFF) << ", " << ((p >> 16) & 0xFF) << ") at (" << x - frameX << ", " << y - frameY << ") of frame '" << 
+					name << "' is not in the default palette!\n";
+				return false;
+			}
+			for (size_t np = 0; np < newPalettes.size(); np++)
+			{
+				outBitmaps[firstOut + np]->data[i] = (a << 24) | (*newPalettes[np])[paletteIndex];
+			}
+		}
 	}
-	// re-hash this new bitmap //
-	hashValue = 0;
-	HashCombine(hashValue, static_cast<size_t>(width));
-	HashCombine(hashValue, static_cast<size_t>(height));
-	HashData(hashValue, reinterpret_cast<char*>(data), sizeof(uint32_t)* width* height);
-}
-void Bitmap::swapPalette(string const& newFileName,
-	vector<uint32_t> const& defaultPalette,
-	vector<uint32_t> const& newPalette)
-{
-	assert(defaultPalette.size() == newPalette.size());
-	name = newFileName;
-	const int numPixels = width * height;
-	uint32_t p, a;
-	auto findColorIndex = [](uint32_t color,
-		vector<uint32_t> const& palette)->size_t
-	{
-		// strip the alpha channel from the color because with respect to palettes,
-		//	it doesn't matter.  All palette color data has zeroed out alpha channels //
-		color &= 0x00FFFFFF;
-		for (size_t c = 0; c < palette.size(); c++)
-		{
-			if (palette[c] == color)
-			{
-				return c;
-			}
-		}
-		return palette.size();
-	};
-	for (int i = 0; i < numPixels; i++)
-	{
-		p = data[i];
-		a = p >> 24;
-		if (a == 0)
-		{
-			continue;
-		}
-		const size_t defaultPaletteIndex = findColorIndex(p, defaultPalette);
-		assert(defaultPaletteIndex < defaultPalette.size());
-		data[i] = (a << 24) | newPalette[defaultPaletteIndex];
+	// re-hash the new bitmaps //
+	for (size_t np = 0; np < newPalettes.size(); np++)
+	{
+		outBitmaps[firstOut + np]->computeHash();
 	}
-	// re-hash this new bitmap //
-	hashValue = 0;
-	HashCombine(hashValue, static_cast<size_t>(width));
-	HashCombine(hashValue, static_cast<size_t>(height));
-	HashData(hashValue, reinterpret_cast<char*>(data), sizeof(uint32_t)* width* height);
+	return true;
+}
+PaletteLookup::PaletteLookup(vector<uint32_t> const& defaultPalette)
+	:numColors(defaultPalette.size())
+{
+	for (size_t c = 0; c < defaultPalette.size(); c++)
+	{
+		// the first occurrence of a color wins, same as a linear search would //
+		colorIndices.emplace(defaultPalette[c] & 0x00FFFFFF, static_cast<uint32_t>(c));
+	}
+}
+bool PaletteLookup::Find(uint32_t color, uint32_t& outIndex) const
+{
+	// strip the alpha channel from the color because with respect to palettes,
+	//	it doesn't matter.  All palette color data has zeroed out alpha channels //
+	auto it = colorIndices.find(color & 0x00FFFFFF);
+	if (it == colorIndices.end())
+	{
+		return false;
+	}
+	outIndex = it->second;
+	return true;
 }
\ No newline at end of file
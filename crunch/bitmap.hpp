@@ -30,9 +30,42 @@
 #include <string>
 #include <cstdint>
 #include <vector>
+#include <unordered_map>
+#include <memory>
 
 using namespace std;
 
+class PixelArena;
+
+// Maps each color of a default palette to its index, so that palette swaps
+//	don't have to search the palette for every pixel.  Build one per palette
+//	group and share it between all of the group's frames & palettes. //
+struct PaletteLookup
+{
+	// colors are stored without their alpha channel: 0x00BBGGRR
+	unordered_map<uint32_t, uint32_t> colorIndices;
+	// the size of the default palette; every palette swapped to has as many
+	size_t numColors = 0;
+	PaletteLookup() = default;
+	explicit PaletteLookup(vector<uint32_t> const& defaultPalette);
+	// returns false if the color is not part of the default palette
+	bool Find(uint32_t color, uint32_t& outIndex) const;
+};
+
+// A width x height window of pixels whose rows are stride pixels apart, so 
+//	that a frame can point straight into the sheet it was sliced out of. //
+struct BitmapView
+{
+	uint32_t const* data;
+	int width;
+	int height;
+	int stride;
+	uint32_t const* row(int y) const
+	{
+		return data + static_cast<size_t>(y) * stride;
+	}
+};
+
 struct Bitmap
 {
     string name;
@@ -44,26 +77,60 @@ struct Bitmap
     int frameH;
 	// each data element is arranged like this:
 	//	0xAABBGGRR
+	//	rows are 'stride' elements apart.  A bitmap that is a view into another 
+	//	bitmap's pixels shares its storage, so the pixels stay alive for as 
+	//	long as any view of them does, even after the source bitmap is gone.
     uint32_t* data;
-    size_t hashValue;
-	Bitmap(Bitmap const& other);
-    Bitmap(const string& file, const string& name, bool premultiply, bool trim);
+	int stride;
+	shared_ptr<uint32_t> storage;
+    uint64_t hashValue;
+	// Copies always get their own tightly packed pixels, even if other is a 
+	//	view.  Wherever a constructor or method takes an arena, the pixels it
+	//	allocates come from there if they fit, and from the heap otherwise (or
+	//	if the arena is null); the arena has to outlive the bitmap. //
+	Bitmap(Bitmap const& other, PixelArena* arena = nullptr);
+	Bitmap(Bitmap&& other) = default;
+	Bitmap& operator=(Bitmap&& other) = default;
+	Bitmap& operator=(Bitmap const& other) = delete;
+	// Decodes a png file into pixels of its own, on the heap.  Returns null,
+	//	after printing why, if it can't be read. //
+	static unique_ptr<Bitmap> Load(const string& file, const string& name, bool premultiply, bool trim);
     Bitmap(Bitmap const* bmSource, int sourceOffsetX, int sourceOffsetY, 
 		int frameWidth, int frameHeight,
-		const string& name, bool premultiply, bool trim);
+		const string& name, bool premultiply, bool trim, PixelArena* arena = nullptr);
     Bitmap(int width, int height);
-    ~Bitmap();
-    void SaveAs(const string& file);
+	// A view of pixels owned by someone else, e.g. a memory mapped cache entry.
+	//	The frame covers the whole bitmap & the hash is left at 0. //
+	Bitmap(const string& name, int width, int height, 
+		uint32_t* data, int stride, shared_ptr<uint32_t> storage);
+	// returns false, after printing why, if the png can't be written
+    bool SaveAs(const string& file);
     void CopyPixels(const Bitmap* src, int tx, int ty, int edgePadSize);
     void CopyPixelsRot(const Bitmap* src, int tx, int ty, int edgePadSize);
     bool Equals(const Bitmap* other) const;
 	void postLoadProcess(string const& fileName, bool premultiply, 
-		bool trim, uint32_t* pixels, int w, int h);
+		bool trim, shared_ptr<uint32_t> pixelStorage, int w, int h, PixelArena* arena);
 	void maskPixels(string const& newFileName);
 	void outlinePixels(string const& newFileName);
-	void swapPalette(string const& newFileName,
-		vector<uint32_t> const& defaultPalette,
-		vector<uint32_t> const& newPalette);
+	BitmapView view() const;
+	void computeHash();
+	// drops this bitmap's reference to its pixels; the name, size & frame 
+	//	info stay valid so the bitmap can still be written to the atlas data.
+	void releasePixels();
+	// Appends one recolored copy of this bitmap per entry of newPalettes to 
+	//	outBitmaps, generating all of them in a single pass over the pixels.
+	//	Returns false, after printing the offending pixel, if a color isn't in
+	//	the default palette. //
+	bool swapPalettes(PaletteLookup const& defaultPaletteLookup,
+		vector<vector<uint32_t> const*> const& newPalettes,
+		vector<string> const& newFileNames,
+		vector<unique_ptr<Bitmap>>& outBitmaps, PixelArena* arena = nullptr) const;
+private:
+	// everything is filled in by postLoadProcess
+	Bitmap() = default;
 };
 
+// the number of pixel buffers that came from the heap rather than the arena
+size_t GetNumHeapPixelBuffers();
+
 #endif
@@ -0,0 +1,1119 @@
+/*
+ 
+ MIT License
+ 
+ Copyright (c) 2017 Chevy Ray Johnston
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+#include "flate.hpp"
+#include "lodepng.h"
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+static const size_t MAX_DISTANCE = 32768;
+static const size_t MIN_MATCH = 4;
+static const size_t MAX_MATCH = 258;
+static const size_t MAX_STORED = 65535;
+static const unsigned NUM_LITLEN_SYMBOLS = 286;
+static const unsigned NUM_DIST_SYMBOLS = 30;
+static const unsigned END_OF_BLOCK = 256;
+static const unsigned MAX_CODE_LENGTH = 15;
+static const unsigned MAX_CODE_LENGTH_CODE_LENGTH = 7;
+
+static const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t DIST_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t DIST_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const uint8_t CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+static const uint8_t CODE_LENGTH_EXTRA[19] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 3, 7 };
+
+static uint32_t Load32(const unsigned char* p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+static uint64_t Load64(const unsigned char* p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+// deflate's bit order is little endian, whatever the machine's
+static uint32_t Load32LE(const unsigned char* p)
+{
+	return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | 
+		(static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+static uint64_t Load64LE(const unsigned char* p)
+{
+	return static_cast<uint64_t>(Load32LE(p)) | (static_cast<uint64_t>(Load32LE(p + 4)) << 32);
+}
+static unsigned ReverseBits(unsigned code, unsigned length)
+{
+	unsigned reversed = 0;
+	for (unsigned i = 0; i < length; i++)
+	{
+		reversed = (reversed << 1) | (code & 1);
+		code >>= 1;
+	}
+	return reversed;
+}
+// the canonical codes for the lengths, bit reversed, as deflate writes them
+static void MakeCodes(const unsigned* lengths, size_t count, uint16_t* codes)
+{
+	unsigned numOfLength[MAX_CODE_LENGTH + 1] = {};
+	for (size_t i = 0; i < count; i++)
+		numOfLength[lengths[i]]++;
+	numOfLength[0] = 0;
+	unsigned next[MAX_CODE_LENGTH + 1] = {};
+	unsigned code = 0;
+	for (unsigned length = 1; length <= MAX_CODE_LENGTH; length++)
+	{
+		code = (code + numOfLength[length - 1]) << 1;
+		next[length] = code;
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		if (lengths[i])
+			codes[i] = static_cast<uint16_t>(ReverseBits(next[lengths[i]]++, lengths[i]));
+	}
+}
+
+// The length & distance symbols of every match length & distance, and the 
+//	fixed codes, worked out once //
+struct SymbolTables
+{
+	uint8_t lengthSymbol[MAX_MATCH + 1];
+	// distances up to 256 are looked up directly, the rest by their upper bits
+	uint8_t distSymbol[512];
+	unsigned fixedLitLenLengths[288];
+	unsigned fixedDistLengths[32];
+	uint16_t fixedLitLenCodes[288];
+	uint16_t fixedDistCodes[32];
+	SymbolTables()
+	{
+		for (unsigned symbol = 0; symbol < 29; symbol++)
+		{
+			const unsigned end = symbol == 28 ? MAX_MATCH + 1 : LENGTH_BASE[symbol] + (1u << LENGTH_EXTRA[symbol]);
+			for (unsigned length = LENGTH_BASE[symbol]; length < end && length <= MAX_MATCH; length++)
+				lengthSymbol[length] = static_cast<uint8_t>(symbol);
+		}
+		for (unsigned symbol = 0; symbol < NUM_DIST_SYMBOLS; symbol++)
+		{
+			for (unsigned dist = DIST_BASE[symbol]; dist < DIST_BASE[symbol] + (1u << DIST_EXTRA[symbol]); dist++)
+			{
+				if (dist <= 256)
+					distSymbol[dist - 1] = static_cast<uint8_t>(symbol);
+				else
+					distSymbol[256 + ((dist - 1) >> 7)] = static_cast<uint8_t>(symbol);
+			}
+		}
+		for (unsigned i = 0; i < 288; i++)
+			fixedLitLenLengths[i] = i < 144 ? 8 : (i < 256 ? 9 : (i < 280 ? 7 : 8));
+		for (unsigned i = 0; i < 32; i++)
+			fixedDistLengths[i] = 5;
+		MakeCodes(fixedLitLenLengths, 288, fixedLitLenCodes);
+		MakeCodes(fixedDistLengths, 32, fixedDistCodes);
+	}
+	unsigned DistSymbol(size_t dist) const
+	{
+		return dist <= 256 ? distSymbol[dist - 1] : distSymbol[256 + ((dist - 1) >> 7)];
+	}
+};
+static SymbolTables const& GetSymbolTables()
+{
+	static const SymbolTables tables;
+	return tables;
+}
+
+uint32_t FlateAdler32(uint32_t adler, const unsigned char* data, size_t length)
+{
+	uint32_t s1 = adler & 0xFFFF;
+	uint32_t s2 = adler >> 16;
+	while (length > 0)
+	{
+		// the most bytes that can be summed before s2 could overflow
+		size_t n = min<size_t>(length, 5552);
+		length -= n;
+		for (; n >= 8; n -= 8, data += 8)
+		{
+			s1 += data[0]; s2 += s1;
+			s1 += data[1]; s2 += s1;
+			s1 += data[2]; s2 += s1;
+			s1 += data[3]; s2 += s1;
+			s1 += data[4]; s2 += s1;
+			s1 += data[5]; s2 += s1;
+			s1 += data[6]; s2 += s1;
+			s1 += data[7]; s2 += s1;
+		}
+		for (; n > 0; n--, data++)
+		{
+			s1 += *data;
+			s2 += s1;
+		}
+		s1 %= 65521;
+		s2 %= 65521;
+	}
+	return (s2 << 16) | s1;
+}
+
+namespace
+{
+// A malloc'd buffer that keeps its own capacity, so it can be handed back 
+//	to lodepng, which frees it w/ free() //
+struct OutBuffer
+{
+	unsigned char* data;
+	size_t size;
+	size_t capacity;
+	OutBuffer(unsigned char* data, size_t size)
+		:data(data)
+		,size(size)
+		,capacity(size)
+	{
+	}
+	bool Reserve(size_t extra)
+	{
+		if (capacity - size >= extra)
+			return true;
+		const size_t grown = max(capacity * 2, size + extra);
+		unsigned char*const memory = static_cast<unsigned char*>(realloc(data, grown));
+		if (!memory)
+			return false;
+		data = memory;
+		capacity = grown;
+		return true;
+	}
+};
+
+//----------------------------------------------------------------------------
+// compression
+
+// Writes bits least significant first.  The buffer has to have room for 
+//	whatever is written (see OutBuffer::Reserve) plus 8 bytes. //
+struct BitWriter
+{
+	OutBuffer& out;
+	uint64_t bits = 0;
+	unsigned count = 0;
+	explicit BitWriter(OutBuffer& out)
+		:out(out)
+	{
+	}
+	// at most 32 bits at a time
+	void Write(uint32_t value, unsigned length)
+	{
+		bits |= static_cast<uint64_t>(value) << count;
+		count += length;
+		if (count >= 32)
+		{
+			unsigned char*const p = out.data + out.size;
+			p[0] = static_cast<unsigned char>(bits);
+			p[1] = static_cast<unsigned char>(bits >> 8);
+			p[2] = static_cast<unsigned char>(bits >> 16);
+			p[3] = static_cast<unsigned char>(bits >> 24);
+			out.size += 4;
+			bits >>= 32;
+			count -= 32;
+		}
+	}
+	// pads w/ zeros to the next byte boundary & writes out what's left
+	void Align()
+	{
+		while (count > 0)
+		{
+			out.data[out.size++] = static_cast<unsigned char>(bits);
+			bits >>= 8;
+			count = count > 8 ? count - 8 : 0;
+		}
+		bits = 0;
+	}
+};
+
+struct LevelParams
+{
+	// how many earlier positions w/ the same hash are tried for each match
+	unsigned maxChain;
+	// a match this long ends the search
+	size_t niceLength;
+	// whether a match is held back a byte in case the next one is longer
+	bool lazy;
+	// lazy matching gives up on improving matches this long, and searches 
+	//	for matches after one this long w/ a quarter of the chain //
+	size_t maxLazy;
+	size_t goodLength;
+	// the positions covered by a longer match aren't hashed (greedy only)
+	size_t maxInsert;
+};
+static LevelParams GetLevelParams(FlateLevel level)
+{
+	switch (level)
+	{
+	case FlateLevel::Store:
+	case FlateLevel::Fastest: return { 8, 32, false, 0, 0, 16 };
+	case FlateLevel::Default: return { 128, 128, true, 16, 8, MAX_MATCH };
+	case FlateLevel::Best: return { 4096, MAX_MATCH, true, MAX_MATCH, 32, MAX_MATCH };
+	}
+	return { 128, 128, true, 16, 8, MAX_MATCH };
+}
+
+class Compressor
+{
+public:
+	Compressor(OutBuffer& out, const unsigned char* in, size_t insize, FlateSettings const& settings)
+		:tables(GetSymbolTables())
+		,writer(out)
+		,in(in)
+		,insize(insize)
+		,settings(settings)
+		,params(GetLevelParams(settings.level))
+		,maxDistance(min(max<size_t>(settings.maxDistance, 1), MAX_DISTANCE))
+	{
+	}
+	unsigned Run(bool final)
+	{
+		if (settings.level == FlateLevel::Store)
+		{
+			unsigned error = WriteStored(0, insize, final);
+			if (!error && !final)
+				error = WriteStored(0, 0, false);
+			if (!error)
+				writer.Align();
+			return error;
+		}
+		// the hash table & chains only need to be as big as the input
+		size_t windowSize = 1;
+		while (windowSize < min(insize, MAX_DISTANCE))
+			windowSize <<= 1;
+		windowMask = windowSize - 1;
+		hashBits = 8;
+		while (hashBits < 15 && (size_t(1) << hashBits) < insize)
+			hashBits++;
+		head.assign(size_t(1) << hashBits, -1);
+		chain.resize(windowSize);
+		tokens.reserve(MAX_BLOCK_TOKENS);
+		ResetBlock();
+		unsigned error = params.lazy ? CompressLazy() : CompressGreedy();
+		if (!error)
+			error = FlushBlock(final);
+		if (!error && !final)
+			error = WriteStored(0, 0, false);
+		if (!error)
+			writer.Align();
+		return error;
+	}
+private:
+	static const size_t MAX_BLOCK_TOKENS = 32768;
+	SymbolTables const& tables;
+	BitWriter writer;
+	const unsigned char* in;
+	const size_t insize;
+	FlateSettings const& settings;
+	const LevelParams params;
+	const size_t maxDistance;
+	size_t windowMask = 0;
+	unsigned hashBits = 0;
+	// the latest position w/ each hash, & for each position the one before it
+	vector<int32_t> head;
+	vector<int32_t> chain;
+	// the current block: literals are their byte, matches (dist << 16) | length
+	vector<uint32_t> tokens;
+	unsigned litLenFreq[NUM_LITLEN_SYMBOLS];
+	unsigned distFreq[NUM_DIST_SYMBOLS];
+	size_t blockStart = 0;
+	size_t blockSize = 0;
+
+	uint32_t Hash(size_t pos) const
+	{
+		return (Load32(in + pos) * 0x9E3779B1u) >> (32 - hashBits);
+	}
+	// adds pos to its hash chain, returning the position before it (or -1)
+	int32_t Insert(size_t pos)
+	{
+		const uint32_t hash = Hash(pos);
+		const int32_t previous = head[hash];
+		head[hash] = static_cast<int32_t>(pos);
+		chain[pos & windowMask] = previous;
+		return previous;
+	}
+	// The longest match for pos that's longer than bestLength, starting 
+	//	the search at the earlier position candidate.  Returns bestLength if
+	//	there's nothing longer. //
+	size_t LongestMatch(int32_t candidate, size_t pos, size_t bestLength, size_t& outDist) const
+	{
+		const size_t maxLength = min(MAX_MATCH, insize - pos);
+		if (bestLength >= maxLength)
+			return bestLength;
+		const int64_t limit = pos > maxDistance ? static_cast<int64_t>(pos - maxDistance) : 0;
+		unsigned chainLeft = bestLength >= params.goodLength && params.goodLength > 0 ? 
+			params.maxChain >> 2 : params.maxChain;
+		const unsigned char*const current = in + pos;
+		while (candidate >= limit && chainLeft-- > 0)
+		{
+			const unsigned char*const match = in + candidate;
+			if (match[bestLength] == current[bestLength] && Load32(match) == Load32(current))
+			{
+				size_t length = MIN_MATCH;
+				while (length + 8 <= maxLength && Load64(match + length) == Load64(current + length))
+					length += 8;
+				while (length < maxLength && match[length] == current[length])
+					length++;
+				if (length > bestLength)
+				{
+					bestLength = length;
+					outDist = pos - candidate;
+					if (length >= params.niceLength || length >= maxLength)
+						break;
+				}
+			}
+			// once the chain wraps around the window its links stop going back
+			const int32_t next = chain[candidate & windowMask];
+			if (next >= candidate)
+				break;
+			candidate = next;
+		}
+		return bestLength;
+	}
+	void ResetBlock()
+	{
+		tokens.clear();
+		memset(litLenFreq, 0, sizeof(litLenFreq));
+		memset(distFreq, 0, sizeof(distFreq));
+		blockStart += blockSize;
+		blockSize = 0;
+	}
+	unsigned AddLiteral(unsigned char byte)
+	{
+		tokens.push_back(byte);
+		litLenFreq[byte]++;
+		blockSize++;
+		return tokens.size() < MAX_BLOCK_TOKENS ? 0 : FlushBlock(false);
+	}
+	unsigned AddMatch(size_t length, size_t dist)
+	{
+		tokens.push_back(static_cast<uint32_t>((dist << 16) | length));
+		litLenFreq[257 + tables.lengthSymbol[length]]++;
+		distFreq[tables.DistSymbol(dist)]++;
+		blockSize += length;
+		return tokens.size() < MAX_BLOCK_TOKENS ? 0 : FlushBlock(false);
+	}
+	unsigned CompressGreedy()
+	{
+		size_t pos = 0;
+		while (pos < insize)
+		{
+			size_t length = 0;
+			size_t dist = 0;
+			if (pos + MIN_MATCH <= insize)
+				length = LongestMatch(Insert(pos), pos, MIN_MATCH - 1, dist);
+			unsigned error;
+			if (length >= MIN_MATCH)
+			{
+				error = AddMatch(length, dist);
+				if (length <= params.maxInsert)
+				{
+					for (size_t i = pos + 1; i < pos + length && i + MIN_MATCH <= insize; i++)
+						Insert(i);
+				}
+				pos += length;
+			}
+			else
+			{
+				error = AddLiteral(in[pos]);
+				pos++;
+			}
+			if (error)
+				return error;
+		}
+		return 0;
+	}
+	// zlib's deflate_slow: each match is only taken if the one starting a 
+	//	byte later isn't longer //
+	unsigned CompressLazy()
+	{
+		size_t pos = 0;
+		size_t length = MIN_MATCH - 1;
+		size_t dist = 0;
+		bool literalPending = false;
+		while (pos < insize)
+		{
+			const int32_t candidate = pos + MIN_MATCH <= insize ? Insert(pos) : -1;
+			const size_t previousLength = length;
+			const size_t previousDist = dist;
+			length = MIN_MATCH - 1;
+			if (candidate >= 0 && previousLength < params.maxLazy)
+				length = LongestMatch(candidate, pos, max(previousLength, MIN_MATCH - 1), dist);
+			unsigned error = 0;
+			if (previousLength >= MIN_MATCH && length <= previousLength)
+			{
+				// the match from the byte before wins
+				error = AddMatch(previousLength, previousDist);
+				const size_t end = pos - 1 + previousLength;
+				for (size_t i = pos + 1; i < end && i + MIN_MATCH <= insize; i++)
+					Insert(i);
+				pos = end;
+				literalPending = false;
+				length = MIN_MATCH - 1;
+			}
+			else
+			{
+				if (literalPending)
+					error = AddLiteral(in[pos - 1]);
+				literalPending = true;
+				pos++;
+			}
+			if (error)
+				return error;
+		}
+		return literalPending ? AddLiteral(in[pos - 1]) : 0;
+	}
+	// Stored blocks for size bytes of the input from start, the last of them
+	//	marked final if final is set.  Always writes at least one block. //
+	unsigned WriteStored(size_t start, size_t size, bool final)
+	{
+		do
+		{
+			const size_t part = min(size, MAX_STORED);
+			if (!writer.out.Reserve(part + 16))
+				return 83;
+			const bool last = part == size;
+			writer.Write(final && last ? 1 : 0, 3);
+			writer.Align();
+			unsigned char*const p = writer.out.data + writer.out.size;
+			p[0] = static_cast<unsigned char>(part);
+			p[1] = static_cast<unsigned char>(part >> 8);
+			p[2] = static_cast<unsigned char>(~part);
+			p[3] = static_cast<unsigned char>(~part >> 8);
+			if (part > 0)
+				memcpy(p + 4, in + start, part);
+			writer.out.size += 4 + part;
+			start += part;
+			size -= part;
+		}
+		while (size > 0);
+		return 0;
+	}
+	static uint64_t DataBits(unsigned const* litLenLengths, unsigned const* distLengths, 
+		unsigned const* litLenFreq, unsigned const* distFreq)
+	{
+		uint64_t bits = 0;
+		for (unsigned i = 0; i < NUM_LITLEN_SYMBOLS; i++)
+			bits += static_cast<uint64_t>(litLenFreq[i]) * 
+				(litLenLengths[i] + (i > 256 ? LENGTH_EXTRA[i - 257] : 0));
+		for (unsigned i = 0; i < NUM_DIST_SYMBOLS; i++)
+			bits += static_cast<uint64_t>(distFreq[i]) * (distLengths[i] + DIST_EXTRA[i]);
+		return bits;
+	}
+	void WriteTokens(uint16_t const* litLenCodes, unsigned const* litLenLengths,
+		uint16_t const* distCodes, unsigned const* distLengths)
+	{
+		for (uint32_t token : tokens)
+		{
+			const size_t dist = token >> 16;
+			if (dist == 0)
+			{
+				writer.Write(litLenCodes[token], litLenLengths[token]);
+				continue;
+			}
+			const size_t length = token & 0xFFFF;
+			const unsigned lengthSymbol = tables.lengthSymbol[length];
+			writer.Write(litLenCodes[257 + lengthSymbol], litLenLengths[257 + lengthSymbol]);
+			writer.Write(static_cast<uint32_t>(length - LENGTH_BASE[lengthSymbol]), LENGTH_EXTRA[lengthSymbol]);
+			const unsigned distSymbol = tables.DistSymbol(dist);
+			writer.Write(distCodes[distSymbol], distLengths[distSymbol]);
+			writer.Write(static_cast<uint32_t>(dist - DIST_BASE[distSymbol]), DIST_EXTRA[distSymbol]);
+		}
+		writer.Write(litLenCodes[END_OF_BLOCK], litLenLengths[END_OF_BLOCK]);
+	}
+	// writes the tokens so far as one block, in whichever form is smallest
+	unsigned FlushBlock(bool final)
+	{
+		litLenFreq[END_OF_BLOCK] = 1;
+		const uint64_t fixedBits = 3 + DataBits(tables.fixedLitLenLengths, tables.fixedDistLengths, 
+			litLenFreq, distFreq);
+		const uint64_t storedBits = 
+			((blockSize + MAX_STORED - 1) / MAX_STORED + 1) * 48 + blockSize * 8;
+		unsigned litLenLengths[NUM_LITLEN_SYMBOLS];
+		unsigned distLengths[NUM_DIST_SYMBOLS];
+		unsigned codeLengthLengths[19] = {};
+		// the code lengths, run length encoded as (symbol | extra << 8)
+		vector<uint32_t> runs;
+		unsigned numLitLen = NUM_LITLEN_SYMBOLS;
+		unsigned numDist = NUM_DIST_SYMBOLS;
+		unsigned numCodeLength = 19;
+		uint64_t dynamicBits = UINT64_MAX;
+		if (!settings.fixedCodes)
+		{
+			unsigned error = lodepng_huffman_code_lengths(litLenLengths, litLenFreq, NUM_LITLEN_SYMBOLS, MAX_CODE_LENGTH);
+			if (!error)
+				error = lodepng_huffman_code_lengths(distLengths, distFreq, NUM_DIST_SYMBOLS, MAX_CODE_LENGTH);
+			if (error)
+				return error;
+			while (numLitLen > 257 && litLenLengths[numLitLen - 1] == 0)
+				numLitLen--;
+			while (numDist > 1 && distLengths[numDist - 1] == 0)
+				numDist--;
+			unsigned lengths[NUM_LITLEN_SYMBOLS + NUM_DIST_SYMBOLS];
+			copy(litLenLengths, litLenLengths + numLitLen, lengths);
+			copy(distLengths, distLengths + numDist, lengths + numLitLen);
+			EncodeRuns(lengths, numLitLen + numDist, runs);
+			unsigned codeLengthFreq[19] = {};
+			for (uint32_t run : runs)
+				codeLengthFreq[run & 0xFF]++;
+			error = lodepng_huffman_code_lengths(codeLengthLengths, codeLengthFreq, 19, MAX_CODE_LENGTH_CODE_LENGTH);
+			if (error)
+				return error;
+			while (numCodeLength > 4 && codeLengthLengths[CODE_LENGTH_ORDER[numCodeLength - 1]] == 0)
+				numCodeLength--;
+			dynamicBits = 3 + 14 + 3 * numCodeLength + 
+				DataBits(litLenLengths, distLengths, litLenFreq, distFreq);
+			for (uint32_t run : runs)
+				dynamicBits += codeLengthLengths[run & 0xFF] + CODE_LENGTH_EXTRA[run & 0xFF];
+		}
+		unsigned error = 0;
+		if (storedBits < min(fixedBits, dynamicBits))
+		{
+			error = WriteStored(blockStart, blockSize, final);
+		}
+		else if (!writer.out.Reserve(min(fixedBits, dynamicBits) / 8 + 16))
+		{
+			error = 83;
+		}
+		else if (fixedBits <= dynamicBits)
+		{
+			writer.Write(final ? 1 : 0, 1);
+			writer.Write(1, 2);
+			WriteTokens(tables.fixedLitLenCodes, tables.fixedLitLenLengths, 
+				tables.fixedDistCodes, tables.fixedDistLengths);
+		}
+		else
+		{
+			uint16_t litLenCodes[NUM_LITLEN_SYMBOLS];
+			uint16_t distCodes[NUM_DIST_SYMBOLS];
+			uint16_t codeLengthCodes[19];
+			MakeCodes(litLenLengths, NUM_LITLEN_SYMBOLS, litLenCodes);
+			MakeCodes(distLengths, NUM_DIST_SYMBOLS, distCodes);
+			MakeCodes(codeLengthLengths, 19, codeLengthCodes);
+			writer.Write(final ? 1 : 0, 1);
+			writer.Write(2, 2);
+			writer.Write(numLitLen - 257, 5);
+			writer.Write(numDist - 1, 5);
+			writer.Write(numCodeLength - 4, 4);
+			for (unsigned i = 0; i < numCodeLength; i++)
+				writer.Write(codeLengthLengths[CODE_LENGTH_ORDER[i]], 3);
+			for (uint32_t run : runs)
+			{
+				const unsigned symbol = run & 0xFF;
+				writer.Write(codeLengthCodes[symbol], codeLengthLengths[symbol]);
+				writer.Write(run >> 8, CODE_LENGTH_EXTRA[symbol]);
+			}
+			WriteTokens(litLenCodes, litLenLengths, distCodes, distLengths);
+		}
+		ResetBlock();
+		return error;
+	}
+	// the code lengths as code length symbols, runs of them as 16, 17 & 18
+	static void EncodeRuns(unsigned const* lengths, size_t count, vector<uint32_t>& runs)
+	{
+		for (size_t i = 0; i < count;)
+		{
+			const unsigned length = lengths[i];
+			size_t run = 1;
+			while (i + run < count && lengths[i + run] == length)
+				run++;
+			i += run;
+			if (length == 0)
+			{
+				for (; run >= 11; run -= min<size_t>(run, 138))
+					runs.push_back(18 | static_cast<uint32_t>((min<size_t>(run, 138) - 11) << 8));
+				if (run >= 3)
+				{
+					runs.push_back(17 | static_cast<uint32_t>((run - 3) << 8));
+					run = 0;
+				}
+			}
+			else
+			{
+				runs.push_back(length);
+				run--;
+				for (; run >= 3; run -= min<size_t>(run, 6))
+					runs.push_back(16 | static_cast<uint32_t>((min<size_t>(run, 6) - 3) << 8));
+			}
+			for (; run > 0; run--)
+				runs.push_back(length);
+		}
+	}
+};
+
+//----------------------------------------------------------------------------
+// decompression
+
+// Table entries are (value << 16) | (kind << 8) | bits to consume, where 
+//	value is a literal, a base length or distance, or where a subtable starts,
+//	and kind is the number of extra bits after a length or distance, or one 
+//	of these. //
+enum : uint32_t
+{
+	KIND_LITERAL = 16,
+	KIND_END = 17,
+	KIND_SUBTABLE = 18,
+	KIND_INVALID = 19
+};
+static uint32_t Entry(uint32_t value, uint32_t kind, uint32_t bits = 0)
+{
+	return (value << 16) | (kind << 8) | bits;
+}
+
+// A Huffman decoding table: the next primaryBits bits of the input look up 
+//	a symbol directly, or a subtable for the rest of a longer code. //
+struct DecodeTable
+{
+	unsigned primaryBits;
+	unsigned subtableBits;
+	vector<uint32_t> entries;
+	DecodeTable(unsigned primaryBits, size_t numSymbols)
+		:primaryBits(primaryBits)
+		,subtableBits(0)
+		,entries((size_t(1) << primaryBits) + numSymbols * (size_t(1) << (MAX_CODE_LENGTH - primaryBits)))
+	{
+	}
+	// Fills in the table for the code lengths, where symbols[i] is the entry
+	//	(w/o the bits) for symbol i.  Returns false if the lengths aren't a 
+	//	code: oversubscribed, or incomplete other than the single 1 bit code 
+	//	deflate allows. //
+	bool Build(uint8_t const* lengths, size_t numSymbols, uint32_t const* symbols)
+	{
+		unsigned numOfLength[MAX_CODE_LENGTH + 1] = {};
+		for (size_t i = 0; i < numSymbols; i++)
+			numOfLength[lengths[i]]++;
+		numOfLength[0] = 0;
+		int left = 1;
+		unsigned maxLength = 0;
+		for (unsigned length = 1; length <= MAX_CODE_LENGTH; length++)
+		{
+			left = (left << 1) - static_cast<int>(numOfLength[length]);
+			if (left < 0)
+				return false;
+			if (numOfLength[length])
+				maxLength = length;
+		}
+		if (left > 0 && maxLength > 1)
+			return false;
+		const size_t primarySize = size_t(1) << primaryBits;
+		fill(entries.begin(), entries.begin() + primarySize, Entry(0, KIND_INVALID));
+		subtableBits = maxLength > primaryBits ? maxLength - primaryBits : 0;
+		size_t nextSubtable = primarySize;
+		unsigned code = 0;
+		for (unsigned length = 1; length <= maxLength; length++)
+		{
+			for (size_t symbol = 0; symbol < numSymbols; symbol++)
+			{
+				if (lengths[symbol] != length)
+					continue;
+				const unsigned reversed = ReverseBits(code++, length);
+				if (length <= primaryBits)
+				{
+					for (size_t i = reversed; i < primarySize; i += size_t(1) << length)
+						entries[i] = symbols[symbol] | length;
+					continue;
+				}
+				uint32_t& link = entries[reversed & (primarySize - 1)];
+				if (((link >> 8) & 0xFF) != KIND_SUBTABLE)
+				{
+					fill(entries.begin() + nextSubtable, 
+						entries.begin() + nextSubtable + (size_t(1) << subtableBits), Entry(0, KIND_INVALID));
+					link = Entry(static_cast<uint32_t>(nextSubtable), KIND_SUBTABLE, primaryBits);
+					nextSubtable += size_t(1) << subtableBits;
+				}
+				const size_t subtable = link >> 16;
+				for (size_t i = reversed >> primaryBits; i < (size_t(1) << subtableBits); i += size_t(1) << (length - primaryBits))
+					entries[subtable + i] = symbols[symbol] | (length - primaryBits);
+			}
+			code <<= 1;
+		}
+		return true;
+	}
+};
+
+class Decompressor
+{
+public:
+	Decompressor(OutBuffer& out, const unsigned char* in, size_t insize)
+		:out(out)
+		,start(in)
+		,in(in)
+		,end(in + insize)
+		,streamStart(out.size)
+		,litLenTable(10, 288)
+		,distTable(8, 32)
+		,codeLengthTable(7, 19)
+	{
+		for (uint32_t i = 0; i < 256; i++)
+			litLenSymbols[i] = Entry(i, KIND_LITERAL);
+		litLenSymbols[END_OF_BLOCK] = Entry(0, KIND_END);
+		for (uint32_t i = 0; i < 29; i++)
+			litLenSymbols[257 + i] = Entry(LENGTH_BASE[i], LENGTH_EXTRA[i]);
+		litLenSymbols[286] = litLenSymbols[287] = Entry(0, KIND_INVALID);
+		for (uint32_t i = 0; i < 32; i++)
+			distSymbols[i] = i < NUM_DIST_SYMBOLS ? Entry(DIST_BASE[i], DIST_EXTRA[i]) : Entry(0, KIND_INVALID);
+		for (uint32_t i = 0; i < 19; i++)
+			codeLengthSymbols[i] = Entry(i, KIND_LITERAL);
+	}
+	unsigned Run(size_t& consumed)
+	{
+		bool final = false;
+		while (!final)
+		{
+			Refill();
+			final = (bits & 1) != 0;
+			const unsigned type = (bits >> 1) & 3;
+			Consume(3);
+			unsigned error;
+			if (type == 0)
+				error = InflateStored();
+			else if (type == 1)
+				error = InflateFixed();
+			else if (type == 2)
+				error = InflateDynamic();
+			else
+				error = 20;
+			if (!error && Overrun())
+				error = 23;
+			if (error)
+				return error;
+		}
+		consumed = static_cast<size_t>(in - start) - ((count >> 3) - padding);
+		return 0;
+	}
+private:
+	OutBuffer& out;
+	const unsigned char*const start;
+	const unsigned char* in;
+	const unsigned char*const end;
+	const size_t streamStart;
+	// the next bits of the input, & how many of them there are
+	uint64_t bits = 0;
+	unsigned count = 0;
+	// zero bytes put in the bit buffer past the end of the input
+	unsigned padding = 0;
+	DecodeTable litLenTable;
+	DecodeTable distTable;
+	DecodeTable codeLengthTable;
+	uint32_t litLenSymbols[288];
+	uint32_t distSymbols[32];
+	uint32_t codeLengthSymbols[19];
+
+	// tops the bit buffer up to at least 56 bits
+	void Refill()
+	{
+		if (end - in >= 8)
+		{
+			bits |= Load64LE(in) << count;
+			in += (63 - count) >> 3;
+			count |= 56;
+			return;
+		}
+		while (count <= 56)
+		{
+			if (in < end)
+				bits |= static_cast<uint64_t>(*in++) << count;
+			else
+				padding++;
+			count += 8;
+		}
+	}
+	void Consume(unsigned n)
+	{
+		bits >>= n;
+		count -= n;
+	}
+	// whether the bits read so far went past the end of the input
+	bool Overrun() const
+	{
+		return padding * 8 > count;
+	}
+	uint32_t Decode(DecodeTable const& table)
+	{
+		uint32_t entry = table.entries[bits & ((uint64_t(1) << table.primaryBits) - 1)];
+		if (((entry >> 8) & 0xFF) == KIND_SUBTABLE)
+		{
+			Consume(table.primaryBits);
+			entry = table.entries[(entry >> 16) + (bits & ((uint64_t(1) << table.subtableBits) - 1))];
+		}
+		Consume(entry & 0xFF);
+		return entry;
+	}
+	unsigned InflateStored()
+	{
+		// the rest of the byte is skipped, & whole bytes still buffered put back
+		Consume(count & 7);
+		if (Overrun())
+			return 23;
+		in -= (count >> 3) - padding;
+		bits = 0;
+		count = 0;
+		padding = 0;
+		if (end - in < 4)
+			return 52;
+		const size_t length = in[0] | (in[1] << 8);
+		const size_t inverse = in[2] | (in[3] << 8);
+		in += 4;
+		if (length != (~inverse & 0xFFFF))
+			return 21;
+		if (static_cast<size_t>(end - in) < length)
+			return 23;
+		if (!out.Reserve(length))
+			return 83;
+		memcpy(out.data + out.size, in, length);
+		out.size += length;
+		in += length;
+		return 0;
+	}
+	unsigned InflateFixed()
+	{
+		uint8_t lengths[288 + 32];
+		for (unsigned i = 0; i < 288; i++)
+			lengths[i] = i < 144 ? 8 : (i < 256 ? 9 : (i < 280 ? 7 : 8));
+		fill(lengths + 288, lengths + 320, 5);
+		litLenTable.Build(lengths, 288, litLenSymbols);
+		distTable.Build(lengths + 288, 32, distSymbols);
+		return InflateCodes();
+	}
+	unsigned InflateDynamic()
+	{
+		Refill();
+		const unsigned numLitLen = 257 + (bits & 31);
+		const unsigned numDist = 1 + ((bits >> 5) & 31);
+		const unsigned numCodeLength = 4 + ((bits >> 10) & 15);
+		Consume(14);
+		if (numLitLen > NUM_LITLEN_SYMBOLS || numDist > NUM_DIST_SYMBOLS)
+			return 15;
+		uint8_t codeLengthLengths[19] = {};
+		for (unsigned i = 0; i < numCodeLength; i++)
+		{
+			if (count < 3)
+				Refill();
+			codeLengthLengths[CODE_LENGTH_ORDER[i]] = bits & 7;
+			Consume(3);
+		}
+		if (!codeLengthTable.Build(codeLengthLengths, 19, codeLengthSymbols))
+			return 16;
+		uint8_t lengths[NUM_LITLEN_SYMBOLS + NUM_DIST_SYMBOLS];
+		const unsigned total = numLitLen + numDist;
+		for (unsigned i = 0; i < total;)
+		{
+			Refill();
+			if (Overrun())
+				return 23;
+			const uint32_t entry = Decode(codeLengthTable);
+			if (((entry >> 8) & 0xFF) != KIND_LITERAL)
+				return 16;
+			const unsigned symbol = entry >> 16;
+			if (symbol < 16)
+			{
+				lengths[i++] = static_cast<uint8_t>(symbol);
+				continue;
+			}
+			unsigned repeat;
+			uint8_t value = 0;
+			if (symbol == 16)
+			{
+				if (i == 0)
+					return 54;
+				value = lengths[i - 1];
+				repeat = 3 + (bits & 3);
+				Consume(2);
+			}
+			else if (symbol == 17)
+			{
+				repeat = 3 + (bits & 7);
+				Consume(3);
+			}
+			else
+			{
+				repeat = 11 + (bits & 127);
+				Consume(7);
+			}
+			if (repeat > total - i)
+				return 13;
+			fill(lengths + i, lengths + i + repeat, value);
+			i += repeat;
+		}
+		if (lengths[END_OF_BLOCK] == 0)
+			return 64;
+		if (!litLenTable.Build(lengths, numLitLen, litLenSymbols) || 
+			!distTable.Build(lengths + numLitLen, numDist, distSymbols))
+		{
+			return 16;
+		}
+		return InflateCodes();
+	}
+	unsigned InflateCodes()
+	{
+		for (;;)
+		{
+			// the longest symbol w/ its extra bits, length & distance, is 48 bits
+			Refill();
+			if (padding && Overrun())
+				return 23;
+			// room for the longest match, plus what the 8 byte copies overshoot
+			if (!out.Reserve(MAX_MATCH + 8))
+				return 83;
+			const uint32_t entry = Decode(litLenTable);
+			const unsigned kind = (entry >> 8) & 0xFF;
+			if (kind == KIND_LITERAL)
+			{
+				out.data[out.size++] = static_cast<unsigned char>(entry >> 16);
+				continue;
+			}
+			if (kind > 13)
+			{
+				if (Overrun())
+					return 23;
+				return kind == KIND_END ? 0 : 16;
+			}
+			const size_t length = (entry >> 16) + (bits & ((uint64_t(1) << kind) - 1));
+			Consume(kind);
+			const uint32_t distEntry = Decode(distTable);
+			const unsigned distKind = (distEntry >> 8) & 0xFF;
+			if (distKind > 13)
+				return 18;
+			const size_t dist = (distEntry >> 16) + (bits & ((uint64_t(1) << distKind) - 1));
+			Consume(distKind);
+			if (dist > out.size - streamStart)
+				return 52;
+			if (Overrun())
+				return 23;
+			unsigned char* dest = out.data + out.size;
+			const unsigned char* source = dest - dist;
+			out.size += length;
+			if (dist >= 8)
+			{
+				// copying 8 bytes at a time is fine once they don't overlap
+				unsigned char*const destEnd = dest + length;
+				for (; dest < destEnd; dest += 8, source += 8)
+					memcpy(dest, source, 8);
+			}
+			else if (dist == 1)
+			{
+				memset(dest, *source, length);
+			}
+			else
+			{
+				for (size_t i = 0; i < length; i++)
+					dest[i] = source[i];
+			}
+		}
+	}
+};
+}
+
+unsigned FlateCompress(unsigned char** out, size_t* outsize,
+	const unsigned char* in, size_t insize, FlateSettings const& settings, bool final)
+{
+	if (insize > INT32_MAX)
+		return 92;
+	OutBuffer buffer(*out, *outsize);
+	// the compressor reserves room per block, and the 8 bytes the bit writer 
+	//	may need past it //
+	unsigned error = buffer.Reserve(insize / 4 + 64) ? 0 : 83;
+	if (!error)
+		error = Compressor(buffer, in, insize, settings).Run(final);
+	*out = buffer.data;
+	*outsize = buffer.size;
+	return error;
+}
+
+unsigned FlateDecompress(unsigned char** out, size_t* outsize,
+	const unsigned char* in, size_t insize, size_t& consumed)
+{
+	OutBuffer buffer(*out, *outsize);
+	// a guess; it grows as needed
+	unsigned error = buffer.Reserve(max<size_t>(insize * 4, 1 << 16)) ? 0 : 83;
+	if (!error)
+		error = Decompressor(buffer, in, insize).Run(consumed);
+	*out = buffer.data;
+	*outsize = buffer.size;
+	return error;
+}
+
+unsigned FlateZlibCompress(unsigned char** out, size_t* outsize,
+	const unsigned char* in, size_t insize, FlateSettings const& settings)
+{
+	OutBuffer buffer(*out, *outsize);
+	if (!buffer.Reserve(2))
+		return 83;
+	// deflate w/ a 32K window, and a check value that makes the header a 
+	//	multiple of 31 //
+	buffer.data[buffer.size++] = 0x78;
+	buffer.data[buffer.size++] = 0x01;
+	*out = buffer.data;
+	*outsize = buffer.size;
+	unsigned error = FlateCompress(out, outsize, in, insize, settings, true);
+	if (error)
+		return error;
+	unsigned char*const grown = static_cast<unsigned char*>(realloc(*out, *outsize + 4));
+	if (!grown)
+		return 83;
+	*out = grown;
+	const uint32_t adler = FlateAdler32(1, in, insize);
+	for (int i = 0; i < 4; i++)
+		grown[(*outsize)++] = static_cast<unsigned char>(adler >> (24 - 8 * i));
+	return 0;
+}
+
+unsigned FlateZlibDecompress(unsigned char** out, size_t* outsize,
+	const unsigned char* in, size_t insize, bool checkAdler32)
+{
+	if (insize < 2)
+		return 53;
+	if ((in[0] * 256 + in[1]) % 31 != 0)
+		return 24;
+	if ((in[0] & 15) != 8 || (in[0] >> 4) > 7)
+		return 25;
+	if (in[1] & 32)
+		return 26;
+	const size_t start = *outsize;
+	size_t consumed = 0;
+	const unsigned error = FlateDecompress(out, outsize, in + 2, insize - 2, consumed);
+	if (error)
+		return error;
+	if (checkAdler32)
+	{
+		if (insize - 2 - consumed < 4)
+			return 53;
+		// like lodepng, the checksum is taken from the end of the data
+		const unsigned char*const stored = in + insize - 4;
+		const uint32_t expected = (static_cast<uint32_t>(stored[0]) << 24) | (stored[1] << 16) | 
+			(stored[2] << 8) | stored[3];
+		if (FlateAdler32(1, *out + start, *outsize - start) != expected)
+			return 58;
+	}
+	return 0;
+}
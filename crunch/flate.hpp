@@ -0,0 +1,80 @@
+/*
+ 
+ MIT License
+ 
+ Copyright (c) 2017 Chevy Ray Johnston
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+#ifndef flate_hpp
+#define flate_hpp
+
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+// crunch's own deflate (RFC 1951) & zlib (RFC 1950) streams, written for 
+//	speed rather than the last few bytes: matches are found through a hash 
+//	of the next 4 bytes, each block is written w/ whichever of the stored, 
+//	fixed & dynamic codes comes out smallest, and the decoder reads the 
+//	input 8 bytes at a time through two-level lookup tables.  Errors are 
+//	lodepng's error codes, so they read the same wherever they surface. //
+
+// How hard compression looks for matches, roughly zlib's levels 0, 1, 6 & 9
+enum class FlateLevel
+{
+	Store,
+	Fastest,
+	Default,
+	Best
+};
+struct FlateSettings
+{
+	FlateLevel level = FlateLevel::Default;
+	// how far back matches may reach, from 1 to 32768 bytes
+	size_t maxDistance = 32768;
+	// only use the fixed codes (or store), which is quicker for tiny inputs
+	bool fixedCodes = false;
+};
+
+// Appends the raw deflate stream of in to the malloc'd *out (which may be 
+//	null).  If final is false, the stream is ended w/ an empty stored block
+//	instead of a final one (a zlib "full flush"), so it's byte aligned and 
+//	the stream of the next part can be appended straight after it. //
+unsigned FlateCompress(unsigned char** out, size_t* outsize,
+	const unsigned char* in, size_t insize, FlateSettings const& settings, bool final);
+// Appends what the raw deflate stream at the start of in inflates to onto 
+//	the malloc'd *out (which may be null), & sets consumed to the number of 
+//	bytes of in the stream took up. //
+unsigned FlateDecompress(unsigned char** out, size_t* outsize,
+	const unsigned char* in, size_t insize, size_t& consumed);
+
+// The same, wrapped in a zlib header & adler32 checksum
+unsigned FlateZlibCompress(unsigned char** out, size_t* outsize,
+	const unsigned char* in, size_t insize, FlateSettings const& settings);
+unsigned FlateZlibDecompress(unsigned char** out, size_t* outsize,
+	const unsigned char* in, size_t insize, bool checkAdler32);
+
+// Continues the adler32 of the data before, which starts out as 1
+uint32_t FlateAdler32(uint32_t adler, const unsigned char* data, size_t length);
+
+#endif
@@ -29,75 +29,67 @@
 #include <vector>
 #include <iostream>
 #include <sstream>
-#include "tinydir.h"
 #include "str.hpp"
+#include "xxhash.hpp"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
 
-template <class T>
-void HashCombine(std::size_t& hash, const T& v)
+void HashCombine(uint64_t& hash, uint64_t v)
 {
-    std::hash<T> hasher;
-    hash ^= hasher(v) + 0x9e3779b9 + (hash<<6) + (hash>>2);
-}
-void HashCombine(std::size_t& hash, size_t v)
-{
-    hash ^= v + 0x9e3779b9 + (hash<<6) + (hash>>2);
+    // serialized little endian so the bytes hashed don't depend on the machine
+    unsigned char bytes[8];
+    for (int i = 0; i < 8; i++)
+        bytes[i] = static_cast<unsigned char>(v >> (i * 8));
+    hash = XXH64(bytes, sizeof(bytes), hash);
 }
 
-void HashString(size_t& hash, const string& str)
+void HashString(uint64_t& hash, const string& str)
 {
-    HashCombine(hash, str);
+    hash = XXH64(str.data(), str.size(), hash);
 }
 
-void HashFile(size_t& hash, const string& file)
+bool HashFile(uint64_t& hash, const string& file, FileManifest* manifest)
 {
-    ifstream stream(file, ios::binary | ios::ate);
-    streamsize size = stream.tellg();
-    stream.seekg(0, ios::beg);
-    vector<char> buffer(size + 1);
-    if (!stream.read(buffer.data(), size))
+    if (manifest != nullptr)
+    {
+        uint64_t contentHash;
+        if (!manifest->ContentHash(file, contentHash))
+            return false;
+        HashCombine(hash, contentHash);
+        return true;
+    }
+    // streamed through in chunks, so big files are never held in memory
+    ifstream stream(file, ios::binary);
+    if (!stream)
     {
         cerr << "failed to read file: " << file << endl;
-        exit(EXIT_FAILURE);
+        return false;
     }
-    buffer[size] = '\0';
-    string text(buffer.begin(), buffer.end());
-    HashCombine(hash, text);
-}
-
-void HashFiles(size_t& hash, const string& root)
-{
-    static string dot1 = ".";
-    static string dot2 = "..";
-    
-    tinydir_dir dir;
-    tinydir_open(&dir, StrToPath(root).data());
-    
-    while (dir.has_next)
+    XXH64Hasher hasher(hash);
+    vector<char> buffer(1 << 16);
+    while (stream)
     {
-        tinydir_file file;
-        tinydir_readfile(&dir, &file);
-        
-        if (file.is_dir)
-        {
-            if (dot1 != PathToStr(file.name) && dot2 != PathToStr(file.name))
-                HashFiles(hash, PathToStr(file.path));
-        }
-        else if (PathToStr(file.extension) == "png")
-            HashFile(hash, PathToStr(file.path));
-        
-        tinydir_next(&dir);
+        stream.read(buffer.data(), buffer.size());
+        hasher.Update(buffer.data(), static_cast<size_t>(stream.gcount()));
     }
-    
-    tinydir_close(&dir);
+    if (stream.bad())
+    {
+        cerr << "failed to read file: " << file << endl;
+        return false;
+    }
+    hash = hasher.Digest();
+    return true;
 }
 
-void HashData(size_t& hash, const char* data, size_t size)
+void HashData(uint64_t& hash, const char* data, size_t size)
 {
-    string str(data, size);
-    HashCombine(hash, str);
+    hash = XXH64(data, size, hash);
 }
 
-bool LoadHash(size_t& hash, const string& file)
+bool LoadHash(uint64_t& hash, const string& file)
 {
     ifstream stream(file);
     if (stream)
@@ -110,8 +102,113 @@ bool LoadHash(size_t& hash, const string& file)
     return false;
 }
 
-void SaveHash(size_t hash, const string& file)
+void SaveHash(uint64_t hash, const string& file)
 {
     ofstream stream(file);
     stream << hash;
 }
+
+// The manifest is plain text: a version line, then one line per file with 
+//	its size, modification time (in nanoseconds) & hash, and its path last so 
+//	that paths may contain spaces. //
+static const char* MANIFEST_HEADER = "crunch-manifest 1";
+
+// size & modification time (in nanoseconds since 1970) of a file, or false 
+//	if it can't be stat'ed
+static bool StatFile(const string& file, uint64_t& size, int64_t& mtime)
+{
+#if defined(_WIN32)
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExW(StrToPath(file).c_str(), GetFileExInfoStandard, &data))
+        return false;
+    size = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+    // 100ns ticks since 1601
+    const int64_t ticks = static_cast<int64_t>((static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | 
+        data.ftLastWriteTime.dwLowDateTime);
+    mtime = (ticks - 116444736000000000LL) * 100;
+#else
+    struct stat fileStat;
+    if (stat(file.c_str(), &fileStat) != 0)
+        return false;
+    size = static_cast<uint64_t>(fileStat.st_size);
+#if defined(__APPLE__)
+    const timespec& modified = fileStat.st_mtimespec;
+#else
+    const timespec& modified = fileStat.st_mtim;
+#endif
+    mtime = static_cast<int64_t>(modified.tv_sec) * 1000000000LL + modified.tv_nsec;
+#endif
+    return true;
+}
+
+FileManifest::FileManifest()
+    :paranoid(false)
+    ,numFiles(0)
+    ,numHashed(0)
+    ,previousSaveTime(0)
+{
+}
+
+bool FileManifest::Load(const string& file)
+{
+    ifstream in(file);
+    string line;
+    if (!getline(in, line) || line != MANIFEST_HEADER)
+        return false;
+    uint64_t size;
+    if (!StatFile(file, size, previousSaveTime))
+        return false;
+    previous.clear();
+    Entry entry;
+    while (in >> entry.size >> entry.mtime >> entry.hash)
+    {
+        string path;
+        in.get();
+        if (!getline(in, path))
+            return false;
+        previous.emplace(path, entry);
+    }
+    return in.eof();
+}
+
+void FileManifest::Save(const string& file)
+{
+    ofstream out(file);
+    out << MANIFEST_HEADER << '\n';
+    for (auto const& named : current)
+    {
+        Entry const& e = named.second;
+        out << e.size << ' ' << e.mtime << ' ' << e.hash << ' ' << named.first << '\n';
+    }
+}
+
+bool FileManifest::ContentHash(const string& file, uint64_t& outHash)
+{
+    numFiles++;
+    // stat before reading, so a write while hashing shows up next time
+    Entry entry;
+    const bool statted = StatFile(file, entry.size, entry.mtime);
+    if (statted && !paranoid)
+    {
+        auto found = previous.find(file);
+        if (found != previous.end() && found->second.size == entry.size && 
+            found->second.mtime == entry.mtime && entry.mtime < previousSaveTime)
+        {
+            lock_guard<mutex> lock(currentMutex);
+            current[file] = found->second;
+            outHash = found->second.hash;
+            return true;
+        }
+    }
+    numHashed++;
+    entry.hash = 0;
+    if (!HashFile(entry.hash, file))
+        return false;
+    if (statted)
+    {
+        lock_guard<mutex> lock(currentMutex);
+        current[file] = entry;
+    }
+    outHash = entry.hash;
+    return true;
+}
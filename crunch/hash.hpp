@@ -28,16 +28,52 @@
 #define hash_hpp
 
 #include <string>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <atomic>
 using namespace std;
 
-template <class T>
-void HashCombine(std::size_t& hash, const T& v);
-void HashCombine(std::size_t& hash, size_t v);
-void HashString(size_t& hash, const string& str);
-void HashFile(size_t& hash, const string& file);
-void HashFiles(size_t& hash, const string& root);
-void HashData(size_t& hash, const char* data, size_t size);
-bool LoadHash(size_t& hash, const string& file);
-void SaveHash(size_t hash, const string& file);
+// Remembers each input file's size, modification time & content hash from 
+//	the previous run, so files whose stat info hasn't changed needn't be 
+//	read again.  Entries modified after the manifest was written are never 
+//	trusted, since a write within the same clock tick wouldn't show. //
+class FileManifest
+{
+public:
+    FileManifest();
+    bool Load(const string& file);
+    void Save(const string& file);
+    // the hash of file's contents, from the previous run if possible (and 
+    //	paranoid is off), otherwise read from disk; safe to call from several 
+    //	threads at once.  Returns false, after printing why, if the file 
+    //	can't be read.
+    bool ContentHash(const string& file, uint64_t& outHash);
+    bool paranoid;
+    atomic<size_t> numFiles;
+    atomic<size_t> numHashed;
+private:
+    struct Entry
+    {
+        uint64_t size;
+        int64_t mtime;
+        uint64_t hash;
+    };
+    map<string, Entry> previous;
+    map<string, Entry> current;
+    mutex currentMutex;
+    int64_t previousSaveTime;
+};
+
+// all hashes are XXH64, seeded with the running hash, so they come out the
+//	same regardless of platform or standard library //
+void HashCombine(uint64_t& hash, uint64_t v);
+void HashString(uint64_t& hash, const string& str);
+// with a manifest, the file contents are hashed through it; returns false, 
+//	after printing why, if the file can't be read
+bool HashFile(uint64_t& hash, const string& file, FileManifest* manifest = nullptr);
+void HashData(uint64_t& hash, const char* data, size_t size);
+bool LoadHash(uint64_t& hash, const string& file);
+void SaveHash(uint64_t hash, const string& file);
 
 #endif
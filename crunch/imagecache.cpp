@@ -0,0 +1,317 @@
+/*
+ 
+ MIT License
+ 
+ Copyright (c) 2017 Chevy Ray Johnston
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+#include "imagecache.hpp"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <filesystem>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+namespace fs = std::filesystem;
+
+// bump this whenever the entry layout or the way bitmaps are derived changes
+static const uint32_t ENTRY_VERSION = 2;
+static const char ENTRY_MAGIC[8] = { 'C', 'R', 'N', 'C', 'H', 'I', 'M', 'G' };
+// pixels start on their own cache line, same as the pixel arena's buffers
+static const uint64_t PIXEL_ALIGNMENT = 64;
+
+struct EntryHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t numBitmaps;
+	uint64_t key;
+};
+// followed by numBitmaps of these, then the names, then the pixels
+struct EntryBitmap
+{
+	int32_t width;
+	int32_t height;
+	int32_t frameX;
+	int32_t frameY;
+	int32_t frameW;
+	int32_t frameH;
+	uint64_t hashValue;
+	uint64_t nameOffset;
+	uint64_t nameLength;
+	uint64_t pixelOffset;
+};
+
+// A read-only file mapped copy-on-write, so the bitmaps pointing into it 
+//	can never change the file on disk. //
+class MappedFile
+{
+public:
+	static shared_ptr<MappedFile> Open(const string& file);
+	~MappedFile();
+	char* memory;
+	size_t size;
+private:
+	MappedFile() : memory(nullptr), size(0) {}
+};
+
+shared_ptr<MappedFile> MappedFile::Open(const string& file)
+{
+	shared_ptr<MappedFile> mapped(new MappedFile());
+#if defined(_WIN32)
+	HANDLE fileHandle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, 
+		nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		return nullptr;
+	LARGE_INTEGER fileSize;
+	HANDLE mapping = nullptr;
+	if (GetFileSizeEx(fileHandle, &fileSize) && fileSize.QuadPart > 0)
+		mapping = CreateFileMappingA(fileHandle, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	CloseHandle(fileHandle);
+	if (mapping == nullptr)
+		return nullptr;
+	mapped->memory = reinterpret_cast<char*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+	CloseHandle(mapping);
+	if (mapped->memory == nullptr)
+		return nullptr;
+	mapped->size = static_cast<size_t>(fileSize.QuadPart);
+#else
+	const int fd = open(file.c_str(), O_RDONLY);
+	if (fd < 0)
+		return nullptr;
+	struct stat fileStat;
+	void* memory = MAP_FAILED;
+	if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0)
+	{
+		memory = mmap(nullptr, static_cast<size_t>(fileStat.st_size), 
+			PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if (memory == MAP_FAILED)
+		return nullptr;
+	mapped->memory = reinterpret_cast<char*>(memory);
+	mapped->size = static_cast<size_t>(fileStat.st_size);
+#endif
+	return mapped;
+}
+MappedFile::~MappedFile()
+{
+	if (memory == nullptr)
+		return;
+#if defined(_WIN32)
+	UnmapViewOfFile(memory);
+#else
+	munmap(memory, size);
+#endif
+}
+
+ImageCache::ImageCache(const string& directory)
+	:directory(directory)
+	,numHits(0)
+	,numMisses(0)
+{
+}
+string ImageCache::EntryFile(uint64_t key) const
+{
+	stringstream ss;
+	ss << directory << "/" << hex << setw(16) << setfill('0') << static_cast<uint64_t>(key) << ".bin";
+	return ss.str();
+}
+// returns true the first time key is used this run
+bool ImageCache::Use(uint64_t key)
+{
+	lock_guard<mutex> lock(usedKeysMutex);
+	return usedKeys.insert(key).second;
+}
+bool ImageCache::Load(uint64_t key, vector<unique_ptr<Bitmap>>& outBitmaps)
+{
+	shared_ptr<MappedFile> mapped = MappedFile::Open(EntryFile(key));
+	// every offset & size is checked against the file, so that a truncated 
+	//	or otherwise damaged entry is just a miss //
+	EntryHeader header;
+	if (!mapped || mapped->size < sizeof(header))
+	{
+		numMisses++;
+		return false;
+	}
+	memcpy(&header, mapped->memory, sizeof(header));
+	const uint64_t size = mapped->size;
+	if (memcmp(header.magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC)) != 0 ||
+		header.version != ENTRY_VERSION || header.key != key ||
+		header.numBitmaps > (size - sizeof(header)) / sizeof(EntryBitmap))
+	{
+		numMisses++;
+		return false;
+	}
+	vector<unique_ptr<Bitmap>> bitmaps;
+	for (uint32_t b = 0; b < header.numBitmaps; b++)
+	{
+		EntryBitmap entry;
+		memcpy(&entry, mapped->memory + sizeof(header) + b * sizeof(EntryBitmap), sizeof(entry));
+		const uint64_t pixelBytes = static_cast<uint64_t>(max(entry.width, 0)) * 
+			static_cast<uint64_t>(max(entry.height, 0)) * sizeof(uint32_t);
+		if (entry.width < 0 || entry.height < 0 ||
+			entry.nameOffset > size || entry.nameLength > size - entry.nameOffset ||
+			entry.pixelOffset % PIXEL_ALIGNMENT != 0 ||
+			entry.pixelOffset > size || pixelBytes > size - entry.pixelOffset)
+		{
+			numMisses++;
+			return false;
+		}
+		uint32_t*const pixels = reinterpret_cast<uint32_t*>(mapped->memory + entry.pixelOffset);
+		bitmaps.push_back(make_unique<Bitmap>(
+			string(mapped->memory + entry.nameOffset, static_cast<size_t>(entry.nameLength)),
+			entry.width, entry.height, pixels, entry.width, 
+			// shares the mapping's lifetime, so it stays mapped for as long as
+			//	any of its bitmaps are alive
+			shared_ptr<uint32_t>(mapped, pixels)));
+		Bitmap& bitmap = *bitmaps.back();
+		bitmap.frameX = entry.frameX;
+		bitmap.frameY = entry.frameY;
+		bitmap.frameW = entry.frameW;
+		bitmap.frameH = entry.frameH;
+		bitmap.hashValue = entry.hashValue;
+	}
+	Use(key);
+	numHits++;
+	for (unique_ptr<Bitmap>& bitmap : bitmaps)
+	{
+		outBitmaps.push_back(move(bitmap));
+	}
+	return true;
+}
+void ImageCache::Store(uint64_t key, vector<Bitmap const*> const& bitmaps)
+{
+	// a sheet listed twice only needs to be written once
+	if (!Use(key))
+	{
+		return;
+	}
+	EntryHeader header;
+	memcpy(header.magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC));
+	header.version = ENTRY_VERSION;
+	header.numBitmaps = static_cast<uint32_t>(bitmaps.size());
+	header.key = static_cast<uint64_t>(key);
+	vector<EntryBitmap> entries(bitmaps.size());
+	uint64_t offset = sizeof(header) + bitmaps.size() * sizeof(EntryBitmap);
+	for (size_t b = 0; b < bitmaps.size(); b++)
+	{
+		entries[b].nameOffset = offset;
+		entries[b].nameLength = bitmaps[b]->name.size();
+		offset += bitmaps[b]->name.size();
+	}
+	for (size_t b = 0; b < bitmaps.size(); b++)
+	{
+		Bitmap const& bitmap = *bitmaps[b];
+		EntryBitmap& entry = entries[b];
+		entry.width = bitmap.width;
+		entry.height = bitmap.height;
+		entry.frameX = bitmap.frameX;
+		entry.frameY = bitmap.frameY;
+		entry.frameW = bitmap.frameW;
+		entry.frameH = bitmap.frameH;
+		entry.hashValue = bitmap.hashValue;
+		offset = (offset + PIXEL_ALIGNMENT - 1) / PIXEL_ALIGNMENT * PIXEL_ALIGNMENT;
+		entry.pixelOffset = offset;
+		offset += static_cast<uint64_t>(bitmap.width) * bitmap.height * sizeof(uint32_t);
+	}
+	error_code ec;
+	fs::create_directories(directory, ec);
+	// written under a temporary name first, so an interrupted run never 
+	//	leaves a half written entry behind //
+	const string file = EntryFile(key);
+	const string tempFile = file + ".tmp";
+	{
+		ofstream out(tempFile, ios::binary);
+		out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+		out.write(reinterpret_cast<char const*>(entries.data()), entries.size() * sizeof(EntryBitmap));
+		uint64_t written = sizeof(header) + entries.size() * sizeof(EntryBitmap);
+		for (Bitmap const* bitmap : bitmaps)
+		{
+			out.write(bitmap->name.data(), bitmap->name.size());
+			written += bitmap->name.size();
+		}
+		static const char padding[PIXEL_ALIGNMENT] = {};
+		for (size_t b = 0; b < bitmaps.size(); b++)
+		{
+			out.write(padding, entries[b].pixelOffset - written);
+			const BitmapView view = bitmaps[b]->view();
+			for (int y = 0; y < view.height; y++)
+			{
+				out.write(reinterpret_cast<char const*>(view.row(y)), view.width * sizeof(uint32_t));
+			}
+			written = entries[b].pixelOffset + 
+				static_cast<uint64_t>(view.width) * view.height * sizeof(uint32_t);
+		}
+		if (!out)
+		{
+			out.close();
+			fs::remove(tempFile, ec);
+			return;
+		}
+	}
+	fs::rename(tempFile, file, ec);
+	if (ec)
+	{
+		fs::remove(tempFile, ec);
+	}
+}
+void ImageCache::Prune()
+{
+	lock_guard<mutex> lock(usedKeysMutex);
+	error_code ec;
+	for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec))
+	{
+		const fs::path path = it->path();
+		if (path.extension() != ".bin" && path.extension() != ".tmp")
+		{
+			continue;
+		}
+		bool used = false;
+		if (path.extension() == ".bin")
+		{
+			uint64_t key;
+			stringstream ss(path.stem().string());
+			used = (ss >> hex >> key) && usedKeys.count(key) > 0;
+		}
+		if (!used)
+		{
+			error_code removeError;
+			fs::remove(path, removeError);
+		}
+	}
+}
+size_t ImageCache::NumHits() const
+{
+	return numHits;
+}
+size_t ImageCache::NumMisses() const
+{
+	return numMisses;
+}
@@ -0,0 +1,72 @@
+/*
+ 
+ MIT License
+ 
+ Copyright (c) 2017 Chevy Ray Johnston
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+#ifndef imagecache_hpp
+#define imagecache_hpp
+
+#include <string>
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <atomic>
+#include "bitmap.hpp"
+
+using namespace std;
+
+// An on-disk cache of the bitmaps crunch derives from each source sheet 
+//	(trimmed frames, masks, outlines & palette swaps), so that sheets that 
+//	haven't changed since the last run skip decoding & processing entirely.
+//	Entries are keyed by a hash of the sheet's contents & everything that 
+//	affects its processing, one file per key.  Loaded bitmaps are views 
+//	straight into the memory mapped entry.  The format is native endian, 
+//	since the cache never leaves the machine it was built on. //
+class ImageCache
+{
+public:
+	explicit ImageCache(const string& directory);
+	// Fills outBitmaps w/ the entry's bitmaps if key is cached & the entry is
+	//	intact.  Safe to call from several threads. //
+	bool Load(uint64_t key, vector<unique_ptr<Bitmap>>& outBitmaps);
+	// Writes bitmaps to the entry for key, replacing any old entry.  A failed
+	//	write only means the next run misses the cache. //
+	void Store(uint64_t key, vector<Bitmap const*> const& bitmaps);
+	// removes every entry that wasn't loaded or stored by this run
+	void Prune();
+	size_t NumHits() const;
+	size_t NumMisses() const;
+private:
+	string EntryFile(uint64_t key) const;
+	bool Use(uint64_t key);
+	const string directory;
+	unordered_set<uint64_t> usedKeys;
+	mutex usedKeysMutex;
+	atomic<size_t> numHits;
+	atomic<size_t> numMisses;
+};
+
+#endif
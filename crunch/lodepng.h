@@ -787,6 +787,16 @@ unsigned lodepng_deflate(unsigned char** out, size_t* outsize,
                          const unsigned char* in, size_t insize,
                          const LodePNGCompressSettings* settings);
 
+/*
+Like lodepng_deflate, but compresses one part of a longer deflate stream. If final
+is 0, the output ends with an empty non-compressed block (a zlib "full flush"),
+so it is byte aligned and the output of the next part can be appended directly
+after it. LZ77 matches never reach back into the data of earlier parts.
+*/
+unsigned lodepng_deflate_part(unsigned char** out, size_t* outsize,
+                              const unsigned char* in, size_t insize,
+                              const LodePNGCompressSettings* settings, unsigned final);
+
 #endif /*LODEPNG_COMPILE_ENCODER*/
 #endif /*LODEPNG_COMPILE_ZLIB*/
 
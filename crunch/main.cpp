@@ -27,9 +27,12 @@
  
  usage:
     crunch [OUTPUT] [INPUT1,INPUT2,INPUT3...] [OPTIONS...]
+    crunch --batch [BATCH JSON FILE] [OPTIONS...]
+    crunch --self-test
  
  example:
     crunch bin/atlases/atlas assets/characters,assets/tiles -p -t -v -u -r
+    crunch --batch atlases.json -v --jobs 8
  
  options:
     -d  --default           use default settings (-x -p -t -u)
@@ -44,6 +47,48 @@
     -r  --rotate            enabled rotating bitmaps 90 degrees clockwise when packing
     -s# --size#             max atlas size (# can be 4096, 2048, 1024, 512, 256, 128, or 64)
     -p# --pad#              padding between images (# can be from 0 to 16)
+        --jobs #            number of threads used to process the bitmaps (defaults to the number of cores)
+        --png-level #       atlas png compression (# can be store, fast, default, or max)
+        --zlib #            deflate implementation for reading & writing pngs (# can be flate, lodepng, or zlib if built w/ CRUNCH_USE_ZLIB; defaults to flate)
+        --bench-zlib        after packing, time decoding & encoding the atlas pages w/ each zlib backend
+        --no-cache          don't read or write the per-sheet image cache (<prefix>.cache next to the atlas)
+        --incremental       keep unchanged bitmaps where the previous run packed them & only re-encode changed pages
+        --repack-threshold # how much occupancy (in percent) an incremental pack may lose before everything is repacked (defaults to 10)
+        --paranoid          hash the contents of every input, even those whose size & modification time match <prefix>.manifest
+        --pack-effort       try every packing heuristic w/ every sort order at once & keep the one that needs the fewest, smallest pages
+        --global-fit        instead of packing the bitmaps largest first, pack whichever fits best next (slower, but usually tighter)
+        --packer #          bin packing algorithm (# can be maxrects, skyline, or guillotine; defaults to maxrects)
+        --skyline-level #   where skyline puts each bitmap (# can be bl or mw; defaults to mw)
+        --skyline-no-waste-map  don't let skyline fill the gaps it leaves under the skyline
+        --guillotine-fit #  which free rect guillotine picks (# can be bssf, blsf, baf, wssf, wlsf, or waf; defaults to bssf)
+        --guillotine-split # how guillotine cuts up what's left of it (# can be slas, llas, sas, las, minas, or maxas; defaults to slas)
+        --guillotine-no-merge   don't let guillotine merge its free rects back together
+        --size-search       after packing, look for the page sizes w/ the least area that still hold each page's bitmaps
+        --npot              let --size-search pick any multiple of 4, not just powers of two
+        --parallel-pages    split the bitmaps over the pages they'll need & pack those pages at the same time
+        --bench-packers     before packing, time every packer w/ every setting on the bitmaps & report the occupancy each gets
+ 
+ self test:
+    Checks the premultiply, mask & outline pixel passes at every SIMD level 
+    this CPU supports against a plain per-pixel version of each, over every 
+    alpha/channel value.  Exits w/ a nonzero status if any of them differ.
+ 
+ batch file:
+    Builds several atlases in one process, sharing the parsed json files & 
+    the decoded sheets between them.  The atlases are built at the same time 
+    on the one thread pool.  The OPTIONS on the command line apply to every 
+    atlas, ahead of its own; --jobs & --zlib can only be given there.
+    {
+        "atlases": [
+            {
+                "output": "bin/atlases/atlas",
+                "inputs": "assets/gfx",
+                "gfx-meta": "assets/gfx-meta.json",
+                "palettes": "assets/palettes.json",
+                "options": [ "-p", "-t", "-u", "-j" ]
+            }
+        ]
+    }
  
  binary format:
     [int16] num_textures (below block is repeated this many times)
@@ -67,29 +112,93 @@
 #include <sstream>
 #include <string>
 #include <vector>
+#include <unordered_set>
 #include <algorithm>
-#include "tinydir.h"
+#include <memory>
+#include <chrono>
+#include <atomic>
+#include <mutex>
 #include "bitmap.hpp"
 #include "packer.hpp"
 #include "binary.hpp"
 #include "hash.hpp"
-#include "str.hpp"
+#include "threadpool.hpp"
+#include "pixelarena.hpp"
+#include "zlibbackend.hpp"
+#include "imagecache.hpp"
+#include "sheetcache.hpp"
+#include "simd.hpp"
+#include <map>
 #include <rapidjson/document.h>
 #include <filesystem>
+#if defined(_WIN32)
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
 namespace fs = std::filesystem;
 using namespace std;
+using namespace rbp;
 
-static int optSize;
-static int optPadding;
-static bool optXml;
-static bool optBinary;
-static bool optJson;
-static bool optPremultiply;
-static bool optTrim;
-static bool optVerbose;
-static bool optForce;
-static bool optUnique;
-static bool optRotate;
+// Everything that can be set on the command line, see the usage notes above.
+//	In a batch, each atlas has its own. //
+struct AtlasOptions
+{
+	int size;
+	int padding;
+	bool xml;
+	bool binary;
+	bool json;
+	bool premultiply;
+	bool trim;
+	bool verbose;
+	bool force;
+	bool unique;
+	bool rotate;
+	int jobs;
+	PngLevel pngLevel;
+	ZlibBackend zlib;
+	bool benchZlib;
+	bool cache;
+	bool incremental;
+	bool paranoid;
+	int repackThreshold;
+	bool packEffort;
+	PackSettings packing;
+	bool benchPackers;
+	bool parallelPages;
+	bool sizeSearch;
+	bool npot;
+	AtlasOptions();
+};
+AtlasOptions::AtlasOptions()
+	:size(4096)
+	,padding(2)
+	,xml(false)
+	,binary(false)
+	,json(false)
+	,premultiply(false)
+	,trim(false)
+	,verbose(false)
+	,force(false)
+	,unique(false)
+	,rotate(false)
+	,jobs(ThreadPool::HardwareConcurrency())
+	,pngLevel(PngLevel::Default)
+	,zlib(DefaultZlibBackend())
+	,benchZlib(false)
+	,cache(true)
+	,incremental(false)
+	,paranoid(false)
+	,repackThreshold(10)
+	,packEffort(false)
+	,benchPackers(false)
+	,parallelPages(false)
+	,sizeSearch(false)
+	,npot(false)
+{
+}
 
 static void SplitFileName(const string& path, string* dir, string* name, string* ext)
 {
@@ -127,35 +236,29 @@ static string GetFileName(const string& path)
     return name;
 }
 
-static void loadBitmap(const string& prefix, const string& path, vector<Bitmap*>& outBitmaps)
+// returns the most memory this process has had resident at once, in bytes
+static size_t GetPeakMemoryUsage()
 {
-    if (optVerbose)
-        cout << "Loading bitmap: '" << path << "'...";
-	outBitmaps.push_back(new Bitmap(path, prefix + GetFileName(path), optPremultiply, optTrim));
-	if (optVerbose)
-		cout << "DONE!\n";
-}
-
-static void LoadBitmaps(const string& root, const string& prefix, vector<Bitmap*>& outBitmaps)
-{
-    static string dot1 = ".";
-    static string dot2 = "..";
-    tinydir_dir dir;
-    tinydir_open(&dir, StrToPath(root).data());
-    while (dir.has_next)
-    {
-        tinydir_file file;
-        tinydir_readfile(&dir, &file);
-        if (file.is_dir)
-        {
-            if (dot1 != PathToStr(file.name) && dot2 != PathToStr(file.name))
-                LoadBitmaps(PathToStr(file.path), prefix + PathToStr(file.name) + "/", outBitmaps);
-        }
-        else if (PathToStr(file.extension) == "png")
-            loadBitmap(prefix, PathToStr(file.path), outBitmaps);
-        tinydir_next(&dir);
-    }
-    tinydir_close(&dir);
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		return counters.PeakWorkingSetSize;
+	}
+	return 0;
+#else
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+	{
+		return 0;
+	}
+#if defined(__APPLE__)
+	// macOS reports ru_maxrss in bytes, everyone else in kilobytes
+	return static_cast<size_t>(usage.ru_maxrss);
+#else
+	return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
 }
 
 static void RemoveFile(string file)
@@ -193,6 +296,796 @@ static int GetPadding(const string& str)
     exit(EXIT_FAILURE);
     return 1;
 }
+
+static int GetRepackThreshold(const string& str)
+{
+	const int threshold = atoi(str.c_str());
+	if (threshold < 0 || threshold > 100 || to_string(threshold) != str)
+	{
+		cerr << "invalid repack threshold: " << str << endl;
+		exit(EXIT_FAILURE);
+	}
+	return threshold;
+}
+
+static int GetJobs(const string& str)
+{
+	const int jobs = atoi(str.c_str());
+	if (jobs < 1 || to_string(jobs) != str)
+	{
+		cerr << "invalid jobs value: " << str << endl;
+		exit(EXIT_FAILURE);
+	}
+	return jobs;
+}
+
+static PngLevel GetPngLevel(const string& str)
+{
+	PngLevel level;
+	if (!ParsePngLevel(str, level))
+	{
+		cerr << "invalid png level: " << str << endl;
+		exit(EXIT_FAILURE);
+	}
+	return level;
+}
+
+static ZlibBackend GetZlibBackend(const string& str)
+{
+	ZlibBackend backend;
+	if (!ParseZlibBackend(str, backend))
+	{
+		cerr << "invalid zlib backend: " << str << endl;
+		exit(EXIT_FAILURE);
+	}
+	if (!ZlibBackendAvailable(backend))
+	{
+		cerr << "zlib backend not compiled in (build with CRUNCH_USE_ZLIB): " << str << endl;
+		exit(EXIT_FAILURE);
+	}
+	return backend;
+}
+
+static PackEngine GetPackEngine(const string& str)
+{
+	PackEngine engine;
+	if (!ParsePackEngine(str, engine))
+	{
+		cerr << "invalid packer: " << str << endl;
+		exit(EXIT_FAILURE);
+	}
+	return engine;
+}
+
+static SkylineBinPack::LevelChoiceHeuristic GetSkylineLevel(const string& str)
+{
+	SkylineBinPack::LevelChoiceHeuristic level;
+	if (!ParseSkylineLevel(str, level))
+	{
+		cerr << "invalid skyline level: " << str << endl;
+		exit(EXIT_FAILURE);
+	}
+	return level;
+}
+
+static GuillotineBinPack::FreeRectChoiceHeuristic GetGuillotineFit(const string& str)
+{
+	GuillotineBinPack::FreeRectChoiceHeuristic fit;
+	if (!ParseGuillotineFit(str, fit))
+	{
+		cerr << "invalid guillotine fit: " << str << endl;
+		exit(EXIT_FAILURE);
+	}
+	return fit;
+}
+
+static GuillotineBinPack::GuillotineSplitHeuristic GetGuillotineSplit(const string& str)
+{
+	GuillotineBinPack::GuillotineSplitHeuristic split;
+	if (!ParseGuillotineSplit(str, split))
+	{
+		cerr << "invalid guillotine split: " << str << endl;
+		exit(EXIT_FAILURE);
+	}
+	return split;
+}
+
+// Applies args (the options part of the command line) on top of options.
+//	Prints the first argument it doesn't know & returns false. //
+static bool ParseOptions(vector<string> const& args, AtlasOptions& options)
+{
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        string const& arg = args[i];
+        if (arg == "-d" || arg == "--default")
+            options.xml = options.premultiply = options.trim = options.unique = true;
+        else if (arg == "-x" || arg == "--xml")
+            options.xml = true;
+        else if (arg == "-b" || arg == "--binary")
+            options.binary = true;
+        else if (arg == "-j" || arg == "--json")
+            options.json = true;
+        else if (arg == "-p" || arg == "--premultiply")
+            options.premultiply = true;
+        else if (arg == "-t" || arg == "--trim")
+            options.trim = true;
+        else if (arg == "-v" || arg == "--verbose")
+            options.verbose = true;
+        else if (arg == "-f" || arg == "--force")
+            options.force = true;
+        else if (arg == "-u" || arg == "--unique")
+            options.unique = true;
+        else if (arg == "-r" || arg == "--rotate")
+            options.rotate = true;
+        else if (arg == "--jobs" && i + 1 < args.size())
+            options.jobs = GetJobs(args[++i]);
+        else if (arg.find("--jobs") == 0)
+            options.jobs = GetJobs(arg.substr(6));
+        else if (arg == "--png-level" && i + 1 < args.size())
+            options.pngLevel = GetPngLevel(args[++i]);
+        else if (arg.find("--png-level") == 0)
+            options.pngLevel = GetPngLevel(arg.substr(11));
+        else if (arg == "--zlib" && i + 1 < args.size())
+            options.zlib = GetZlibBackend(args[++i]);
+        else if (arg.find("--zlib") == 0)
+            options.zlib = GetZlibBackend(arg.substr(6));
+        else if (arg == "--bench-zlib")
+            options.benchZlib = true;
+        else if (arg == "--no-cache")
+            options.cache = false;
+        else if (arg == "--incremental")
+            options.incremental = true;
+        else if (arg == "--paranoid")
+            options.paranoid = true;
+        else if (arg == "--pack-effort")
+            options.packEffort = true;
+        else if (arg == "--global-fit")
+            options.packing.globalFit = true;
+        else if (arg == "--packer" && i + 1 < args.size())
+            options.packing.engine = GetPackEngine(args[++i]);
+        else if (arg.find("--packer") == 0)
+            options.packing.engine = GetPackEngine(arg.substr(8));
+        else if (arg == "--skyline-no-waste-map")
+            options.packing.skylineWasteMap = false;
+        else if (arg == "--skyline-level" && i + 1 < args.size())
+            options.packing.skylineLevel = GetSkylineLevel(args[++i]);
+        else if (arg.find("--skyline-level") == 0)
+            options.packing.skylineLevel = GetSkylineLevel(arg.substr(15));
+        else if (arg == "--guillotine-no-merge")
+            options.packing.guillotineMerge = false;
+        else if (arg == "--guillotine-fit" && i + 1 < args.size())
+            options.packing.guillotineFit = GetGuillotineFit(args[++i]);
+        else if (arg.find("--guillotine-fit") == 0)
+            options.packing.guillotineFit = GetGuillotineFit(arg.substr(16));
+        else if (arg == "--guillotine-split" && i + 1 < args.size())
+            options.packing.guillotineSplit = GetGuillotineSplit(args[++i]);
+        else if (arg.find("--guillotine-split") == 0)
+            options.packing.guillotineSplit = GetGuillotineSplit(arg.substr(18));
+        else if (arg == "--bench-packers")
+            options.benchPackers = true;
+        else if (arg == "--parallel-pages")
+            options.parallelPages = true;
+        else if (arg == "--size-search")
+            options.sizeSearch = true;
+        else if (arg == "--npot")
+            options.npot = true;
+        else if (arg == "--repack-threshold" && i + 1 < args.size())
+            options.repackThreshold = GetRepackThreshold(args[++i]);
+        else if (arg.find("--repack-threshold") == 0)
+            options.repackThreshold = GetRepackThreshold(arg.substr(18));
+        else if (arg.find("--size") == 0)
+            options.size = GetPackSize(arg.substr(6));
+        else if (arg.find("-s") == 0)
+            options.size = GetPackSize(arg.substr(2));
+        else if (arg.find("--pad") == 0)
+            options.padding = GetPadding(arg.substr(5));
+        else if (arg.find("-p") == 0)
+            options.padding = GetPadding(arg.substr(2));
+        else
+        {
+            cerr << "unexpected argument: " << arg << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Only the options that can change what gets written count towards the
+//	atlas hash; the number of jobs, verbosity, benchmarks & caching don't, so
+//	they never force a repack. //
+static void HashOptions(uint64_t& hash, AtlasOptions const& options)
+{
+	HashCombine(hash, static_cast<uint64_t>(options.size));
+	HashCombine(hash, static_cast<uint64_t>(options.padding));
+	HashCombine(hash, static_cast<uint64_t>(options.xml));
+	HashCombine(hash, static_cast<uint64_t>(options.binary));
+	HashCombine(hash, static_cast<uint64_t>(options.json));
+	HashCombine(hash, static_cast<uint64_t>(options.premultiply));
+	HashCombine(hash, static_cast<uint64_t>(options.trim));
+	HashCombine(hash, static_cast<uint64_t>(options.unique));
+	HashCombine(hash, static_cast<uint64_t>(options.rotate));
+	HashCombine(hash, static_cast<uint64_t>(options.pngLevel));
+	HashCombine(hash, static_cast<uint64_t>(options.zlib));
+	HashCombine(hash, static_cast<uint64_t>(options.incremental));
+	HashCombine(hash, static_cast<uint64_t>(options.repackThreshold));
+	HashCombine(hash, static_cast<uint64_t>(options.packEffort));
+	HashCombine(hash, static_cast<uint64_t>(options.packing.engine));
+	HashCombine(hash, static_cast<uint64_t>(options.packing.maxRectsFit));
+	HashCombine(hash, static_cast<uint64_t>(options.packing.globalFit));
+	HashCombine(hash, static_cast<uint64_t>(options.packing.skylineLevel));
+	HashCombine(hash, static_cast<uint64_t>(options.packing.skylineWasteMap));
+	HashCombine(hash, static_cast<uint64_t>(options.packing.guillotineFit));
+	HashCombine(hash, static_cast<uint64_t>(options.packing.guillotineSplit));
+	HashCombine(hash, static_cast<uint64_t>(options.packing.guillotineMerge));
+	HashCombine(hash, static_cast<uint64_t>(options.parallelPages));
+	HashCombine(hash, static_cast<uint64_t>(options.sizeSearch));
+	HashCombine(hash, static_cast<uint64_t>(options.npot));
+}
+
+// Puts every bitmap that is still the same size back where the previous run
+//	packed it, then packs the rest around them, page by page.  If that wastes
+//	too much space compared to the last full repack, everything is handed 
+//	back in its original order & false is returned. //
+static bool PackIncremental(vector<unique_ptr<Bitmap>>& bitmaps, 
+	AtlasPlacements const& previous, vector<unique_ptr<Packer>>& packers, AtlasOptions const& options, ostream& log)
+{
+	vector<Bitmap*> order;
+	for (unique_ptr<Bitmap> const& bitmap : bitmaps)
+	{
+		order.push_back(bitmap.get());
+	}
+	for (size_t p = 0; p < previous.pageHashes.size(); p++)
+	{
+		packers.push_back(make_unique<Packer>(options.size, options.size, options.padding, options.packing));
+	}
+	// in the same back to front order Pack goes through them //
+	size_t numKept = 0;
+	vector<unique_ptr<Bitmap>> remaining;
+	for (size_t i = bitmaps.size(); i-- > 0;)
+	{
+		auto found = previous.placements.find(bitmaps[i]->name);
+		if (found != previous.placements.end() && 
+			found->second.width == bitmaps[i]->width && found->second.height == bitmaps[i]->height &&
+			packers[found->second.page]->Keep(bitmaps[i], found->second, options.unique))
+		{
+			numKept++;
+			continue;
+		}
+		remaining.push_back(move(bitmaps[i]));
+	}
+	bitmaps.clear();
+	reverse(remaining.begin(), remaining.end());
+	for (unique_ptr<Packer>& packer : packers)
+	{
+		packer->PackAround(remaining, options.verbose ? &log : nullptr, options.unique, options.rotate);
+	}
+	bool fits = true;
+	while (!remaining.empty() && fits)
+	{
+		packers.push_back(make_unique<Packer>(options.size, options.size, options.padding, options.packing));
+		packers.back()->Pack(remaining, options.verbose ? &log : nullptr, options.unique, options.rotate);
+		fits = !packers.back()->bitmaps.empty();
+	}
+	packers.erase(remove_if(packers.begin(), packers.end(), 
+		[](unique_ptr<Packer> const& packer) { return packer->bitmaps.empty(); }), packers.end());
+	size_t usedArea = 0;
+	size_t pageArea = 0;
+	for (unique_ptr<Packer>& packer : packers)
+	{
+		packer->ShrinkToFit();
+		usedArea += packer->UsedArea();
+		pageArea += static_cast<size_t>(packer->width) * packer->height;
+	}
+	const float occupancy = pageArea > 0 ? static_cast<float>(usedArea) / pageArea : 0.0f;
+	const float minOccupancy = previous.fullPackOccupancy * (100 - options.repackThreshold) / 100.0f;
+	if (options.verbose)
+	{
+		log << "incremental pack: kept " << numKept << " of " << order.size() << 
+			" bitmaps in place, occupancy " << occupancy << " (last full pack " << 
+			previous.fullPackOccupancy << ")" << endl;
+	}
+	if (fits && occupancy >= minOccupancy)
+	{
+		return true;
+	}
+	if (options.verbose)
+	{
+		log << "too fragmented, repacking everything..." << endl;
+	}
+	unordered_map<Bitmap*, unique_ptr<Bitmap>> owned;
+	for (unique_ptr<Packer>& packer : packers)
+	{
+		for (unique_ptr<Bitmap>& bitmap : packer->bitmaps)
+		{
+			Bitmap*const key = bitmap.get();
+			owned[key] = move(bitmap);
+		}
+	}
+	for (unique_ptr<Bitmap>& bitmap : remaining)
+	{
+		Bitmap*const key = bitmap.get();
+		owned[key] = move(bitmap);
+	}
+	packers.clear();
+	for (Bitmap* bitmap : order)
+	{
+		bitmaps.push_back(move(owned[bitmap]));
+	}
+	return false;
+}
+
+// Splits the bitmaps over as many pages as their area says they need at 
+//	least (largest first, each into the page w/ the least area so far) & 
+//	packs those pages at the same time.  Whatever didn't fit is then packed 
+//	around the other pages' bitmaps, page by page, and anything left after 
+//	that is left in bitmaps, in order, for the pages after these.  The split
+//	doesn't depend on the number of jobs, so neither does the result. //
+static void PackPagesInParallel(vector<unique_ptr<Bitmap>>& bitmaps, vector<unique_ptr<Packer>>& packers, 
+	AtlasOptions const& options, PackSettings const& packing, ThreadPool& threadPool, string const& outputPrefix, ostream& log)
+{
+	// duplicates go to the page of the first copy, & only count once
+	const size_t binArea = static_cast<size_t>(options.size - options.padding) * (options.size - options.padding);
+	size_t totalArea = 0;
+	unordered_set<uint64_t> counted;
+	for (unique_ptr<Bitmap> const& bitmap : bitmaps)
+	{
+		if (!options.unique || counted.insert(bitmap->hashValue).second)
+			totalArea += static_cast<size_t>(bitmap->width + options.padding) * (bitmap->height + options.padding);
+	}
+	const size_t numPages = (totalArea + binArea - 1) / binArea;
+	if (numPages < 2)
+	{
+		return;
+	}
+	
+	unordered_map<Bitmap*, size_t> indexOf;
+	unordered_map<uint64_t, size_t> pageOfHash;
+	vector<vector<unique_ptr<Bitmap>>> pageBitmaps(numPages);
+	vector<size_t> pageAreas(numPages, 0);
+	for (size_t i = bitmaps.size(); i-- > 0;)
+	{
+		indexOf[bitmaps[i].get()] = i;
+		auto found = options.unique ? pageOfHash.find(bitmaps[i]->hashValue) : pageOfHash.end();
+		size_t page = 0;
+		if (found != pageOfHash.end())
+		{
+			page = found->second;
+		}
+		else
+		{
+			page = min_element(pageAreas.begin(), pageAreas.end()) - pageAreas.begin();
+			pageAreas[page] += static_cast<size_t>(bitmaps[i]->width + options.padding) * (bitmaps[i]->height + options.padding);
+			if (options.unique)
+				pageOfHash[bitmaps[i]->hashValue] = page;
+		}
+		pageBitmaps[page].push_back(move(bitmaps[i]));
+	}
+	bitmaps.clear();
+	
+	// Packer takes the bitmaps from the back.  PackAround skips the ones 
+	//	that don't fit instead of stopping at them like Pack; neither 
+	//	shrinks the page, since more is packed into it below. //
+	const size_t firstPage = packers.size();
+	for (size_t p = 0; p < numPages; p++)
+	{
+		reverse(pageBitmaps[p].begin(), pageBitmaps[p].end());
+		packers.push_back(make_unique<Packer>(options.size, options.size, options.padding, packing));
+	}
+	threadPool.ParallelFor(numPages, [&](size_t p) {
+		Packer& packer = *packers[firstPage + p];
+		if (packing.globalFit)
+			packer.PackGlobal(pageBitmaps[p], nullptr, options.unique, options.rotate);
+		else
+			packer.PackAround(pageBitmaps[p], nullptr, options.unique, options.rotate);
+	});
+	
+	vector<unique_ptr<Bitmap>> leftovers;
+	for (vector<unique_ptr<Bitmap>>& page : pageBitmaps)
+	{
+		for (unique_ptr<Bitmap>& bitmap : page)
+			leftovers.push_back(move(bitmap));
+	}
+	sort(leftovers.begin(), leftovers.end(), [&indexOf](unique_ptr<Bitmap> const& a, unique_ptr<Bitmap> const& b) {
+		return indexOf[a.get()] < indexOf[b.get()];
+	});
+	const size_t numLeftovers = leftovers.size();
+	for (size_t p = firstPage; p < packers.size(); p++)
+	{
+		packers[p]->PackAround(leftovers, options.verbose ? &log : nullptr, options.unique, options.rotate);
+	}
+	if (options.verbose)
+	{
+		log << "packed " << numPages << " pages at once, packed " << numLeftovers - leftovers.size() << 
+			" of the " << numLeftovers << " bitmaps left over around them" << endl;
+	}
+	// a page gets nothing if all of its bitmaps are too big for any page
+	packers.erase(remove_if(packers.begin() + firstPage, packers.end(), 
+		[](unique_ptr<Packer> const& packer) { return packer->bitmaps.empty(); }), packers.end());
+	for (size_t p = firstPage; p < packers.size(); p++)
+	{
+		packers[p]->ShrinkToFit();
+		if (options.verbose)
+			log << "finished packing: " << outputPrefix << p << " (" << packers[p]->width << " x " << packers[p]->height << 
+				", occupancy " << packers[p]->Occupancy() << ')' << endl;
+	}
+	bitmaps = move(leftovers);
+}
+
+// The orders the bitmaps can be packed in, largest first.  Ties keep the 
+//	area order, so PackOrder::Area is the order crunch has always used.
+//	PackOrder::GlobalFit leaves the order to the packer, see 
+//	PackSettings::globalFit. //
+enum class PackOrder
+{
+	Area,
+	MaxSide,
+	Perimeter,
+	Height,
+	GlobalFit,
+};
+
+static const char* PackOrderName(PackOrder order)
+{
+	switch (order)
+	{
+	case PackOrder::Area: return "area";
+	case PackOrder::MaxSide: return "max side";
+	case PackOrder::Perimeter: return "perimeter";
+	case PackOrder::Height: return "height";
+	case PackOrder::GlobalFit: return "global fit";
+	}
+	return "?";
+}
+
+// Re-sorts area sorted bitmaps by order.  Pack takes them from the back, so
+//	they end up smallest first. //
+static void SortForPacking(vector<unique_ptr<Bitmap>>& bitmaps, PackOrder order)
+{
+	auto key = [order](Bitmap const& bitmap) {
+		switch (order)
+		{
+		case PackOrder::MaxSide: return max(bitmap.width, bitmap.height);
+		case PackOrder::Perimeter: return bitmap.width + bitmap.height;
+		case PackOrder::Height: return bitmap.height;
+		default: return bitmap.width * bitmap.height;
+		}
+	};
+	stable_sort(bitmaps.begin(), bitmaps.end(), [&key](unique_ptr<Bitmap> const& a, unique_ptr<Bitmap> const& b) {
+		return key(*a) < key(*b);
+	});
+}
+
+// Views of bitmaps (sharing their pixels) for trial packs to use up
+static vector<unique_ptr<Bitmap>> MakeViews(vector<unique_ptr<Bitmap>> const& bitmaps)
+{
+	vector<unique_ptr<Bitmap>> views;
+	views.reserve(bitmaps.size());
+	for (unique_ptr<Bitmap> const& bitmap : bitmaps)
+	{
+		views.push_back(make_unique<Bitmap>(bitmap->name, bitmap->width, bitmap->height, 
+			bitmap->data, bitmap->stride, bitmap->storage));
+		views.back()->hashValue = bitmap->hashValue;
+	}
+	return views;
+}
+
+// What packing the bitmaps came to
+struct PackResult
+{
+	bool fits;
+	size_t numPages;
+	size_t pageArea;
+	size_t usedArea;
+};
+
+// Packs views into pages like the atlas would be packed, using them up
+static PackResult PackViews(vector<unique_ptr<Bitmap>>& views, AtlasOptions const& options, PackSettings const& settings)
+{
+	PackResult result = { true, 0, 0, 0 };
+	while (!views.empty() && result.fits)
+	{
+		Packer packer(options.size, options.size, options.padding, settings);
+		packer.Pack(views, nullptr, options.unique, options.rotate);
+		result.fits = !packer.bitmaps.empty();
+		result.numPages++;
+		result.pageArea += static_cast<size_t>(packer.width) * packer.height;
+		result.usedArea += packer.UsedArea();
+	}
+	return result;
+}
+
+// base w/ each of the heuristics its engine has (for guillotine, each 
+//	combination of fit & split) //
+static vector<PackSettings> EngineSettings(PackSettings const& base)
+{
+	vector<PackSettings> settings;
+	switch (base.engine)
+	{
+	case PackEngine::MaxRects:
+		for (MaxRectsBinPack::FreeRectChoiceHeuristic fit : { 
+			MaxRectsBinPack::RectBestShortSideFit, MaxRectsBinPack::RectBestLongSideFit, 
+			MaxRectsBinPack::RectBestAreaFit, MaxRectsBinPack::RectBottomLeftRule, 
+			MaxRectsBinPack::RectContactPointRule })
+		{
+			settings.push_back(base);
+			settings.back().maxRectsFit = fit;
+		}
+		break;
+	case PackEngine::Skyline:
+		for (SkylineBinPack::LevelChoiceHeuristic level : { SkylineBinPack::LevelBottomLeft, SkylineBinPack::LevelMinWasteFit })
+		{
+			settings.push_back(base);
+			settings.back().skylineLevel = level;
+		}
+		break;
+	case PackEngine::Guillotine:
+		for (GuillotineBinPack::FreeRectChoiceHeuristic fit : { 
+			GuillotineBinPack::RectBestShortSideFit, GuillotineBinPack::RectBestLongSideFit, 
+			GuillotineBinPack::RectBestAreaFit, GuillotineBinPack::RectWorstShortSideFit, 
+			GuillotineBinPack::RectWorstLongSideFit, GuillotineBinPack::RectWorstAreaFit })
+		{
+			for (GuillotineBinPack::GuillotineSplitHeuristic split : { 
+				GuillotineBinPack::SplitShorterLeftoverAxis, GuillotineBinPack::SplitLongerLeftoverAxis, 
+				GuillotineBinPack::SplitShorterAxis, GuillotineBinPack::SplitLongerAxis, 
+				GuillotineBinPack::SplitMinimizeArea, GuillotineBinPack::SplitMaximizeArea })
+			{
+				settings.push_back(base);
+				settings.back().guillotineFit = fit;
+				settings.back().guillotineSplit = split;
+			}
+		}
+		break;
+	}
+	return settings;
+}
+
+// Packs views of the bitmaps w/ every heuristic of the engine picked, in 
+//	every order, all at once, then sorts bitmaps into the order of the one 
+//	that needed the fewest pages, and after that the least page area.  Ties 
+//	go to the earlier combination, so the result doesn't depend on the 
+//	number of jobs. //
+static void ChoosePacking(vector<unique_ptr<Bitmap>>& bitmaps, AtlasOptions const& options, 
+	ThreadPool& threadPool, PackSettings& outSettings, ostream& log)
+{
+	const vector<PackSettings> candidates = EngineSettings(options.packing);
+	const PackOrder orders[] = { PackOrder::Area, PackOrder::MaxSide, PackOrder::Perimeter, PackOrder::Height, PackOrder::GlobalFit };
+	const size_t numOrders = sizeof(orders) / sizeof(orders[0]);
+	const size_t numTrials = candidates.size() * numOrders;
+	auto trialSettings = [&](size_t t) {
+		PackSettings settings = candidates[t / numOrders];
+		settings.globalFit = orders[t % numOrders] == PackOrder::GlobalFit;
+		return settings;
+	};
+	
+	vector<PackResult> trials(numTrials);
+	threadPool.ParallelFor(numTrials, [&](size_t t) {
+		vector<unique_ptr<Bitmap>> views = MakeViews(bitmaps);
+		SortForPacking(views, orders[t % numOrders]);
+		trials[t] = PackViews(views, options, trialSettings(t));
+	});
+	
+	size_t best = 0;
+	for (size_t t = 1; t < numTrials; t++)
+	{
+		PackResult const& trial = trials[t];
+		if (trial.fits && (!trials[best].fits || trial.numPages < trials[best].numPages ||
+			(trial.numPages == trials[best].numPages && trial.pageArea < trials[best].pageArea)))
+		{
+			best = t;
+		}
+	}
+	if (options.verbose)
+	{
+		for (size_t t = 0; t < numTrials; t++)
+		{
+			log << '\t' << PackSettingsName(candidates[t / numOrders]) << " by " << PackOrderName(orders[t % numOrders]) << ": ";
+			if (trials[t].fits)
+				log << trials[t].numPages << " pages, " << trials[t].pageArea << " pixels" << endl;
+			else
+				log << "doesn't fit" << endl;
+		}
+		log << "pack effort: packing by " << PackOrderName(orders[best % numOrders]) << 
+			" w/ " << PackSettingsName(candidates[best / numOrders]) << endl;
+	}
+	SortForPacking(bitmaps, orders[best % numOrders]);
+	outSettings = trialSettings(best);
+}
+
+// Packs views of the (area sorted) bitmaps w/ every engine & every setting 
+//	it has, one after the other on this thread so the times compare fairly, 
+//	and reports how long each took & how much of the pages it filled. //
+static void BenchPackers(vector<unique_ptr<Bitmap>> const& bitmaps, AtlasOptions const& options, ostream& log)
+{
+	log << "Benchmarking packers on " << bitmaps.size() << " bitmaps...\n";
+	for (PackEngine engine : { PackEngine::MaxRects, PackEngine::Skyline, PackEngine::Guillotine })
+	{
+		for (bool toggle : { true, false })
+		{
+			// maxrects' global fit, skyline's waste map & guillotine's merging
+			PackSettings base = options.packing;
+			base.engine = engine;
+			base.globalFit = engine == PackEngine::MaxRects && !toggle;
+			base.skylineWasteMap = toggle;
+			base.guillotineMerge = toggle;
+			for (PackSettings const& settings : EngineSettings(base))
+			{
+				vector<unique_ptr<Bitmap>> views = MakeViews(bitmaps);
+				const auto start = chrono::steady_clock::now();
+				const PackResult result = PackViews(views, options, settings);
+				const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+				log << "\t" << PackSettingsName(settings) << ": " << seconds * 1000.0 << " ms, ";
+				if (result.fits)
+					log << result.numPages << " pages, occupancy " << static_cast<float>(result.usedArea) / result.pageArea << "\n";
+				else
+					log << "doesn't fit\n";
+			}
+		}
+	}
+}
+
+// The page sides the size search tries between lo & hi: powers of two, or
+//	w/ --npot, multiples of 4 (the block size of compressed textures) //
+static vector<int> PageSides(int lo, int hi, bool npot)
+{
+	vector<int> sides;
+	if (npot)
+	{
+		for (int side = (lo + 3) / 4 * 4; side <= hi; side += 4)
+			sides.push_back(side);
+	}
+	else
+	{
+		for (int side = 1; side <= hi; side *= 2)
+			if (side >= lo)
+				sides.push_back(side);
+	}
+	return sides;
+}
+
+// Looks for the page size w/ the least area that still holds everything in
+//	the page, and repacks the page at that size if it's smaller than the one 
+//	ShrinkToFit got.  Each width is tried on its own thread, binary 
+//	searching the heights between what the bitmaps' area needs at least & 
+//	the height that would make the page no smaller.  Ties go to the squarer
+//	size, then the narrower one.  Returns false if the repack fails. //
+static bool SearchPageSize(unique_ptr<Packer>& page, AtlasOptions const& options, PackSettings const& packing, 
+	ThreadPool& threadPool, string const& name, ostream& log)
+{
+	const int pad = options.padding;
+	const size_t pageArea = static_cast<size_t>(page->width) * page->height;
+	size_t paddedArea = 0;
+	int minWidth = 1;
+	int minHeight = 1;
+	for (size_t i = 0; i < page->bitmaps.size(); i++)
+	{
+		Bitmap const& bitmap = *page->bitmaps[i];
+		if (page->points[i].dupID < 0)
+			paddedArea += static_cast<size_t>(bitmap.width + pad) * (bitmap.height + pad);
+		minWidth = max(minWidth, (options.rotate ? min(bitmap.width, bitmap.height) : bitmap.width) + pad * 2);
+		minHeight = max(minHeight, (options.rotate ? min(bitmap.width, bitmap.height) : bitmap.height) + pad * 2);
+	}
+	
+	// the page packs the bitmaps from the back, in the order they went in
+	auto fits = [&](int width, int height) {
+		vector<unique_ptr<Bitmap>> views = MakeViews(page->bitmaps);
+		reverse(views.begin(), views.end());
+		Packer trial(width, height, pad, packing);
+		trial.Pack(views, nullptr, options.unique, options.rotate);
+		return views.empty();
+	};
+	const vector<int> widths = PageSides(minWidth, options.size, options.npot);
+	vector<int> heights(widths.size(), 0);
+	threadPool.ParallelFor(widths.size(), [&](size_t w) {
+		const int width = widths[w];
+		const int binWidth = width - pad;
+		const int lo = max<int>(minHeight, pad + static_cast<int>((paddedArea + binWidth - 1) / binWidth));
+		const int hi = static_cast<int>(min<size_t>(options.size, (pageArea - 1) / width));
+		const vector<int> sides = PageSides(lo, hi, options.npot);
+		if (sides.empty() || !fits(width, sides.back()))
+			return;
+		size_t first = 0;
+		size_t last = sides.size() - 1;
+		while (first < last)
+		{
+			const size_t mid = (first + last) / 2;
+			if (fits(width, sides[mid]))
+				last = mid;
+			else
+				first = mid + 1;
+		}
+		heights[w] = sides[first];
+	});
+	
+	size_t best = widths.size();
+	for (size_t w = 0; w < widths.size(); w++)
+	{
+		if (heights[w] == 0)
+			continue;
+		if (best == widths.size())
+		{
+			best = w;
+			continue;
+		}
+		const size_t area = static_cast<size_t>(widths[w]) * heights[w];
+		const size_t bestArea = static_cast<size_t>(widths[best]) * heights[best];
+		if (area < bestArea || (area == bestArea && max(widths[w], heights[w]) < max(widths[best], heights[best])))
+			best = w;
+	}
+	if (best == widths.size())
+		return true;
+	
+	if (options.verbose)
+	{
+		log << "size search: " << name << " (" << page->width << " x " << page->height << ") fits in " << 
+			widths[best] << " x " << heights[best] << endl;
+	}
+	vector<unique_ptr<Bitmap>> bitmaps = move(page->bitmaps);
+	reverse(bitmaps.begin(), bitmaps.end());
+	page = make_unique<Packer>(widths[best], heights[best], pad, packing);
+	page->Pack(bitmaps, nullptr, options.unique, options.rotate);
+	if (!bitmaps.empty())
+	{
+		cerr << "size search: repacking " << name << " at " << widths[best] << " x " << heights[best] << 
+			" failed, could not fit bitmap: " << bitmaps.back()->name << endl;
+		return false;
+	}
+	return true;
+}
+
+// Decodes & re-encodes the atlas pages w/ every zlib backend compiled in, 
+//	reporting the throughput of each in megabytes of pixels per second.
+//	The encoding runs on one thread so the backends compare fairly. //
+static void BenchZlibBackends(vector<string> const& pngFiles, PngLevel level)
+{
+	const PngWriteSettings settings(level);
+	cout << "Benchmarking zlib backends on " << pngFiles.size() << " atlas pages...\n";
+	const ZlibBackend previous = CurrentZlibBackend();
+	for (ZlibBackend backend : { ZlibBackend::LodePNG, ZlibBackend::Zlib, ZlibBackend::Flate })
+	{
+		if (!ZlibBackendAvailable(backend))
+		{
+			cout << "\t" << ZlibBackendName(backend) << ": not compiled in\n";
+			continue;
+		}
+		SetZlibBackend(backend);
+		double decodeSeconds = 0.0;
+		double encodeSeconds = 0.0;
+		size_t pixelBytes = 0;
+		uintmax_t encodedBytes = 0;
+		for (string const& file : pngFiles)
+		{
+			unsigned char* pixels;
+			unsigned int w, h;
+			auto start = chrono::steady_clock::now();
+			if (DecodePng32File(&pixels, &w, &h, file))
+			{
+				cerr << "failed to load png: " << file << endl;
+				exit(EXIT_FAILURE);
+			}
+			decodeSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			uint32_t const*const rows = reinterpret_cast<uint32_t const*>(pixels);
+			const string benchFile = file + ".bench";
+			start = chrono::steady_clock::now();
+			if (!SavePngStreamed(benchFile, static_cast<int>(w), static_cast<int>(h), 
+				[&](int y, int)->uint32_t const* { return rows + static_cast<size_t>(y) * w; }, 
+				settings))
+			{
+				cout << "failed to save png: " << benchFile << endl;
+				exit(EXIT_FAILURE);
+			}
+			encodeSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			pixelBytes += static_cast<size_t>(w) * h * 4;
+			encodedBytes += fs::file_size(benchFile);
+			RemoveFile(benchFile);
+			free(pixels);
+		}
+		const double megabytes = pixelBytes / 1e6;
+		cout << "\t" << ZlibBackendName(backend) << ": decode " << megabytes / decodeSeconds << 
+			" MB/s, encode " << megabytes / encodeSeconds << " MB/s (--png-level " << 
+			PngLevelName(level) << ", " << encodedBytes << " bytes)\n";
+	}
+	SetZlibBackend(previous);
+}
 struct Palette
 {
 	string name;
@@ -202,175 +1095,331 @@ struct PaletteGroup
 {
 	vector<string> textureNames;
 	vector<Palette> palettes;
+	// built from palettes[0] once all the palettes are loaded
+	PaletteLookup defaultPaletteLookup;
 };
-int main(int argc, const char* argv[])
+struct FlipbookMeta
+{
+	string fileNameAndGfxPathAndExt;
+	int frameWidth;
+	int frameHeight;
+	int frameCount;
+	bool generateMask;
+	bool generateOutline;
+};
+// The parts of Vagante's gfx-meta.json that go into an atlas.  The sheets are
+//	every flipbook's (w/ the player, pet & skeleton class flipbooks repeated 
+//	for each costume) followed by every vfont's. //
+struct GfxMeta
+{
+	vector<FlipbookMeta> flipbooks;
+	vector<string> sheetFileNames;
+};
+static bool ParseJsonFile(const string& file, const char* description, rapidjson::Document& outDocument)
+{
+	std::ifstream inFile{ file };
+	if (!inFile.is_open())
+	{
+		cerr << "Failed to open " << description << " JSON file '" << file << "'!\n";
+		return false;
+	}
+	std::stringstream ssFile;
+	ssFile << inFile.rdbuf();
+	outDocument.Parse(ssFile.str().c_str());
+	if (outDocument.HasParseError())
+	{
+		cerr << "Failed to parse " << description << " JSON file '" << file << "'!\n";
+		cerr << "json error [" << outDocument.GetErrorOffset() << "] =" <<
+			outDocument.GetParseError();
+		return false;
+	}
+	return true;
+}
+static bool LoadGfxMeta(const string& file, bool verbose, GfxMeta& outGfxMeta)
 {
-	vector<Bitmap*> bitmaps;
-	vector<Packer*> packers;
-	vector<PaletteGroup> paletteGroups;
-///    //Print out passed arguments
-///    for (int i = 0; i < argc; ++i)
-///        cout << argv[i] << ' ';
-///    cout << "\n";
-    
-    if (argc < 5)
-    {
-        cerr << "invalid input, expected: \"crunch [OUTPUT PREFIX] [INPUT GFX DIRECTORY] \
-[VAGANTE GFX META JSON FILE] [VAGANTE PALETTE JSON FILE] [OPTIONS...]\"\n";
-		cerr << "Usage notes: use Unix-style file paths, NOT windows style.\n";
-		cerr << "eg. 'C:/git/path-to-stuff' instead of 'C:\\git\\path-to-stuff'.\n";
-		cerr << "Multiple input directories can be supplied by separating them with commas.\n";
-        return EXIT_FAILURE;
-    }
-    
-    //Get the output directory and name
-    string outputDir, outputPrefix;
-    SplitFileName(argv[1], &outputDir, &outputPrefix, nullptr);
-
-    //Get all the input files and directories
-    vector<string> inputs;
-    stringstream ss(argv[2]);
-    while (ss.good())
-    {
-        string inputStr;
-        getline(ss, inputStr, ',');
-        inputs.push_back(inputStr);
-    }
-	//Get the gfx meta json file and parse it
-	const string gfxMetaJsonFileName = argv[3];
 	rapidjson::Document dGfxMeta;
+	if (!ParseJsonFile(file, "gfx meta", dGfxMeta))
+	{
+		return false;
+	}
+	vector<FlipbookMeta>& flipbookMetaArray = outGfxMeta.flipbooks;
+	const int numPlayerCostumes = dGfxMeta["num-player-costumes"].GetInt();
+	auto playerClassDirArray = dGfxMeta["player-class-directories"].GetArray();
+	auto petClassDirArray    = dGfxMeta["pet-class-directories"].GetArray();
+	auto pcFbArray       = dGfxMeta["player-class-flipbooks"].GetArray();
+	auto petFbArray      = dGfxMeta["pet-class-flipbooks"].GetArray();
+	auto skeletonFbArray = dGfxMeta["skeleton-class-flipbooks"].GetArray();
+	auto fbArray         = dGfxMeta["flipbooks"].GetArray();
+	auto gatherFlipbookMeta = [&flipbookMetaArray, verbose](string const& fileNamePrefix,
+		rapidjson::GenericArray<false, rapidjson::Value::ValueType> const& jsonArray)->void
 	{
-		std::ifstream inFileGfxMeta{ gfxMetaJsonFileName };
-		if (!inFileGfxMeta.is_open())
+		for (rapidjson::SizeType fb = 0; fb < jsonArray.Size(); fb++)
 		{
-			cerr << "Failed to open gfx meta JSON file '" << gfxMetaJsonFileName << "'!\n";
-			return EXIT_FAILURE;
+			auto const& flipbookMeta = jsonArray[fb];
+			FlipbookMeta newMeta;
+			newMeta.fileNameAndGfxPathAndExt = 
+				fileNamePrefix + flipbookMeta["filename"].GetString();
+			newMeta.frameWidth               = flipbookMeta["frame-width"].GetInt();
+			newMeta.frameHeight              = flipbookMeta["frame-height"].GetInt();
+			newMeta.frameCount               = flipbookMeta["frame-count"].GetInt();
+			newMeta.generateMask             = flipbookMeta["generate-mask"].GetBool();
+			newMeta.generateOutline          = flipbookMeta["generate-outline"].GetBool();
+			if (verbose)
+			{
+				cout << "new flipbook fileName=" << newMeta.fileNameAndGfxPathAndExt << "\n";
+				///cout << "new flipbook name=" << flipbookBitmaps.back()->name << "\n";
+			}
+			flipbookMetaArray.push_back(newMeta);
 		}
-		std::stringstream ssFileGfxMeta;
-		ssFileGfxMeta << inFileGfxMeta.rdbuf();
-		dGfxMeta.Parse(ssFileGfxMeta.str().c_str());
-		if (dGfxMeta.HasParseError())
+	};
+	for (int playerCostumeIndex = 1; playerCostumeIndex <= numPlayerCostumes; playerCostumeIndex++)
+	{
+		for (rapidjson::SizeType d = 0; d < playerClassDirArray.Size(); d++)
 		{
-			cerr << "Failed to parse gfx meta JSON file '" << gfxMetaJsonFileName << "'!\n";
-			cerr << "json error [" << dGfxMeta.GetErrorOffset() << "] =" <<
-				dGfxMeta.GetParseError();
-			return EXIT_FAILURE;
+			char const*const classDir = playerClassDirArray[d].GetString();
+			stringstream ssDir;
+			ssDir << classDir << playerCostumeIndex << "/";
+			gatherFlipbookMeta(ssDir.str(), pcFbArray);
+			if (ssDir.str().find("skeleton") != string::npos)
+			{
+				gatherFlipbookMeta(ssDir.str(), skeletonFbArray);
+			}
+		}
+		for (rapidjson::SizeType d = 0; d < petClassDirArray.Size(); d++)
+		{
+			char const*const classDir = petClassDirArray[d].GetString();
+			stringstream ssDir;
+			ssDir << classDir << playerCostumeIndex << "/";
+			gatherFlipbookMeta(ssDir.str(), petFbArray);
 		}
 	}
-	//Get the palette json file and parse it
-	const string palettesJsonFileName = argv[4];
+	gatherFlipbookMeta("", fbArray);
+	for (FlipbookMeta const& fbMeta : flipbookMetaArray)
+	{
+		outGfxMeta.sheetFileNames.push_back(fbMeta.fileNameAndGfxPathAndExt);
+	}
+	auto vFontArray = dGfxMeta["vfonts"].GetArray();
+	for (rapidjson::SizeType v = 0; v < vFontArray.Size(); v++)
+	{
+		outGfxMeta.sheetFileNames.emplace_back(vFontArray[v]["filename"].GetString());
+	}
+	return true;
+}
+static bool LoadPaletteGroups(const string& file, bool verbose, vector<PaletteGroup>& outPaletteGroups)
+{
 	rapidjson::Document dPalettes;
+	if (!ParseJsonFile(file, "palettes", dPalettes))
+	{
+		return false;
+	}
+	if (verbose)
 	{
-		std::ifstream inFilePalettes{ palettesJsonFileName };
-		if (!inFilePalettes.is_open())
+		cout << "Deserializing palettes JSON file...\n";
+	}
+	auto pGArray = dPalettes["palette-groups"].GetArray();
+	for (rapidjson::SizeType pg = 0; pg < pGArray.Size(); pg++)
+	{
+		auto const& palGroup = pGArray[pg];
+		PaletteGroup newPg;
+		const string newPgName = palGroup["name"].GetString();
+		if (verbose)
 		{
-			cerr << "Failed to open palettes JSON file '" << palettesJsonFileName << "'!\n";
-			return EXIT_FAILURE;
+			cout << "\tPaletteGroup name="<< newPgName<<"\n";
 		}
-		std::stringstream ssFilePalettes;
-		ssFilePalettes << inFilePalettes.rdbuf();
-		dPalettes.Parse(ssFilePalettes.str().c_str());
-		if (dPalettes.HasParseError())
+		auto texNameArray = palGroup["texture-names"].GetArray();
+		for (rapidjson::SizeType t = 0; t < texNameArray.Size(); t++)
 		{
-			cerr << "Failed to parse palettes JSON file '" << palettesJsonFileName << "'!\n";
-			cerr << "json error [" << dPalettes.GetErrorOffset() << "] =" <<
-				dPalettes.GetParseError();
-			return EXIT_FAILURE;
+			char const*const texName = texNameArray[t].GetString();
+			newPg.textureNames.emplace_back(texName);
+		}
+		auto pArray = palGroup["palettes"].GetArray();
+		for (rapidjson::SizeType p = 0; p < pArray.Size(); p++)
+		{
+			auto const& jsonPalette = pArray[p];
+			Palette newP;
+			newP.name = jsonPalette["name"].GetString();
+			if (verbose)
+			{
+				cout << "\t\tPalette name=" << newP.name << "\n";
+			}
+			auto colorArray = jsonPalette["colors"].GetArray();
+			for (rapidjson::SizeType c = 0; c < colorArray.Size(); c++)
+			{
+				auto colorComponentArray = colorArray[c].GetArray();
+				assert(colorComponentArray.Size() == 4);
+				const uint32_t red   = colorComponentArray[0].GetInt();
+				const uint32_t green = colorComponentArray[1].GetInt();
+				const uint32_t blue  = colorComponentArray[2].GetInt();
+				// Just ignore the alpha component because it is meaningless //
+				///const uint32_t alpha = colorComponentArray[3].GetInt();
+				const uint32_t colorData = 
+					///(alpha << 24) |
+					(blue  << 16) |
+					(green << 8 ) |
+					 red;
+				newP.colors.push_back(colorData);
+			}
+			// palette swaps index each palette w/ a color's index in the default one
+			if (!newPg.palettes.empty() && newP.colors.size() != newPg.palettes[0].colors.size())
+			{
+				cerr << "palette '" << newP.name << "' of palette group '" << newPgName << "' has " << 
+					newP.colors.size() << " colors, but the group's default palette '" << 
+					newPg.palettes[0].name << "' has " << newPg.palettes[0].colors.size() << "!\n";
+				return false;
+			}
+			newPg.palettes.push_back(newP);
+		}
+		// @assumption
+		//	first palette in a palette group is always the default palette
+		if (!newPg.palettes.empty())
+		{
+			newPg.defaultPaletteLookup = PaletteLookup(newPg.palettes[0].colors);
 		}
+		outPaletteGroups.push_back(newPg);
 	}
-    
-    //Get the options
-    optSize = 4096;
-    optPadding = 2;
-    optXml = false;
-    optBinary = false;
-    optJson = false;
-    optPremultiply = false;
-    optTrim = false;
-    optVerbose = false;
-    optForce = false;
-    optUnique = false;
-    for (int i = 5; i < argc; ++i)
+	return true;
+}
+// One atlas to build, as given on the command line or in a batch file //
+struct AtlasJob
+{
+	string output;
+	vector<string> inputs;
+	string gfxMetaJsonFileName;
+	string palettesJsonFileName;
+	AtlasOptions options;
+	// shared by every atlas of the run that uses the same json file
+	GfxMeta const* gfxMeta = nullptr;
+	vector<PaletteGroup> const* paletteGroups = nullptr;
+};
+static vector<string> SplitInputs(const string& str)
+{
+    vector<string> inputs;
+    stringstream ss(str);
+    while (ss.good())
     {
-        string arg = argv[i];
-        if (arg == "-d" || arg == "--default")
-            optXml = optPremultiply = optTrim = optUnique = true;
-        else if (arg == "-x" || arg == "--xml")
-            optXml = true;
-        else if (arg == "-b" || arg == "--binary")
-            optBinary = true;
-        else if (arg == "-j" || arg == "--json")
-            optJson = true;
-        else if (arg == "-p" || arg == "--premultiply")
-            optPremultiply = true;
-        else if (arg == "-t" || arg == "--trim")
-            optTrim = true;
-        else if (arg == "-v" || arg == "--verbose")
-            optVerbose = true;
-        else if (arg == "-f" || arg == "--force")
-            optForce = true;
-        else if (arg == "-u" || arg == "--unique")
-            optUnique = true;
-        else if (arg == "-r" || arg == "--rotate")
-            optRotate = true;
-        else if (arg.find("--size") == 0)
-            optSize = GetPackSize(arg.substr(6));
-        else if (arg.find("-s") == 0)
-            optSize = GetPackSize(arg.substr(2));
-        else if (arg.find("--pad") == 0)
-            optPadding = GetPadding(arg.substr(5));
-        else if (arg.find("-p") == 0)
-            optPadding = GetPadding(arg.substr(2));
-        else
-        {
-            cerr << "unexpected argument: " << arg << "\n";
-            return EXIT_FAILURE;
-        }
+        string inputStr;
+        getline(ss, inputStr, ',');
+        inputs.push_back(inputStr);
     }
-	if (optVerbose)
+    return inputs;
+}
+// the file sheet s of an atlas is decoded from & the name the sheet gets
+static void GetSheetFile(AtlasJob const& job, size_t s, string& outFile, string& outName)
+{
+	string const& fileNameAndGfxPathAndExt = job.gfxMeta->sheetFileNames[s];
+	string fileDir;
+	SplitFileName(fileNameAndGfxPathAndExt, &fileDir, nullptr, nullptr);
+	outFile = job.inputs[0] + "/" + fileNameAndGfxPathAndExt;
+	outName = fileDir + GetFileName(outFile);
+}
+// Builds the atlas job asks for, unless it's already up to date.  Any png
+//	pages written are added to outPngFiles.  Every atlas of a batch runs this
+//	at the same time, sharing threadPool & the sheets in sheetCache. //
+static int BuildAtlas(AtlasJob const& job, SheetCache& sheetCache, ThreadPool& threadPool, 
+	vector<string>& outPngFiles, ostream& log)
+{
+	// Frames & their variants take their pixels from here.  It's declared 
+	//	first so it goes last, after every bitmap of the atlas, which frees 
+	//	the atlas's pixels as soon as it's saved instead of when the batch is
+	//	done. //
+	PixelArena pixelArena;
+	AtlasOptions const& options = job.options;
+	vector<unique_ptr<Bitmap>> bitmaps;
+	vector<unique_ptr<Packer>> packers;
+	vector<PaletteGroup> const& paletteGroups = *job.paletteGroups;
+	vector<string> const& inputs = job.inputs;
+	string const& gfxMetaJsonFileName = job.gfxMetaJsonFileName;
+	string const& palettesJsonFileName = job.palettesJsonFileName;
+    
+    //Get the output directory and name
+    string outputDir, outputPrefix;
+    SplitFileName(job.output, &outputDir, &outputPrefix, nullptr);
+	if (options.verbose)
 	{
-		cout << "SUPPLIED PARAMETERS:\n";
-		cout << "outputDir=" << outputDir << "\n";
-		cout << "outputPrefix=" << outputPrefix << "\n";
-		cout << "input directories=\n";
+		log << "SUPPLIED PARAMETERS:\n";
+		log << "outputDir=" << outputDir << "\n";
+		log << "outputPrefix=" << outputPrefix << "\n";
+		log << "input directories=\n";
 		for (string const& input : inputs)
 		{
-			cout << "\t" << input << "\n";
+			log << "\t" << input << "\n";
 		}
-		cout << "gfxMetaJsonFileName=" << gfxMetaJsonFileName << "\n";
-		cout << "palettesJsonFileName=" << palettesJsonFileName << "\n";
-		cout << "END SUPPLIED PARAMETER OUTPUT.\n";
+		log << "gfxMetaJsonFileName=" << gfxMetaJsonFileName << "\n";
+		log << "palettesJsonFileName=" << palettesJsonFileName << "\n";
+		log << "END SUPPLIED PARAMETER OUTPUT.\n";
 	}
+	// Only the flipbook & vfont sheets gfx-meta.json refers to end up in the 
+	//	atlas, so they are also the only pngs the hash below depends on. //
+	vector<FlipbookMeta> const& flipbookMetaArray = job.gfxMeta->flipbooks;
+	vector<string> const& sheetFileNames = job.gfxMeta->sheetFileNames;
+	const size_t numSheets = sheetFileNames.size();
+	const size_t numVFonts = numSheets - flipbookMetaArray.size();
     
-    //Hash the arguments and input directories
-	if (optVerbose)
+    //Hash the arguments and the sheets
+	if (options.verbose)
 	{
-		cout << "Hashing arguments & input directories...";
+		log << "Hashing arguments & " << numSheets << " sheets using " << 
+			threadPool.NumThreads() << " threads...";
 	}
-    size_t newHash = 0;
-    for (int i = 1; i < argc; ++i)
-        HashString(newHash, argv[i]);
-    for (size_t i = 0; i < inputs.size(); ++i)
-    {
-        if (inputs[i].rfind('.') == string::npos)
-            HashFiles(newHash, inputs[i]);
-        else
-            HashFile(newHash, inputs[i]);
-    }
-	HashFile(newHash, gfxMetaJsonFileName);
-	HashFile(newHash, palettesJsonFileName);
-	if (optVerbose)
+    // inputs whose size & modification time match the manifest aren't read //
+    const string manifestFile = outputDir + outputPrefix + ".manifest";
+    FileManifest manifest;
+    manifest.paranoid = options.paranoid;
+    manifest.Load(manifestFile);
+    uint64_t newHash = 0;
+    HashString(newHash, job.output);
+    for (string const& input : inputs)
+        HashString(newHash, input);
+    HashString(newHash, gfxMetaJsonFileName);
+    HashString(newHash, palettesJsonFileName);
+    HashOptions(newHash, options);
+	// Nothing in here exits the process, since the other atlases of a batch 
+	//	are still being built on the same threads; a failure is flagged & the
+	//	atlas gives up once the threads working on it are done. //
+	atomic<bool> failed(false);
+	// nobody else is waiting on this atlas' share of the sheets if it stops 
+	//	before decoding them
+	auto releaseSheets = [&]()->void
+	{
+		for (size_t s = 0; s < numSheets; s++)
+		{
+			string sheetFile, sheetName;
+			GetSheetFile(job, s, sheetFile, sheetName);
+			sheetCache.Release(sheetFile, sheetName, options.premultiply);
+		}
+	};
+	vector<uint64_t> sheetContentHashes(numSheets);
+	threadPool.ParallelFor(numSheets, [&](size_t s)->void
+	{
+		if (!manifest.ContentHash(inputs[0] + "/" + sheetFileNames[s], sheetContentHashes[s]))
+			failed = true;
+	});
+	for (uint64_t sheetContentHash : sheetContentHashes)
+	{
+		HashCombine(newHash, sheetContentHash);
+	}
+	if (failed || !HashFile(newHash, gfxMetaJsonFileName, &manifest) || 
+		!HashFile(newHash, palettesJsonFileName, &manifest))
+	{
+		releaseSheets();
+		return EXIT_FAILURE;
+	}
+	if (options.verbose)
 	{
-		cout << "DONE!\n";
+		log << "DONE! (read " << manifest.numHashed << " of " << manifest.numFiles << " files)\n";
 	}
     
     //Load the old hash
-    size_t oldHash;
+    uint64_t oldHash;
     if (LoadHash(oldHash, outputDir + outputPrefix + ".hash"))
     {
-        if (!optForce && newHash == oldHash)
+        if (!options.force && newHash == oldHash)
         {
-            cout << "atlas is unchanged: " << outputPrefix << "\n";
+            // files that were touched without changing don't need reading again
+            if (manifest.numHashed > 0)
+                manifest.Save(manifestFile);
+            releaseSheets();
+            log << "atlas is unchanged: " << outputPrefix << "\n";
             return EXIT_SUCCESS;
         }
     }
@@ -388,22 +1437,42 @@ int main(int argc, const char* argv[])
     -s# --size#             max atlas size (# can be 4096, 2048, 1024, 512, or 256)
     -p# --pad#              padding between images (# can be from 0 to 16)*/
     
-    if (optVerbose)
+    if (options.verbose)
     {
-        cout << "options...\n";
-        cout << "\t--xml: " << (optXml ? "true" : "false") << "\n";
-        cout << "\t--binary: " << (optBinary ? "true" : "false") << "\n";
-        cout << "\t--json: " << (optJson ? "true" : "false") << "\n";
-        cout << "\t--premultiply: " << (optPremultiply ? "true" : "false") << "\n";
-        cout << "\t--trim: " << (optTrim ? "true" : "false") << "\n";
-        cout << "\t--verbose: " << (optVerbose ? "true" : "false") << "\n";
-        cout << "\t--force: " << (optForce ? "true" : "false") << "\n";
-        cout << "\t--unique: " << (optUnique ? "true" : "false") << "\n";
-        cout << "\t--rotate: " << (optRotate ? "true" : "false") << "\n";
-        cout << "\t--size: " << optSize << "\n";
-        cout << "\t--pad: " << optPadding << "\n";
+        log << "options...\n";
+        log << "\t--xml: " << (options.xml ? "true" : "false") << "\n";
+        log << "\t--binary: " << (options.binary ? "true" : "false") << "\n";
+        log << "\t--json: " << (options.json ? "true" : "false") << "\n";
+        log << "\t--premultiply: " << (options.premultiply ? "true" : "false") << "\n";
+        log << "\t--trim: " << (options.trim ? "true" : "false") << "\n";
+        log << "\t--verbose: " << (options.verbose ? "true" : "false") << "\n";
+        log << "\t--force: " << (options.force ? "true" : "false") << "\n";
+        log << "\t--unique: " << (options.unique ? "true" : "false") << "\n";
+        log << "\t--rotate: " << (options.rotate ? "true" : "false") << "\n";
+        log << "\t--size: " << options.size << "\n";
+        log << "\t--pad: " << options.padding << "\n";
+        log << "\t--jobs: " << options.jobs << "\n";
+        log << "\t--png-level: " << PngLevelName(options.pngLevel) << "\n";
+        log << "\t--zlib: " << ZlibBackendName(options.zlib) << "\n";
+        log << "\t--bench-zlib: " << (options.benchZlib ? "true" : "false") << "\n";
+        log << "\t--no-cache: " << (options.cache ? "false" : "true") << "\n";
+        log << "\t--incremental: " << (options.incremental ? "true" : "false") << "\n";
+        log << "\t--repack-threshold: " << options.repackThreshold << "\n";
+        log << "\t--paranoid: " << (options.paranoid ? "true" : "false") << "\n";
+        log << "\t--packer: " << PackSettingsName(options.packing) << "\n";
     }
     
+    //Load where the previous run packed everything, unless the settings that
+    //	decide placements have changed since then.  Only maxrects can pack 
+    //	around bitmaps that are already in place.
+    const string placementsFile = outputDir + outputPrefix + ".placements";
+    AtlasPlacements previousPlacements;
+    const bool havePreviousPlacements = options.incremental && !options.force && 
+        LoadPlacements(placementsFile, previousPlacements) &&
+        previousPlacements.size == options.size && previousPlacements.pad == options.padding &&
+        previousPlacements.unique == options.unique && previousPlacements.rotate == options.rotate &&
+        options.packing.engine == PackEngine::MaxRects;
+    
     //Remove old files
 	const string processedGfxDir = outputDir + ".processed-gfx";
 	const bool debugProcessedGfx = false;
@@ -416,132 +1485,155 @@ int main(int argc, const char* argv[])
 		RemoveFile(outputDir + outputPrefix + ".bin");
 		RemoveFile(outputDir + outputPrefix + ".xml");
 		RemoveFile(outputDir + outputPrefix + ".json");
-		for (size_t i = 0; i < 16; ++i)
-			RemoveFile(outputDir + outputPrefix + to_string(i) + ".png");
-	}
-	// Load the palettes.json file contents into memory //
-	if (optVerbose)
-	{
-		cout << "Deserializing palettes JSON file...\n";
-	}
-	{
-		auto pGArray = dPalettes["palette-groups"].GetArray();
-		for (rapidjson::SizeType pg = 0; pg < pGArray.Size(); pg++)
+		RemoveFile(placementsFile);
+		// pages that come out the same as last time are left as they are
+		if (!havePreviousPlacements)
 		{
-			auto const& palGroup = pGArray[pg];
-			PaletteGroup newPg;
-			const string newPgName = palGroup["name"].GetString();
-			if (optVerbose)
-			{
-				cout << "\tPaletteGroup name="<< newPgName<<"\n";
-			}
-			auto texNameArray = palGroup["texture-names"].GetArray();
-			for (rapidjson::SizeType t = 0; t < texNameArray.Size(); t++)
-			{
-				char const*const texName = texNameArray[t].GetString();
-				newPg.textureNames.emplace_back(texName);
-			}
-			auto pArray = palGroup["palettes"].GetArray();
-			for (rapidjson::SizeType p = 0; p < pArray.Size(); p++)
-			{
-				auto const& jsonPalette = pArray[p];
-				Palette newP;
-				newP.name = jsonPalette["name"].GetString();
-				if (optVerbose)
-				{
-					cout << "\t\tPalette name=" << newP.name << "\n";
-				}
-				auto colorArray = jsonPalette["colors"].GetArray();
-				for (rapidjson::SizeType c = 0; c < colorArray.Size(); c++)
-				{
-					auto colorComponentArray = colorArray[c].GetArray();
-					assert(colorComponentArray.Size() == 4);
-					const uint32_t red   = colorComponentArray[0].GetInt();
-					const uint32_t green = colorComponentArray[1].GetInt();
-					const uint32_t blue  = colorComponentArray[2].GetInt();
-					// Just ignore the alpha component because it is meaningless //
-					///const uint32_t alpha = colorComponentArray[3].GetInt();
-					const uint32_t colorData = 
-						///(alpha << 24) |
-						(blue  << 16) |
-						(green << 8 ) |
-						 red;
-					newP.colors.push_back(colorData);
-				}
-				newPg.palettes.push_back(newP);
-			}
-			paletteGroups.push_back(newPg);
+			for (size_t i = 0; i < 16; ++i)
+				RemoveFile(outputDir + outputPrefix + to_string(i) + ".png");
 		}
 	}
 	// Process Vagante's gfx-meta.json file //
 ///	fs::create_directories(processedGfxDir);
 ///	cout << "processedGfxDir='" << processedGfxDir << "'\n";
 	{
-		vector<Bitmap*> flipbookBitmaps;
-		vector<Bitmap*> frameBitmaps;
-		struct FlipbookMeta
+		// The sheets are only needed until their frames have been sliced out.
+		//	The frames are views into the sheets' pixels, which are freed once
+		//	the atlas pages holding those frames have been saved. //
+		vector<shared_ptr<Bitmap const>> flipbookBitmaps;
+		// Each frame is sliced out of its sheet & trimmed, and then every variant
+		//	of it (the frame itself, mask, outline & palette swaps) is derived from 
+		//	that.  The jobs are gathered in the order the atlas used to receive the
+		//	bitmaps, and their results are stored in that same order. //
+		struct FrameSlice
+		{
+			Bitmap const* sheet;
+			int x;
+			int y;
+			int width;
+			int height;
+			string name;
+			size_t firstVariantJob;
+			size_t numVariantJobs;
+		};
+		enum class FrameVariant
+		{
+			Frame,
+			Mask,
+			Outline,
+			Palette
+		};
+		// A palette job produces every palette swap of its frame in one go, so it
+		//	has one name per palette; all other jobs produce a single bitmap. //
+		struct FrameVariantJob
 		{
-			string fileNameAndGfxPathAndExt;
-			int frameWidth;
-			int frameHeight;
-			int frameCount;
-			bool generateMask;
-			bool generateOutline;
+			FrameVariant variant;
+			vector<string> names;
+			vector<string> debugFileNames;
+			PaletteGroup const* paletteGroup = nullptr;
+			size_t firstBitmap;
 		};
-		vector<FlipbookMeta> flipbookMetaArray;
-		const int numPlayerCostumes = dGfxMeta["num-player-costumes"].GetInt();
-		auto playerClassDirArray = dGfxMeta["player-class-directories"].GetArray();
-		auto petClassDirArray    = dGfxMeta["pet-class-directories"].GetArray();
-		auto pcFbArray       = dGfxMeta["player-class-flipbooks"].GetArray();
-		auto petFbArray      = dGfxMeta["pet-class-flipbooks"].GetArray();
-		auto skeletonFbArray = dGfxMeta["skeleton-class-flipbooks"].GetArray();
-		auto fbArray         = dGfxMeta["flipbooks"].GetArray();
-		auto gatherFlipbookMeta = [&flipbookMetaArray](string const& fileNamePrefix,
-			rapidjson::GenericArray<false, rapidjson::Value::ValueType> const& jsonArray)->void
-		{
-			for (rapidjson::SizeType fb = 0; fb < jsonArray.Size(); fb++)
-			{
-				auto const& flipbookMeta = jsonArray[fb];
-				FlipbookMeta newMeta;
-				newMeta.fileNameAndGfxPathAndExt = 
-					fileNamePrefix + flipbookMeta["filename"].GetString();
-				newMeta.frameWidth               = flipbookMeta["frame-width"].GetInt();
-				newMeta.frameHeight              = flipbookMeta["frame-height"].GetInt();
-				newMeta.frameCount               = flipbookMeta["frame-count"].GetInt();
-				newMeta.generateMask             = flipbookMeta["generate-mask"].GetBool();
-				newMeta.generateOutline          = flipbookMeta["generate-outline"].GetBool();
-				if (optVerbose)
+		size_t numFrameVariantBitmaps = 0;
+		vector<FrameSlice> frameSlices;
+		vector<FrameVariantJob> frameVariantJobs;
+		// iterate over paletteGroups, iterate over each PaletteGroup's textureNames,
+		//	if it contains the texture name in this PaletteGroup, that means we need
+		//	to also generate palette swaps for each of its frames!
+		// @assumtion
+		//	for any given texture file, it is only located in ONE palette group!
+		auto findPaletteGroup = [&paletteGroups](string const& textureName)->PaletteGroup const*
+		{
+			for (auto const& pg : paletteGroups)
+			{
+				for (string const& texName : pg.textureNames)
 				{
-					cout << "new flipbook fileName=" << newMeta.fileNameAndGfxPathAndExt << "\n";
-					///cout << "new flipbook name=" << flipbookBitmaps.back()->name << "\n";
+					if (textureName == texName)
+					{
+						return &pg;
+					}
 				}
-				flipbookMetaArray.push_back(newMeta);
 			}
+			return nullptr;
 		};
-		for (int playerCostumeIndex = 1; playerCostumeIndex <= numPlayerCostumes; playerCostumeIndex++)
+		// Decode every flipbook & vfont sheet up front on the thread pool.
+		//	The sheets are sliced below in the same order as before, so the atlas 
+		//	comes out identical to a serial run.  Sheets whose bitmaps are in the
+		//	image cache aren't decoded at all; their sheet bitmap stays null.
+		//	Sheets other atlases of a batch use as well are only decoded once. //
+		if (options.verbose)
+		{
+			log << "Decoding " << numSheets << 
+				" flipbook & vfont sheets using " << threadPool.NumThreads() << " threads...";
+		}
+		flipbookBitmaps.resize(flipbookMetaArray.size());
+		vector<shared_ptr<Bitmap const>> vFontBitmaps(numVFonts);
+		ImageCache imageCache(outputDir + outputPrefix + ".cache");
+		vector<uint64_t> sheetCacheKeys(numSheets);
+		vector<vector<unique_ptr<Bitmap>>> cachedSheetBitmaps(numSheets);
+		threadPool.ParallelFor(numSheets, [&](size_t s)->void
 		{
-			for (rapidjson::SizeType d = 0; d < playerClassDirArray.Size(); d++)
+			const bool isVFont = s >= flipbookMetaArray.size();
+			const size_t v = s - flipbookMetaArray.size();
+			string const& fileNameAndGfxPathAndExt = sheetFileNames[s];
+			string absoluteFileName, sheetName;
+			GetSheetFile(job, s, absoluteFileName, sheetName);
+			if (options.cache)
 			{
-				char const*const classDir = playerClassDirArray[d].GetString();
-				stringstream ssDir;
-				ssDir << classDir << playerCostumeIndex << "/";
-				gatherFlipbookMeta(ssDir.str(), pcFbArray);
-				if (ssDir.str().find("skeleton") != string::npos)
+				// everything the sheet's bitmaps are derived from //
+				uint64_t& key = sheetCacheKeys[s];
+				HashString(key, fileNameAndGfxPathAndExt);
+				HashCombine(key, sheetContentHashes[s]);
+				HashCombine(key, static_cast<uint64_t>(options.premultiply));
+				HashCombine(key, static_cast<uint64_t>(options.trim));
+				HashCombine(key, static_cast<uint64_t>(isVFont));
+				if (!isVFont)
 				{
-					gatherFlipbookMeta(ssDir.str(), skeletonFbArray);
+					FlipbookMeta const& fbMeta = flipbookMetaArray[s];
+					HashCombine(key, static_cast<uint64_t>(fbMeta.frameWidth));
+					HashCombine(key, static_cast<uint64_t>(fbMeta.frameHeight));
+					HashCombine(key, static_cast<uint64_t>(fbMeta.frameCount));
+					HashCombine(key, static_cast<uint64_t>(fbMeta.generateMask));
+					HashCombine(key, static_cast<uint64_t>(fbMeta.generateOutline));
+					if (PaletteGroup const* pg = findPaletteGroup(fileNameAndGfxPathAndExt))
+					{
+						for (Palette const& palette : pg->palettes)
+						{
+							HashString(key, palette.name);
+							HashData(key, reinterpret_cast<char const*>(palette.colors.data()), 
+								palette.colors.size() * sizeof(uint32_t));
+						}
+					}
+				}
+				if (imageCache.Load(key, cachedSheetBitmaps[s]))
+				{
+					sheetCache.Release(absoluteFileName, sheetName, options.premultiply);
+					return;
 				}
 			}
-			for (rapidjson::SizeType d = 0; d < petClassDirArray.Size(); d++)
-			{
-				char const*const classDir = petClassDirArray[d].GetString();
-				stringstream ssDir;
-				ssDir << classDir << playerCostumeIndex << "/";
-				gatherFlipbookMeta(ssDir.str(), petFbArray);
-			}
+			shared_ptr<Bitmap const> sheet = sheetCache.Acquire(absoluteFileName, sheetName, options.premultiply);
+			if (!sheet)
+				failed = true;
+			(isVFont ? vFontBitmaps[v] : flipbookBitmaps[s]) = move(sheet);
+		});
+		if (failed)
+		{
+			return EXIT_FAILURE;
+		}
+		if (options.verbose)
+		{
+			log << "DONE!\n";
 		}
-		gatherFlipbookMeta("", fbArray);
-		for(FlipbookMeta const& fbMeta : flipbookMetaArray)
+		// the jobs of sheet s are [sheetFirstJob[s], sheetFirstJob[s + 1]) //
+		vector<size_t> sheetFirstJob(numSheets + 1);
+		for (size_t fbIndex = 0; fbIndex < flipbookMetaArray.size(); fbIndex++)
 		{
+			sheetFirstJob[fbIndex] = frameVariantJobs.size();
+			FlipbookMeta const& fbMeta = flipbookMetaArray[fbIndex];
+			Bitmap const*const bmpFlipbook = flipbookBitmaps[fbIndex].get();
+			if (!bmpFlipbook)
+			{
+				continue;
+			}
 			char const*const fbFileNameAndGfxPathAndExt = 
 				fbMeta.fileNameAndGfxPathAndExt.c_str();
 			int frameW                 = fbMeta.frameWidth;
@@ -551,18 +1643,10 @@ int main(int argc, const char* argv[])
 			const bool generateOutline = fbMeta.generateOutline;
 			string fbFileDir, fbFileName;
 			SplitFileName(fbFileNameAndGfxPathAndExt, &fbFileDir, &fbFileName, nullptr);
-///			if (optVerbose)
+///			if (options.verbose)
 ///			{
 ///				cout << "processing flipbook '" << fbFileName << "'...\n";
 ///			}
-			///loadBitmap(fbFileDir, inputs[0] + "/" + fbFileNameAndGfxPathAndExt, flipbookBitmaps);
-			const string absoluteFileName = inputs[0] + "/" + fbFileNameAndGfxPathAndExt;
-			// specifically do NOT trim the flipbook sprite sheet when we load it in here!
-			//	we will do the trim step on each individual frame instead to save maximum space.
-			flipbookBitmaps.push_back(new Bitmap(
-				absoluteFileName,
-				fbFileDir + GetFileName(absoluteFileName),
-				optPremultiply, false));
 			// if the database has w == h == 0, that means the entire flipbook should just be treated
 			//	as a single frame.
 			if (frameW == 0 || frameH == 0)
@@ -572,15 +1656,15 @@ int main(int argc, const char* argv[])
 					cerr << "ERROR: frame-width & frame-height must BOTH be equal to zero if either "
 						<< "one is zero to signify a degenerate case single-frame flipbook!\n";
 					cerr << "Offending flipbook=" << fbFileNameAndGfxPathAndExt << "\n";
-					exit(EXIT_FAILURE);
+					return EXIT_FAILURE;
 				}
-				frameW = flipbookBitmaps.back()->width;
-				frameH = flipbookBitmaps.back()->height;
+				frameW = bmpFlipbook->width;
+				frameH = bmpFlipbook->height;
 				frameCount = 0;
 			}
 			const int numFrames = (frameCount > 0 ? frameCount :  
-				((flipbookBitmaps.back()->width  / frameW) * 
-				 (flipbookBitmaps.back()->height / frameH)));
+				((bmpFlipbook->width  / frameW) * 
+				 (bmpFlipbook->height / frameH)));
 ///			cout << fbFileDir << "\n";
 ///			cout << (processedFlipbookDir + "/" + fbFileDir) << "\n";
 			// Create a directory to store all the processed flipbook sprites in a temp folder //
@@ -598,136 +1682,114 @@ int main(int argc, const char* argv[])
 					fs::create_directories(processedGfxDir + "/flipbooks/" + fbFileDir + fbFileName + "/outline");
 				}
 			}
-			// iterate over paletteGroups, iterate over each PaletteGroup's textureNames,
-			//	if it contains fbFileNameAndGfxPathAndExt in this PaletteGroup, that means we need
-			//	to also generate palette swaps for each frame in the loop below!
-			// @assumtion
-			//	for any given texture file, it is only located in ONE palette group!
-			PaletteGroup const* flipbookPaletteGroup = nullptr;
-			for (auto const& pg : paletteGroups)
-			{
-				for (string const& texName : pg.textureNames)
-				{
-					if (fbFileNameAndGfxPathAndExt == texName)
-					{
-						flipbookPaletteGroup = &pg;
-						break;
-					}
-				}
-				if (flipbookPaletteGroup)
-				{
-					break;
-				}
-			}
-			const int numColumns = flipbookBitmaps.back()->width / frameW;
+			PaletteGroup const*const flipbookPaletteGroup = 
+				findPaletteGroup(fbFileNameAndGfxPathAndExt);
+			const int numColumns = bmpFlipbook->width / frameW;
 			for (int f = 0; f < numFrames; f++)
 			{
 				const int frameOffsetX = (f % numColumns) * frameW;
 				const int frameOffsetY = (f / numColumns) * frameH;
 				stringstream ssFrameName;
 				ssFrameName << fbFileDir << fbFileName << "/" << f;
-				if (optVerbose)
+				if (options.verbose)
 				{
-					cout << "\t" << ssFrameName.str()<<"\n";
+					log << "\t" << ssFrameName.str()<<"\n";
 				}
-				frameBitmaps.push_back(new Bitmap(flipbookBitmaps.back(),
+				frameSlices.push_back({ bmpFlipbook,
 					frameOffsetX, frameOffsetY, frameW, frameH,
-					ssFrameName.str(),
-					// do not premultiply on the individual frames, since we already 
-					//	did that w/ the entire flipbook texture
-					false, optTrim));
-				bitmaps.push_back(new Bitmap(*frameBitmaps.back()));
+					ssFrameName.str(), frameVariantJobs.size(), 0 });
+				const string debugFrameDir = 
+					processedGfxDir + "/flipbooks/" + fbFileDir + fbFileName + "/";
+				FrameVariantJob frameJob;
+				frameJob.variant = FrameVariant::Frame;
+				frameJob.names.push_back(ssFrameName.str());
 				if (debugProcessedGfx)
 				{
 					stringstream ss;
-					ss << (processedGfxDir + "/flipbooks/" + fbFileDir + fbFileName + "/");
-					ss << f << ".png";
-					frameBitmaps.back()->SaveAs(ss.str());
+					ss << debugFrameDir << f << ".png";
+					frameJob.debugFileNames.push_back(ss.str());
 				}
+				frameVariantJobs.push_back(frameJob);
 				if (generateMask)
 				{
-					bitmaps.push_back(new Bitmap(*frameBitmaps.back()));
+					FrameVariantJob maskJob;
+					maskJob.variant = FrameVariant::Mask;
 					stringstream ssFrameName;
 					ssFrameName << fbFileDir << fbFileName << "/mask/" << f;
-					bitmaps.back()->maskPixels(ssFrameName.str());
+					maskJob.names.push_back(ssFrameName.str());
 					if (debugProcessedGfx)
 					{
 						stringstream ss;
-						ss << (processedGfxDir + "/flipbooks/" + fbFileDir + fbFileName + "/mask/");
-						ss << f << ".png";
-						bitmaps.back()->SaveAs(ss.str());
+						ss << debugFrameDir << "mask/" << f << ".png";
+						maskJob.debugFileNames.push_back(ss.str());
 					}
+					frameVariantJobs.push_back(maskJob);
 				}
 				if (generateOutline)
 				{
-					bitmaps.push_back(new Bitmap(*frameBitmaps.back()));
+					FrameVariantJob outlineJob;
+					outlineJob.variant = FrameVariant::Outline;
 					stringstream ssFrameName;
 					ssFrameName << fbFileDir << fbFileName << "/outline/" << f;
-					bitmaps.back()->outlinePixels(ssFrameName.str());
+					outlineJob.names.push_back(ssFrameName.str());
 					if (debugProcessedGfx)
 					{
 						stringstream ss;
-						ss << (processedGfxDir + "/flipbooks/" + fbFileDir + fbFileName + "/outline/");
-						ss << f << ".png";
-						bitmaps.back()->SaveAs(ss.str());
+						ss << debugFrameDir << "outline/" << f << ".png";
+						outlineJob.debugFileNames.push_back(ss.str());
 					}
+					frameVariantJobs.push_back(outlineJob);
 				}
-				if (flipbookPaletteGroup)
+				if (flipbookPaletteGroup && flipbookPaletteGroup->palettes.size() > 1)
 				{
 					// @assumption
 					//	first palette in a palette group is always the default palette
-					Palette const& defaultPalette = flipbookPaletteGroup->palettes[0];
+					FrameVariantJob paletteJob;
+					paletteJob.variant = FrameVariant::Palette;
+					paletteJob.paletteGroup = flipbookPaletteGroup;
 					for (size_t p = 1; p < flipbookPaletteGroup->palettes.size(); p++)
 					{
 						Palette const& palette = flipbookPaletteGroup->palettes[p];
-						bitmaps.push_back(new Bitmap(*frameBitmaps.back()));
 						stringstream ssFrameName;
 						ssFrameName << fbFileDir << fbFileName << "/"<<
 							palette.name <<"/"<< f;
-						bitmaps.back()->swapPalette(ssFrameName.str(),
-							defaultPalette.colors, palette.colors);
+						paletteJob.names.push_back(ssFrameName.str());
 						if (debugProcessedGfx)
 						{
-							fs::create_directories(processedGfxDir + "/flipbooks/" + 
-								fbFileDir + fbFileName + "/"+ palette.name);
+							fs::create_directories(debugFrameDir + palette.name);
 							stringstream ss;
-							ss << (processedGfxDir + "/flipbooks/" + fbFileDir + fbFileName + "/");
-							ss << palette.name << "/" << f << ".png";
-							bitmaps.back()->SaveAs(ss.str());
+							ss << debugFrameDir << palette.name << "/" << f << ".png";
+							paletteJob.debugFileNames.push_back(ss.str());
 						}
 					}
+					frameVariantJobs.push_back(paletteJob);
 				}
+				frameSlices.back().numVariantJobs = 
+					frameVariantJobs.size() - frameSlices.back().firstVariantJob;
 			}
 		}
 		// Need to process VFonts slightly differently than normal flipbooks,
 		//	because their frame meta data is inconsistent between frames, and 
 		//	it's embedded in the image data. //
-		vector<Bitmap*> vFontBitmaps;
-		auto vFontArray = dGfxMeta["vfonts"].GetArray();
-		for (rapidjson::SizeType v = 0; v < vFontArray.Size(); v++)
+		for (size_t v = 0; v < numVFonts; v++)
 		{
-			auto const& vFont = vFontArray[v];
-			const string vFontFileNameAndGfxPathAndExt = vFont["filename"].GetString();
+			sheetFirstJob[flipbookMetaArray.size() + v] = frameVariantJobs.size();
+			if (!vFontBitmaps[v])
+			{
+				continue;
+			}
+			string const& vFontFileNameAndGfxPathAndExt = sheetFileNames[flipbookMetaArray.size() + v];
 			string vfFileDir, vfFileName;
 			SplitFileName(vFontFileNameAndGfxPathAndExt, &vfFileDir, &vfFileName, nullptr);
-			///			if (optVerbose)
+			///			if (options.verbose)
 			///			{
 			///				cout << "processing flipbook '" << fbFileName << "'...\n";
 			///			}
-						///loadBitmap(fbFileDir, inputs[0] + "/" + fbFileNameAndGfxPathAndExt, flipbookBitmaps);
-			const string absoluteFileName = inputs[0] + "/" + vFontFileNameAndGfxPathAndExt;
 			if (debugProcessedGfx)
 			{
 				fs::create_directories(processedGfxDir + "/flipbooks/" + vfFileDir + vfFileName);
 			}
-			//	load the bitmap //
-			// specifically do NOT trim the flipbook sprite sheet when we load it in here!
-			//	we will do the trim step on each individual frame instead to save maximum space.
-			vFontBitmaps.push_back(new Bitmap(
-				absoluteFileName,
-				vfFileDir + GetFileName(absoluteFileName),
-				optPremultiply, false));
-			Bitmap*const bmpCurrVFont = vFontBitmaps.back();
+			Bitmap const*const bmpCurrVFont = vFontBitmaps[v].get();
 			//	process the character frame metadata & extract each character bitmap //
 			int currVFontCharacterIndex = 0;
 			// First, we need to find the uniform height of all characters in the VFont.
@@ -757,9 +1819,9 @@ int main(int argc, const char* argv[])
 			}
 			const int vFontTextHeight = secondMetaScanlineY - firstMetaScanlineY - 1;
 			assert(vFontTextHeight > 0);
-			if (optVerbose)
+			if (options.verbose)
 			{
-				cout << "vFont '" << vFontFileNameAndGfxPathAndExt << 
+				log << "vFont '" << vFontFileNameAndGfxPathAndExt << 
 					"' vFontTextHeight=" << vFontTextHeight<<"\n";
 			}
 			// for each scanline, we can check if it is a meta scanline by comparing the
@@ -787,27 +1849,27 @@ int main(int argc, const char* argv[])
 						// Extract the next character in the VFont //
 						stringstream ssFrameName;
 						ssFrameName << vfFileDir << vfFileName << "/" << currVFontCharacterIndex;
-						if (optVerbose)
+						if (options.verbose)
 						{
-							cout << "\t" << ssFrameName.str() << "\n";
+							log << "\t" << ssFrameName.str() << "\n";
 						}
-						frameBitmaps.push_back(new Bitmap(vFontBitmaps.back(),
+						frameSlices.push_back({ bmpCurrVFont,
 							prevCharStartX, y + 1, characterWidth, vFontTextHeight,
-							ssFrameName.str(),
-							// do not premultiply on the individual frames, since we already 
-							//	did that w/ the entire flipbook texture
-							false, optTrim));
+							ssFrameName.str(), frameVariantJobs.size(), 1 });
 						prevCharStartX = x;
 						//	add each character to 'bitmaps' using an appropriate filename //
-						bitmaps.push_back(new Bitmap(*frameBitmaps.back()));
+						FrameVariantJob charJob;
+						charJob.variant = FrameVariant::Frame;
+						charJob.names.push_back(ssFrameName.str());
 						if (debugProcessedGfx)
 						{
 							//	debug save the character bitmaps into files //
 							stringstream ss;
 							ss << (processedGfxDir + "/flipbooks/" + vfFileDir + vfFileName + "/");
 							ss << currVFontCharacterIndex << ".png";
-							frameBitmaps.back()->SaveAs(ss.str());
+							charJob.debugFileNames.push_back(ss.str());
 						}
+						frameVariantJobs.push_back(charJob);
 						currVFontCharacterIndex++;
 					}
 					// if the pixel in the meta scanline is solid BLUE,
@@ -819,10 +1881,134 @@ int main(int argc, const char* argv[])
 				}
 			}
 		}
+		sheetFirstJob[numSheets] = frameVariantJobs.size();
+		// slice -> trim -> {frame, mask, outline, palette_1..k} //
+		//	Each sheet's bitmaps, whether cached or not, are kept together in the 
+		//	same order so the cache can't change the atlas. //
+		vector<size_t> sheetFirstBitmap(numSheets + 1);
+		for (size_t s = 0; s < numSheets; s++)
+		{
+			sheetFirstBitmap[s] = bitmaps.size() + numFrameVariantBitmaps;
+			for (size_t j = sheetFirstJob[s]; j < sheetFirstJob[s + 1]; j++)
+			{
+				frameVariantJobs[j].firstBitmap = bitmaps.size() + numFrameVariantBitmaps;
+				numFrameVariantBitmaps += frameVariantJobs[j].names.size();
+			}
+			numFrameVariantBitmaps += cachedSheetBitmaps[s].size();
+		}
+		sheetFirstBitmap[numSheets] = bitmaps.size() + numFrameVariantBitmaps;
+		bitmaps.resize(bitmaps.size() + numFrameVariantBitmaps);
+		threadPool.ParallelFor(frameSlices.size(), [&](size_t f)->void
+		{
+			// the atlas is given up on, so don't pile more errors on the first
+			if (failed)
+			{
+				return;
+			}
+			FrameSlice const& slice = frameSlices[f];
+			unique_ptr<Bitmap> frame = make_unique<Bitmap>(slice.sheet,
+				slice.x, slice.y, slice.width, slice.height,
+				slice.name,
+				// do not premultiply on the individual frames, since we already 
+				//	did that w/ the entire flipbook texture
+				false, options.trim, &pixelArena);
+			threadPool.ParallelFor(slice.numVariantJobs, [&](size_t v)->void
+			{
+				FrameVariantJob const& job = frameVariantJobs[slice.firstVariantJob + v];
+				vector<unique_ptr<Bitmap>> jobBitmaps;
+				if (job.variant == FrameVariant::Palette)
+				{
+					vector<vector<uint32_t> const*> newPalettes;
+					for (size_t p = 1; p < job.paletteGroup->palettes.size(); p++)
+					{
+						newPalettes.push_back(&job.paletteGroup->palettes[p].colors);
+					}
+					if (!frame->swapPalettes(job.paletteGroup->defaultPaletteLookup,
+						newPalettes, job.names, jobBitmaps, &pixelArena))
+					{
+						failed = true;
+						return;
+					}
+				}
+				else if (job.variant == FrameVariant::Frame)
+				{
+					// the other variants still need the frame, so it is only 
+					//	handed over to the atlas once they are all done //
+					if (!job.debugFileNames.empty() && !frame->SaveAs(job.debugFileNames[0]))
+					{
+						failed = true;
+					}
+					return;
+				}
+				else
+				{
+					jobBitmaps.push_back(make_unique<Bitmap>(*frame, &pixelArena));
+					if (job.variant == FrameVariant::Mask)
+					{
+						jobBitmaps.back()->maskPixels(job.names[0]);
+					}
+					else if (job.variant == FrameVariant::Outline)
+					{
+						jobBitmaps.back()->outlinePixels(job.names[0]);
+					}
+				}
+				for (size_t b = 0; b < jobBitmaps.size(); b++)
+				{
+					if (b < job.debugFileNames.size() && !jobBitmaps[b]->SaveAs(job.debugFileNames[b]))
+					{
+						failed = true;
+					}
+					bitmaps[job.firstBitmap + b] = move(jobBitmaps[b]);
+				}
+			});
+			// the frame is a read-only view into its sheet, so it can be packed
+			//	as-is without copying its pixels //
+			FrameVariantJob const& frameJob = frameVariantJobs[slice.firstVariantJob];
+			if (frameJob.variant == FrameVariant::Frame)
+			{
+				bitmaps[frameJob.firstBitmap] = move(frame);
+			}
+		});
+		if (failed)
+		{
+			return EXIT_FAILURE;
+		}
+		// put the cached bitmaps in their place & cache the ones just made //
+		threadPool.ParallelFor(numSheets, [&](size_t s)->void
+		{
+			const bool isVFont = s >= flipbookMetaArray.size();
+			const bool wasDecoded = isVFont ? 
+				vFontBitmaps[s - flipbookMetaArray.size()] != nullptr : flipbookBitmaps[s] != nullptr;
+			if (!wasDecoded)
+			{
+				for (size_t b = 0; b < cachedSheetBitmaps[s].size(); b++)
+				{
+					bitmaps[sheetFirstBitmap[s] + b] = move(cachedSheetBitmaps[s][b]);
+				}
+			}
+			else if (options.cache)
+			{
+				vector<Bitmap const*> sheetBitmaps;
+				for (size_t b = sheetFirstBitmap[s]; b < sheetFirstBitmap[s + 1]; b++)
+				{
+					sheetBitmaps.push_back(bitmaps[b].get());
+				}
+				imageCache.Store(sheetCacheKeys[s], sheetBitmaps);
+			}
+		});
+		if (options.cache)
+		{
+			imageCache.Prune();
+			if (options.verbose)
+			{
+				log << "image cache: " << imageCache.NumHits() << " of " << numSheets << 
+					" sheets loaded from " << outputDir << outputPrefix << ".cache" << endl;
+			}
+		}
 	}
 
 ///    //Load the bitmaps from all the input files and directories
-///    if (optVerbose)
+///    if (options.verbose)
 ///        cout << "loading images..." << endl;
 ///    for (size_t i = 0; i < inputs.size(); ++i)
 ///    {
@@ -833,20 +2019,33 @@ int main(int argc, const char* argv[])
 ///    }
     
     //Sort the bitmaps by area
-    sort(bitmaps.begin(), bitmaps.end(), [](const Bitmap* a, const Bitmap* b) {
+    sort(bitmaps.begin(), bitmaps.end(), [](unique_ptr<Bitmap> const& a, unique_ptr<Bitmap> const& b) {
         return (a->width * a->height) < (b->width * b->height);
     });
     
-    //Pack the bitmaps
+    if (options.benchPackers && !bitmaps.empty())
+        BenchPackers(bitmaps, options, log);
+    
+    //Pack the bitmaps, around last run's placements if possible
+    bool packedIncrementally = false;
+    if (havePreviousPlacements)
+        packedIncrementally = PackIncremental(bitmaps, previousPlacements, packers, options, log);
+    //Otherwise pack them the way that fits best, if asked to look for it
+    PackSettings packing = options.packing;
+    if (options.packEffort && !bitmaps.empty())
+        ChoosePacking(bitmaps, options, threadPool, packing, log);
+    if (options.parallelPages && !bitmaps.empty())
+        PackPagesInParallel(bitmaps, packers, options, packing, threadPool, outputPrefix, log);
     while (!bitmaps.empty())
     {
-        if (optVerbose)
-            cout << "packing " << bitmaps.size() << " images..." << endl;
-        auto packer = new Packer(optSize, optSize, optPadding);
-        packer->Pack(bitmaps, optVerbose, optUnique, optRotate);
-        packers.push_back(packer);
-        if (optVerbose)
-            cout << "finished packing: " << outputPrefix << to_string(packers.size() - 1) << " (" << packer->width << " x " << packer->height << ')' << endl;
+        if (options.verbose)
+            log << "packing " << bitmaps.size() << " images..." << endl;
+        packers.push_back(make_unique<Packer>(options.size, options.size, options.padding, packing));
+        Packer*const packer = packers.back().get();
+        packer->Pack(bitmaps, options.verbose ? &log : nullptr, options.unique, options.rotate);
+        if (options.verbose)
+            log << "finished packing: " << outputPrefix << to_string(packers.size() - 1) << " (" << packer->width << " x " << packer->height << 
+                ", occupancy " << packer->Occupancy() << ')' << endl;
     
         if (packer->bitmaps.empty())
         {
@@ -854,46 +2053,117 @@ int main(int argc, const char* argv[])
             return EXIT_FAILURE;
         }
     }
+    //Then look for smaller page sizes than halving found, unless the pages 
+    //	were packed around the previous run's placements
+    if (options.sizeSearch && !packedIncrementally)
+    {
+        for (size_t i = 0; i < packers.size(); ++i)
+        {
+            if (!SearchPageSize(packers[i], options, packing, threadPool, outputPrefix + to_string(i), log))
+                return EXIT_FAILURE;
+        }
+    }
+    if (options.verbose && !packers.empty())
+    {
+        size_t usedArea = 0;
+        size_t pageArea = 0;
+        for (unique_ptr<Packer> const& packer : packers)
+        {
+            usedArea += packer->UsedArea();
+            pageArea += static_cast<size_t>(packer->width) * packer->height;
+        }
+        log << "packed " << packers.size() << " pages w/ " << PackSettingsName(packing) << 
+            ", occupancy " << static_cast<float>(usedArea) / pageArea << endl;
+    }
     
-    //Save the atlas image
+    //Save the atlas images, encoding the pages at the same time.  The threads
+    //	left over are used to compress bands of each page in parallel, so that 
+    //	even a single page atlas keeps every core busy.
+    //	Pages whose contents & encoding settings hash the same as last run's
+    //	already have the right png on disk, so they aren't encoded again.
+    uint64_t pageHashSeed = 0;
+    HashCombine(pageHashSeed, static_cast<uint64_t>(options.pngLevel));
+    HashCombine(pageHashSeed, static_cast<uint64_t>(options.zlib));
+    vector<uint64_t> pageHashes(packers.size());
+    vector<char> pageUnchanged(packers.size(), 0);
     for (size_t i = 0; i < packers.size(); ++i)
     {
-        if (optVerbose)
-            cout << "writing png: " << outputDir << outputPrefix << to_string(i) << ".png" << endl;
-        packers[i]->SavePng(outputDir + outputPrefix + to_string(i) + ".png");
+        pageHashes[i] = packers[i]->ContentHash(pageHashSeed);
+        pageUnchanged[i] = havePreviousPlacements && i < previousPlacements.pageHashes.size() &&
+            previousPlacements.pageHashes[i] == pageHashes[i] &&
+            fs::exists(outputDir + outputPrefix + to_string(i) + ".png");
+    }
+    if (options.verbose)
+    {
+        for (size_t i = 0; i < packers.size(); ++i)
+            log << (pageUnchanged[i] ? "unchanged png: " : "writing png: ") << 
+                outputDir << outputPrefix << to_string(i) << ".png" << endl;
+    }
+    if (havePreviousPlacements)
+    {
+        for (size_t i = packers.size(); i < 16; ++i)
+            RemoveFile(outputDir + outputPrefix + to_string(i) + ".png");
+    }
+    PngWriteSettings pngSettings(options.pngLevel);
+    pngSettings.threadPool = &threadPool;
+    pngSettings.maxParallelBands = (threadPool.NumThreads() + static_cast<int>(packers.size()) - 1) / 
+        max(1, static_cast<int>(packers.size()));
+    vector<double> pngSeconds(packers.size());
+    threadPool.ParallelFor(packers.size(), [&](size_t i)->void
+    {
+        const auto start = chrono::steady_clock::now();
+        if (!pageUnchanged[i] && !packers[i]->SavePng(outputDir + outputPrefix + to_string(i) + ".png", pngSettings))
+            failed = true;
+        packers[i]->ReleasePixels();
+        pngSeconds[i] = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    });
+    if (failed)
+        return EXIT_FAILURE;
+    if (options.verbose)
+    {
+        for (size_t i = 0; i < packers.size(); ++i)
+        {
+            if (pageUnchanged[i])
+                continue;
+            const string file = outputDir + outputPrefix + to_string(i) + ".png";
+            log << "wrote png: " << file << " (--png-level " << PngLevelName(options.pngLevel) << "): " << 
+                fs::file_size(file) << " bytes in " << pngSeconds[i] << "s" << endl;
+        }
     }
+    for (size_t i = 0; i < packers.size(); ++i)
+        outPngFiles.push_back(outputDir + outputPrefix + to_string(i) + ".png");
     
     //Save the atlas binary
-    if (optBinary)
+    if (options.binary)
     {
-        if (optVerbose)
-            cout << "writing bin: " << outputDir << outputPrefix << ".bin" << endl;
+        if (options.verbose)
+            log << "writing bin: " << outputDir << outputPrefix << ".bin" << endl;
         
         ofstream bin(outputDir + outputPrefix + ".bin", ios::binary);
         WriteShort(bin, (int16_t)packers.size());
         for (size_t i = 0; i < packers.size(); ++i)
-            packers[i]->SaveBin(outputPrefix + to_string(i), bin, optTrim, optRotate);
+            packers[i]->SaveBin(outputPrefix + to_string(i), bin, options.trim, options.rotate);
         bin.close();
     }
     
     //Save the atlas xml
-    if (optXml)
+    if (options.xml)
     {
-        if (optVerbose)
-            cout << "writing xml: " << outputDir << outputPrefix << ".xml" << endl;
+        if (options.verbose)
+            log << "writing xml: " << outputDir << outputPrefix << ".xml" << endl;
         
         ofstream xml(outputDir + outputPrefix + ".xml");
         xml << "<atlas>" << endl;
         for (size_t i = 0; i < packers.size(); ++i)
-            packers[i]->SaveXml(outputPrefix + to_string(i), xml, optTrim, optRotate);
+            packers[i]->SaveXml(outputPrefix + to_string(i), xml, options.trim, options.rotate);
         xml << "</atlas>";
     }
     
     //Save the atlas json
-    if (optJson)
+    if (options.json)
     {
-        if (optVerbose)
-            cout << "writing json: " << outputDir << outputPrefix << ".json" << endl;
+        if (options.verbose)
+            log << "writing json: " << outputDir << outputPrefix << ".json" << endl;
         
         ofstream json(outputDir + outputPrefix + ".json");
         json << '{' << endl;
@@ -901,7 +2171,7 @@ int main(int argc, const char* argv[])
         for (size_t i = 0; i < packers.size(); ++i)
         {
             json << "\t\t{" << endl;
-            packers[i]->SaveJson(outputPrefix + to_string(i), json, optTrim, optRotate);
+            packers[i]->SaveJson(outputPrefix + to_string(i), json, options.trim, options.rotate);
             json << "\t\t}";
             if (i + 1 < packers.size())
                 json << ',';
@@ -911,8 +2181,246 @@ int main(int argc, const char* argv[])
         json << '}';
     }
     
+    //Save where everything was packed, for the next incremental run
+    if (options.incremental)
+    {
+        AtlasPlacements placements;
+        placements.size = options.size;
+        placements.pad = options.padding;
+        placements.unique = options.unique;
+        placements.rotate = options.rotate;
+        placements.pageHashes = pageHashes;
+        size_t usedArea = 0;
+        size_t pageArea = 0;
+        for (size_t i = 0; i < packers.size(); ++i)
+        {
+            Packer const& packer = *packers[i];
+            for (size_t b = 0; b < packer.bitmaps.size(); ++b)
+            {
+                placements.placements[packer.bitmaps[b]->name] = { static_cast<int>(i), 
+                    packer.points[b].x, packer.points[b].y, 
+                    packer.bitmaps[b]->width, packer.bitmaps[b]->height, packer.points[b].rot };
+            }
+            usedArea += packer.UsedArea();
+            pageArea += static_cast<size_t>(packer.width) * packer.height;
+        }
+        placements.fullPackOccupancy = packedIncrementally ? previousPlacements.fullPackOccupancy :
+            (pageArea > 0 ? static_cast<float>(usedArea) / pageArea : 0.0f);
+        SavePlacements(placementsFile, placements);
+    }
+    
     //Save the new hash
     SaveHash(newHash, outputDir + outputPrefix + ".hash");
+    manifest.Save(manifestFile);
     
+    if (options.verbose)
+    {
+        log << "pixel buffers: " << pixelArena.NumAllocations() << " from the arena (" << 
+            pixelArena.NumChunks() << " chunks, at most " << pixelArena.PeakBytesReserved() / (1024 * 1024) << 
+            " MiB at once)" << endl;
+    }
     return EXIT_SUCCESS;
 }
+// Reads a batch file (see the usage notes) into one job per atlas, with 
+//	commandLineArgs applied to each atlas ahead of its own options. //
+static bool LoadBatch(const string& file, vector<string> const& commandLineArgs, vector<AtlasJob>& outJobs)
+{
+	rapidjson::Document dBatch;
+	if (!ParseJsonFile(file, "batch", dBatch))
+	{
+		return false;
+	}
+	if (!dBatch.IsObject() || !dBatch.HasMember("atlases") || !dBatch["atlases"].IsArray())
+	{
+		cerr << "batch file has no \"atlases\" array: " << file << endl;
+		return false;
+	}
+	auto atlasArray = dBatch["atlases"].GetArray();
+	for (rapidjson::SizeType a = 0; a < atlasArray.Size(); a++)
+	{
+		auto const& atlas = atlasArray[a];
+		for (char const* member : { "output", "inputs", "gfx-meta", "palettes" })
+		{
+			if (!atlas.IsObject() || !atlas.HasMember(member) || !atlas[member].IsString())
+			{
+				cerr << "atlas " << a << " of batch file '" << file << "' is missing its \"" << member << "\" string" << endl;
+				return false;
+			}
+		}
+		AtlasJob job;
+		job.output = atlas["output"].GetString();
+		job.inputs = SplitInputs(atlas["inputs"].GetString());
+		job.gfxMetaJsonFileName = atlas["gfx-meta"].GetString();
+		job.palettesJsonFileName = atlas["palettes"].GetString();
+		vector<string> args = commandLineArgs;
+		if (atlas.HasMember("options"))
+		{
+			if (!atlas["options"].IsArray())
+			{
+				cerr << "the options of atlas " << job.output << " must be an array of strings" << endl;
+				return false;
+			}
+			for (auto const& option : atlas["options"].GetArray())
+			{
+				if (!option.IsString())
+				{
+					cerr << "the options of atlas " << job.output << " must be an array of strings" << endl;
+					return false;
+				}
+				const string arg = option.GetString();
+				// there's only one thread pool & zlib backend for the whole run
+				if (arg.find("--jobs") == 0 || arg.find("--zlib") == 0)
+				{
+					cerr << arg << " can only be given on the command line of a batch" << endl;
+					return false;
+				}
+				args.push_back(arg);
+			}
+		}
+		if (!ParseOptions(args, job.options))
+		{
+			return false;
+		}
+		for (AtlasJob const& other : outJobs)
+		{
+			if (other.output == job.output)
+			{
+				cerr << "atlas is in the batch more than once: " << job.output << endl;
+				return false;
+			}
+		}
+		outJobs.push_back(job);
+	}
+	return true;
+}
+int main(int argc, const char* argv[])
+{
+    if (argc == 2 && string(argv[1]) == "--self-test")
+        return SimdSelfTest() ? EXIT_SUCCESS : EXIT_FAILURE;
+///    //Print out passed arguments
+///    for (int i = 0; i < argc; ++i)
+///        cout << argv[i] << ' ';
+///    cout << "\n";
+    
+    // the options that apply to the whole run (--jobs & --zlib) come from the 
+    //	command line, even in a batch
+    vector<AtlasJob> jobs;
+    AtlasOptions runOptions;
+    if (argc >= 3 && string(argv[1]) == "--batch")
+    {
+        const vector<string> args(argv + 3, argv + argc);
+        if (!ParseOptions(args, runOptions) || !LoadBatch(argv[2], args, jobs))
+            return EXIT_FAILURE;
+    }
+    else
+    {
+        if (argc < 5)
+        {
+            cerr << "invalid input, expected: \"crunch [OUTPUT PREFIX] [INPUT GFX DIRECTORY] \\
+[VAGANTE GFX META JSON FILE] [VAGANTE PALETTE JSON FILE] [OPTIONS...]\"\n";
+            cerr << "or: \"crunch --batch [BATCH JSON FILE] [OPTIONS...]\"\n";
+            cerr << "Usage notes: use Unix-style file paths, NOT windows style.\n";
+            cerr << "eg. 'C:/git/path-to-stuff' instead of 'C:\\git\\path-to-stuff'.\n";
+            cerr << "Multiple input directories can be supplied by separating them with commas.\n";
+            return EXIT_FAILURE;
+        }
+        AtlasJob job;
+        job.output = argv[1];
+        job.inputs = SplitInputs(argv[2]);
+        job.gfxMetaJsonFileName = argv[3];
+        job.palettesJsonFileName = argv[4];
+        if (!ParseOptions(vector<string>(argv + 5, argv + argc), job.options))
+            return EXIT_FAILURE;
+        runOptions = job.options;
+        jobs.push_back(job);
+    }
+    
+    //Parse each json file once, however many atlases use it
+    map<string, GfxMeta> gfxMetas;
+    map<string, vector<PaletteGroup>> paletteGroups;
+    for (AtlasJob& job : jobs)
+    {
+        auto gfxMeta = gfxMetas.find(job.gfxMetaJsonFileName);
+        if (gfxMeta == gfxMetas.end())
+        {
+            gfxMeta = gfxMetas.emplace(job.gfxMetaJsonFileName, GfxMeta()).first;
+            if (!LoadGfxMeta(job.gfxMetaJsonFileName, job.options.verbose, gfxMeta->second))
+                return EXIT_FAILURE;
+        }
+        job.gfxMeta = &gfxMeta->second;
+        auto palettes = paletteGroups.find(job.palettesJsonFileName);
+        if (palettes == paletteGroups.end())
+        {
+            palettes = paletteGroups.emplace(job.palettesJsonFileName, vector<PaletteGroup>()).first;
+            if (!LoadPaletteGroups(job.palettesJsonFileName, job.options.verbose, palettes->second))
+                return EXIT_FAILURE;
+        }
+        job.paletteGroups = &palettes->second;
+    }
+    
+    //Build all the atlases at once, on the one thread pool
+	SetZlibBackend(runOptions.zlib);
+	ThreadPool threadPool(runOptions.jobs);
+	SheetCache sheetCache;
+	for (AtlasJob const& job : jobs)
+	{
+		for (size_t s = 0; s < job.gfxMeta->sheetFileNames.size(); s++)
+		{
+			string sheetFile, sheetName;
+			GetSheetFile(job, s, sheetFile, sheetName);
+			sheetCache.Expect(sheetFile, sheetName, job.options.premultiply);
+		}
+	}
+	vector<int> results(jobs.size(), EXIT_SUCCESS);
+	vector<vector<string>> pngFiles(jobs.size());
+	mutex logMutex;
+	threadPool.ParallelFor(jobs.size(), [&](size_t j)->void
+	{
+		// A batch's atlases are built at the same time, so each one's output 
+		//	is held back until it's done, to keep it in one piece.  A single 
+		//	atlas prints as it goes. //
+		ostringstream buffer;
+		ostream& log = jobs.size() > 1 ? buffer : cout;
+		// one atlas failing, even on something unexpected, doesn't stop the others
+		try
+		{
+			results[j] = BuildAtlas(jobs[j], sheetCache, threadPool, pngFiles[j], log);
+		}
+		catch (exception const& e)
+		{
+			cerr << "failed to build atlas " << jobs[j].output << ": " << e.what() << endl;
+			results[j] = EXIT_FAILURE;
+		}
+		if (jobs.size() > 1)
+		{
+			lock_guard<mutex> lock(logMutex);
+			cout << buffer.str() << flush;
+		}
+	});
+    
+    //Benchmarks run once nothing else is encoding, since they switch backends
+	int result = EXIT_SUCCESS;
+	bool verbose = false;
+	for (size_t j = 0; j < jobs.size(); j++)
+	{
+		if (results[j] != EXIT_SUCCESS)
+		{
+			result = EXIT_FAILURE;
+		}
+		else if (jobs[j].options.benchZlib && !pngFiles[j].empty())
+		{
+			BenchZlibBackends(pngFiles[j], jobs[j].options.pngLevel);
+		}
+		verbose = verbose || jobs[j].options.verbose;
+	}
+    if (verbose)
+    {
+        if (jobs.size() > 1)
+            cout << "sheets: " << sheetCache.NumDecoded() << " decoded, " << sheetCache.NumShared() << 
+                " shared between " << jobs.size() << " atlases" << endl;
+        cout << "pixel buffers: " << GetNumHeapPixelBuffers() << " from the heap" << endl;
+        cout << "peak memory usage: " << GetPeakMemoryUsage() / (1024 * 1024) << " MiB" << endl;
+    }
+    
+    return result;
+}
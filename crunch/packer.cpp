@@ -25,81 +25,201 @@
  */
 
 #include "packer.hpp"
-#include "MaxRectsBinPack.h"
-#include "GuillotineBinPack.h"
 #include "binary.hpp"
+#include "hash.hpp"
 #include <iostream>
 #include <algorithm>
 
 using namespace std;
 using namespace rbp;
 
-Packer::Packer(int width, int height, int pad)
-: width(width), height(height), pad(pad)
+Packer::Packer(int width, int height, int pad, PackSettings const& settings)
+: width(width), height(height), pad(pad), settings(settings), binPack(MakeBinPacker(settings))
 {
-    
+    binPack->Init(width - pad, height - pad);
 }
 
-void Packer::Pack(vector<Bitmap*>& bitmaps, bool verbose, bool unique, bool rotate)
+void Packer::Pack(vector<unique_ptr<Bitmap>>& bitmaps, ostream* log, bool unique, bool rotate)
 {
 	//	@anti-texture-bleeding
 	// subtract "pad" from the packer range, so that we can have pixels around the outside edge of the
 	//	texture's contents that can be filled with anti-texture-bleeding data if desired~
-    MaxRectsBinPack packer(width - pad, height - pad);
+    binPack->Init(width - pad, height - pad);
+    
+    if (settings.globalFit)
+    {
+        PackGlobal(bitmaps, log, unique, rotate);
+        ShrinkToFit();
+        return;
+    }
     
-    int ww = 0;
-    int hh = 0;
     while (!bitmaps.empty())
     {
-        auto bitmap = bitmaps.back();
-        
-        if (verbose)
-            cout << '\t' << bitmaps.size() << ": " << bitmap->name << endl;
+        if (log)
+            *log << '\t' << bitmaps.size() << ": " << bitmaps.back()->name << endl;
         
-        //Check to see if this is a duplicate of an already packed bitmap
-        if (unique)
-        {
-            auto di = dupLookup.find(bitmap->hashValue);
-            if (di != dupLookup.end() && bitmap->Equals(this->bitmaps[di->second]))
-            {
-                Point p = points[di->second];
-                p.dupID = di->second;
-                points.push_back(p);
-                this->bitmaps.push_back(bitmap);
-                bitmaps.pop_back();
-                continue;
-            }
-        }
+        if (!Insert(bitmaps.back(), unique, rotate))
+            break;
+        bitmaps.pop_back();
+    }
+    
+    ShrinkToFit();
+}
+
+bool Packer::Insert(unique_ptr<Bitmap>& bitmap, bool unique, bool rotate)
+{
+    //Check to see if this is a duplicate of an already packed bitmap
+    if (unique && InsertDuplicate(bitmap))
+        return true;
+    
+    //If it's not a duplicate, pack it into the atlas
+    Rect rect = binPack->Insert(bitmap->width + pad, bitmap->height + pad, rotate);
+    if (rect.width == 0 || rect.height == 0)
+        return false;
+    
+    Place(bitmap, rect, unique, rotate);
+    return true;
+}
+
+void Packer::Place(unique_ptr<Bitmap>& bitmap, Rect rect, bool unique, bool rotate)
+{
+	//	@anti-texture-bleeding
+	// offset the resulting rect by half of the pad size so that the left & top edges
+	//	of the atlas texture are padded with empty pixels.
+	rect.x += pad / 2;
+	rect.y += pad / 2;
+    
+    if (unique)
+        dupLookup[bitmap->hashValue] = static_cast<int>(points.size());
+    
+    //Check if we rotated it
+    Point p;
+    p.x = rect.x;
+    p.y = rect.y;
+    p.dupID = -1;
+    p.rot = rotate && bitmap->width != (rect.width - pad);
+    
+    points.push_back(p);
+    this->bitmaps.push_back(move(bitmap));
+}
+
+bool Packer::InsertDuplicate(unique_ptr<Bitmap>& bitmap)
+{
+    auto di = dupLookup.find(bitmap->hashValue);
+    if (di == dupLookup.end() || !bitmap->Equals(this->bitmaps[di->second].get()))
+        return false;
+    Point p = points[di->second];
+    p.dupID = di->second;
+    points.push_back(p);
+    this->bitmaps.push_back(move(bitmap));
+    return true;
+}
+
+bool Packer::Keep(unique_ptr<Bitmap>& bitmap, Placement const& placement, bool unique)
+{
+    if (unique && InsertDuplicate(bitmap))
+        return true;
+    
+	//	@anti-texture-bleeding
+	// undo the half pad offset that Insert gives every rect
+    Rect rect;
+    rect.x = placement.x - pad / 2;
+    rect.y = placement.y - pad / 2;
+    rect.width = (placement.rot ? bitmap->height : bitmap->width) + pad;
+    rect.height = (placement.rot ? bitmap->width : bitmap->height) + pad;
+    if (!binPack->Occupy(rect))
+        return false;
+    
+    if (unique)
+        dupLookup[bitmap->hashValue] = static_cast<int>(points.size());
+    
+    Point p;
+    p.x = placement.x;
+    p.y = placement.y;
+    p.dupID = -1;
+    p.rot = placement.rot;
+    points.push_back(p);
+    this->bitmaps.push_back(move(bitmap));
+    return true;
+}
+
+void Packer::PackAround(vector<unique_ptr<Bitmap>>& bitmaps, ostream* log, bool unique, bool rotate)
+{
+    vector<unique_ptr<Bitmap>> leftovers;
+    for (size_t i = bitmaps.size(); i-- > 0;)
+    {
+        if (log)
+            *log << '\t' << i + 1 << ": " << bitmaps[i]->name << endl;
         
-        //If it's not a duplicate, pack it into the atlas
-        {
-            Rect rect = packer.Insert(bitmap->width + pad, bitmap->height + pad, 
-				rotate, MaxRectsBinPack::RectBestShortSideFit);
-			//	@anti-texture-bleeding
-			// offset the resulting rect by half of the pad size so that the left & top edges
-			//	of the atlas texture are padded with empty pixels.
-			rect.x += pad / 2;
-			rect.y += pad / 2;
-            if (rect.width == 0 || rect.height == 0)
-                break;
-            
-            if (unique)
-                dupLookup[bitmap->hashValue] = static_cast<int>(points.size());
-            
-            //Check if we rotated it
-            Point p;
-            p.x = rect.x;
-            p.y = rect.y;
-            p.dupID = -1;
-            p.rot = rotate && bitmap->width != (rect.width - pad);
-            
-            points.push_back(p);
-            this->bitmaps.push_back(bitmap);
-            bitmaps.pop_back();
-            
-            ww = max(rect.x + rect.width, ww);
-            hh = max(rect.y + rect.height, hh);
-        }
+        if (!Insert(bitmaps[i], unique, rotate))
+            leftovers.push_back(move(bitmaps[i]));
+    }
+    reverse(leftovers.begin(), leftovers.end());
+    bitmaps = move(leftovers);
+}
+
+void Packer::PackGlobal(vector<unique_ptr<Bitmap>>& bitmaps, ostream* log, bool unique, bool rotate)
+{
+	// Duplicates share the rect of the first copy (going back to front, like
+	//	Pack does), so only that one is handed to the bin packer. //
+	vector<RectSize> sizes;
+	vector<size_t> sizeBitmaps;
+	vector<size_t> rectOf(bitmaps.size());
+	unordered_map<uint64_t, size_t> firstOfHash;
+	for (size_t i = bitmaps.size(); i-- > 0;)
+	{
+		if (unique)
+		{
+			auto found = firstOfHash.find(bitmaps[i]->hashValue);
+			if (found != firstOfHash.end() && bitmaps[i]->Equals(bitmaps[found->second].get()))
+			{
+				rectOf[i] = rectOf[found->second];
+				continue;
+			}
+			if (found == firstOfHash.end())
+				firstOfHash.emplace(bitmaps[i]->hashValue, i);
+		}
+		rectOf[i] = sizes.size();
+		sizes.push_back({ bitmaps[i]->width + pad, bitmaps[i]->height + pad });
+		sizeBitmaps.push_back(i);
+	}
+	
+	vector<Rect> rects;
+	binPack->Insert(sizes, rects, rotate);
+	
+	vector<unique_ptr<Bitmap>> leftovers;
+	for (size_t i = bitmaps.size(); i-- > 0;)
+	{
+		Rect const& rect = rects[rectOf[i]];
+		if (rect.width == 0 || rect.height == 0)
+		{
+			leftovers.push_back(move(bitmaps[i]));
+			continue;
+		}
+		if (log)
+			*log << '\t' << i + 1 << ": " << bitmaps[i]->name << endl;
+		if (sizeBitmaps[rectOf[i]] == i)
+			Place(bitmaps[i], rect, unique, rotate);
+		else if (!InsertDuplicate(bitmaps[i]))
+			leftovers.push_back(move(bitmaps[i]));
+	}
+	reverse(leftovers.begin(), leftovers.end());
+	bitmaps = move(leftovers);
+}
+
+void Packer::ShrinkToFit()
+{
+    // an empty page (nothing fit) stays 1 x 1 instead of halving forever
+    int ww = 1;
+    int hh = 1;
+    for (size_t i = 0, j = bitmaps.size(); i < j; ++i)
+    {
+        if (points[i].dupID >= 0)
+            continue;
+        const int packedWidth = points[i].rot ? bitmaps[i]->height : bitmaps[i]->width;
+        const int packedHeight = points[i].rot ? bitmaps[i]->width : bitmaps[i]->height;
+        ww = max(points[i].x + packedWidth + pad, ww);
+        hh = max(points[i].y + packedHeight + pad, hh);
     }
     
     while (width / 2 >= ww)
@@ -108,25 +228,86 @@ void Packer::Pack(vector<Bitmap*>& bitmaps, bool verbose, bool unique, bool rota
         height /= 2;
 }
 
-void Packer::SavePng(const string& file)
+size_t Packer::UsedArea() const
 {
-    Bitmap bitmap(width, height);
+    size_t area = 0;
     for (size_t i = 0, j = bitmaps.size(); i < j; ++i)
-    {
         if (points[i].dupID < 0)
-        {
+            area += static_cast<size_t>(bitmaps[i]->width) * bitmaps[i]->height;
+    return area;
+}
+
+float Packer::Occupancy() const
+{
+    return static_cast<float>(UsedArea()) / (static_cast<size_t>(width) * height);
+}
+
+uint64_t Packer::ContentHash(uint64_t seed) const
+{
+    // the bitmaps are hashed in an order that doesn't depend on how they were packed
+    vector<uint64_t> bitmapHashes;
+    for (size_t i = 0, j = bitmaps.size(); i < j; ++i)
+    {
+        if (points[i].dupID >= 0)
+            continue;
+        uint64_t hash = bitmaps[i]->hashValue;
+        HashCombine(hash, static_cast<uint64_t>(bitmaps[i]->width));
+        HashCombine(hash, static_cast<uint64_t>(bitmaps[i]->height));
+        HashCombine(hash, static_cast<uint64_t>(points[i].x));
+        HashCombine(hash, static_cast<uint64_t>(points[i].y));
+        HashCombine(hash, static_cast<uint64_t>(points[i].rot));
+        bitmapHashes.push_back(hash);
+    }
+    sort(bitmapHashes.begin(), bitmapHashes.end());
+    uint64_t hash = seed;
+    HashCombine(hash, static_cast<uint64_t>(width));
+    HashCombine(hash, static_cast<uint64_t>(height));
+    HashCombine(hash, static_cast<uint64_t>(pad));
+    for (uint64_t bitmapHash : bitmapHashes)
+        HashCombine(hash, bitmapHash);
+    return hash;
+}
+
+bool Packer::SavePng(const string& file, PngWriteSettings settings)
+{
+	// The page is composed one band of rows at a time, right as the encoder 
+	//	asks for them, so the full page never has to be held in memory. //
+	settings.bandHeight = max(1, min(height, (1 << 20) / (4 * width)));
+    Bitmap band(width, settings.bandHeight);
+	auto composeRows = [&](int y, int numRows)->uint32_t const*
+	{
+		fill(band.data, band.data + static_cast<size_t>(width) * numRows, 0);
+		for (size_t i = 0, j = bitmaps.size(); i < j; ++i)
+		{
+			if (points[i].dupID >= 0)
+				continue;
+			const int packedHeight = points[i].rot ? bitmaps[i]->width : bitmaps[i]->height;
+			if (points[i].y + packedHeight + pad / 2 <= y || points[i].y - pad / 2 >= y + numRows)
+				continue;
 			//	@anti-texture-bleeding 
 			// Here, when copying pixels we tell the Bitmaps to duplicate all the
 			//	pixels along the edge so that we can fill the gutters between the
 			//	UV shells of each individual frame.
 			// See http://wiki.polycount.com/wiki/Edge_padding for more info on this issue
             if (points[i].rot)
-                bitmap.CopyPixelsRot(bitmaps[i], points[i].x, points[i].y, pad/2);
+                band.CopyPixelsRot(bitmaps[i].get(), points[i].x, points[i].y - y, pad/2);
             else
-                bitmap.CopyPixels   (bitmaps[i], points[i].x, points[i].y, pad/2);
-        }
+                band.CopyPixels   (bitmaps[i].get(), points[i].x, points[i].y - y, pad/2);
+		}
+		return band.data;
+	};
+    if (!SavePngStreamed(file, width, height, composeRows, settings))
+    {
+        cout << "failed to save png: " << file << endl;
+        return false;
     }
-    bitmap.SaveAs(file);
+    return true;
+}
+
+void Packer::ReleasePixels()
+{
+    for (auto& bitmap : bitmaps)
+        bitmap->releasePixels();
 }
 
 void Packer::SaveXml(const string& name, ofstream& xml, bool trim, bool rotate)
@@ -204,3 +385,58 @@ void Packer::SaveJson(const string& name, ofstream& json, bool trim, bool rotate
     }
     json << "\t\t\t]" << endl;
 }
+
+// The placements file is plain text: a version line, the settings line, 
+//	the page hashes, then one line per bitmap with its name last so that 
+//	names may contain spaces. //
+static const char* PLACEMENTS_HEADER = "crunch-placements 1";
+
+bool LoadPlacements(const string& file, AtlasPlacements& outPlacements)
+{
+    ifstream in(file);
+    string line;
+    if (!getline(in, line) || line != PLACEMENTS_HEADER)
+        return false;
+    size_t numPages = 0;
+    if (!(in >> outPlacements.size >> outPlacements.pad >> outPlacements.unique >> 
+        outPlacements.rotate >> outPlacements.fullPackOccupancy >> numPages))
+        return false;
+    outPlacements.pageHashes.resize(numPages);
+    for (uint64_t& pageHash : outPlacements.pageHashes)
+        if (!(in >> pageHash))
+            return false;
+    outPlacements.placements.clear();
+    Placement placement;
+    while (in >> placement.page >> placement.x >> placement.y >> 
+        placement.width >> placement.height >> placement.rot)
+    {
+        string name;
+        in.get();
+        if (!getline(in, name) || placement.page < 0 || static_cast<size_t>(placement.page) >= numPages)
+            return false;
+        outPlacements.placements.emplace(name, placement);
+    }
+    return in.eof();
+}
+
+void SavePlacements(const string& file, AtlasPlacements const& placements)
+{
+    ofstream out(file);
+    out << PLACEMENTS_HEADER << '\n';
+    out << placements.size << ' ' << placements.pad << ' ' << placements.unique << ' ' << 
+        placements.rotate << ' ' << placements.fullPackOccupancy << ' ' << 
+        placements.pageHashes.size() << '\n';
+    for (uint64_t pageHash : placements.pageHashes)
+        out << pageHash << '\n';
+    // sorted so the file doesn't change between identical runs
+    vector<pair<string, Placement>> sorted(placements.placements.begin(), placements.placements.end());
+    sort(sorted.begin(), sorted.end(), [](pair<string, Placement> const& a, pair<string, Placement> const& b) {
+        return a.first < b.first;
+    });
+    for (auto const& named : sorted)
+    {
+        Placement const& p = named.second;
+        out << p.page << ' ' << p.x << ' ' << p.y << ' ' << p.width << ' ' << p.height << ' ' << 
+            p.rot << ' ' << named.first << '\n';
+    }
+}
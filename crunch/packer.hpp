@@ -30,7 +30,10 @@
 #include <vector>
 #include <fstream>
 #include <unordered_map>
+#include <memory>
 #include "bitmap.hpp"
+#include "pngwriter.hpp"
+#include "binpacker.hpp"
 
 using namespace std;
 
@@ -42,22 +45,86 @@ struct Point
     bool rot;
 };
 
+// Where a bitmap ended up in the previous run, as read back from the 
+//	.placements file written next to the atlas. //
+struct Placement
+{
+    int page;
+    int x;
+    int y;
+    int width;
+    int height;
+    bool rot;
+};
+
+// Everything an incremental run needs to know about the previous one
+struct AtlasPlacements
+{
+    // placements only carry over if these are unchanged
+    int size;
+    int pad;
+    bool unique;
+    bool rotate;
+    // the ratio of sprite area to page area of the last full repack, which 
+    //	incremental runs are measured against
+    float fullPackOccupancy;
+    vector<uint64_t> pageHashes;
+    unordered_map<string, Placement> placements;
+};
+
 struct Packer
 {
     int width;
     int height;
     int pad;
     
-    vector<Bitmap*> bitmaps;
+    vector<unique_ptr<Bitmap>> bitmaps;
     vector<Point> points;
-    unordered_map<size_t, int> dupLookup;
+    unordered_map<uint64_t, int> dupLookup;
+    PackSettings settings;
+    // made from settings
+    unique_ptr<BinPacker> binPack;
     
-    Packer(int width, int height, int pad);
-    void Pack(vector<Bitmap*>& bitmaps, bool verbose, bool unique, bool rotate);
-    void SavePng(const string& file);
+    Packer(int width, int height, int pad, PackSettings const& settings = PackSettings());
+    // each bitmap is printed to log as it's packed, if there is a log
+    void Pack(vector<unique_ptr<Bitmap>>& bitmaps, ostream* log, bool unique, bool rotate);
+    // Puts the bitmap back where the previous run packed it.  Returns false 
+    //	(leaving bitmap alone) if that spot isn't free in this page, or the 
+    //	engine can't pack around bitmaps that are already there (only 
+    //	maxrects can). //
+    bool Keep(unique_ptr<Bitmap>& bitmap, Placement const& placement, bool unique);
+    // Like Pack, but packs around the bitmaps already in the page & skips the
+    //	bitmaps that don't fit instead of stopping at the first one.  Those are
+    //	left in bitmaps, in the same order. //
+    void PackAround(vector<unique_ptr<Bitmap>>& bitmaps, ostream* log, bool unique, bool rotate);
+    // halves the page size for as long as everything still fits
+    void ShrinkToFit();
+    // the sum of the packed bitmaps' areas (not counting duplicates)
+    size_t UsedArea() const;
+    // UsedArea over the page's area
+    float Occupancy() const;
+    // identifies the page's pixels: equal hashes mean equal atlas images
+    uint64_t ContentHash(uint64_t seed) const;
+    // packs one bitmap, taking it out of the unique_ptr unless it didn't fit
+    bool Insert(unique_ptr<Bitmap>& bitmap, bool unique, bool rotate);
+    bool InsertDuplicate(unique_ptr<Bitmap>& bitmap);
+    // puts the bitmap in the spot the bin packer gave it (before the pad offset)
+    void Place(unique_ptr<Bitmap>& bitmap, rbp::Rect rect, bool unique, bool rotate);
+    // Pack w/ settings.globalFit: packs as many bitmaps as fit, leaving the rest in 
+    //	bitmaps, in the same order. //
+    void PackGlobal(vector<unique_ptr<Bitmap>>& bitmaps, ostream* log, bool unique, bool rotate);
+    // the band height is picked by the packer, everything else comes from 
+    //	settings; returns false, after printing why, if the png can't be written
+    bool SavePng(const string& file, PngWriteSettings settings = PngWriteSettings());
+    // frees the packed bitmaps' pixels once the atlas image has been saved
+    void ReleasePixels();
     void SaveXml(const string& name, ofstream& xml, bool trim, bool rotate);
     void SaveBin(const string& name, ofstream& bin, bool trim, bool rotate);
     void SaveJson(const string& name, ofstream& json, bool trim, bool rotate);
 };
 
+// returns false if the file is missing or unreadable
+bool LoadPlacements(const string& file, AtlasPlacements& outPlacements);
+void SavePlacements(const string& file, AtlasPlacements const& placements);
+
 #endif
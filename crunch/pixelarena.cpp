@@ -0,0 +1,160 @@
+/*
+ 
+ MIT License
+ 
+ Copyright (c) 2017 Chevy Ray Johnston
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+#include "pixelarena.hpp"
+#include <cstdlib>
+#include <algorithm>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// keeps every buffer on its own cache lines, which also suits the SIMD kernels
+static const size_t ALLOCATION_ALIGNMENT = 64;
+
+PixelArena::PixelArena(size_t chunkSize)
+	:chunkSize(chunkSize)
+	,chunkUsed(0)
+	,numAllocations(0)
+	,numChunksHeld(0)
+	,peakChunksHeld(0)
+{
+}
+PixelArena::~PixelArena()
+{
+	for (Chunk& chunk : chunks)
+	{
+		FreeChunk(chunk);
+	}
+}
+shared_ptr<uint32_t> PixelArena::Allocate(size_t count)
+{
+	const size_t bytes = 
+		(count * sizeof(uint32_t) + ALLOCATION_ALIGNMENT - 1) & ~(ALLOCATION_ALIGNMENT - 1);
+	if (bytes > MaxAllocation())
+	{
+		return nullptr;
+	}
+	lock_guard<mutex> lock(arenaMutex);
+	if (chunks.empty() || chunkUsed + bytes > chunks.back().size)
+	{
+		// whatever is left of the current chunk is wasted, which is why big
+		//	buffers are kept out of the arena entirely //
+		char*const memory = AllocateChunk(chunkSize);
+		if (!memory)
+		{
+			return nullptr;
+		}
+		// nothing more will be carved out of the old chunk, so if all of its
+		//	buffers are already gone it can go too //
+		if (!chunks.empty() && chunks.back().numLive == 0)
+		{
+			FreeChunk(chunks.back());
+			numChunksHeld--;
+		}
+		chunks.push_back({ memory, chunkSize, 0 });
+		chunkUsed = 0;
+		numChunksHeld++;
+		peakChunksHeld = max(peakChunksHeld, numChunksHeld);
+	}
+	// fresh pages from the OS are already zeroed, and arena memory is never 
+	//	reused, so there's no need to clear the buffer //
+	const size_t chunkIndex = chunks.size() - 1;
+	uint32_t*const pixels = 
+		reinterpret_cast<uint32_t*>(chunks[chunkIndex].memory + chunkUsed);
+	chunkUsed += bytes;
+	chunks[chunkIndex].numLive++;
+	numAllocations++;
+	return shared_ptr<uint32_t>(pixels, [this, chunkIndex](uint32_t*) { Release(chunkIndex); });
+}
+void PixelArena::Release(size_t chunkIndex)
+{
+	lock_guard<mutex> lock(arenaMutex);
+	Chunk& chunk = chunks[chunkIndex];
+	// the current chunk stays, as later buffers will still be carved from it
+	if (--chunk.numLive == 0 && chunkIndex + 1 < chunks.size())
+	{
+		FreeChunk(chunk);
+		numChunksHeld--;
+	}
+}
+size_t PixelArena::MaxAllocation() const
+{
+	return chunkSize / 4;
+}
+size_t PixelArena::NumAllocations() const
+{
+	lock_guard<mutex> lock(arenaMutex);
+	return numAllocations;
+}
+size_t PixelArena::NumChunks() const
+{
+	lock_guard<mutex> lock(arenaMutex);
+	return chunks.size();
+}
+size_t PixelArena::BytesReserved() const
+{
+	lock_guard<mutex> lock(arenaMutex);
+	return numChunksHeld * chunkSize;
+}
+size_t PixelArena::PeakBytesReserved() const
+{
+	lock_guard<mutex> lock(arenaMutex);
+	return peakChunksHeld * chunkSize;
+}
+char* PixelArena::AllocateChunk(size_t size)
+{
+#if defined(_WIN32)
+	void*const memory = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	if (memory == nullptr)
+#else
+	void*const memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, 
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED)
+#endif
+	{
+		return nullptr;
+	}
+#if defined(MADV_HUGEPAGE)
+	// only a hint; the kernel falls back to regular pages if it can't comply
+	madvise(memory, size, MADV_HUGEPAGE);
+#endif
+	return reinterpret_cast<char*>(memory);
+}
+void PixelArena::FreeChunk(Chunk& chunk)
+{
+	if (!chunk.memory)
+	{
+		return;
+	}
+#if defined(_WIN32)
+	VirtualFree(chunk.memory, 0, MEM_RELEASE);
+#else
+	munmap(chunk.memory, chunk.size);
+#endif
+	chunk.memory = nullptr;
+}
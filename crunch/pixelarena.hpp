@@ -0,0 +1,86 @@
+/*
+ 
+ MIT License
+ 
+ Copyright (c) 2017 Chevy Ray Johnston
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+#ifndef pixelarena_hpp
+#define pixelarena_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <mutex>
+#include <memory>
+
+using namespace std;
+
+// A bump allocator for pixel buffers.  Memory is reserved from the OS in 
+//	large page-aligned chunks (huge-page backed where Linux allows it) and 
+//	buffers are carved out of the current chunk one after the other.  Each 
+//	chunk counts the buffers still alive in it, and is given back to the OS 
+//	as soon as the last of them is released & the arena has moved on to a 
+//	newer chunk; whatever is left is given back when the arena is destroyed,
+//	so the arena has to outlive every buffer it hands out.  Allocate() is 
+//	safe to call from several threads, as is releasing the buffers. //
+class PixelArena
+{
+public:
+	// a multiple of the 2MB huge page size
+	static const size_t DEFAULT_CHUNK_SIZE = 8 << 20;
+	explicit PixelArena(size_t chunkSize = DEFAULT_CHUNK_SIZE);
+	~PixelArena();
+	PixelArena(PixelArena const&) = delete;
+	PixelArena& operator=(PixelArena const&) = delete;
+	// Returns a zeroed, cache line aligned buffer of count pixels, or null if 
+	//	the buffer is too big for the arena (see MaxAllocation()) or the OS 
+	//	has no memory left for another chunk.  Dropping the last reference to 
+	//	the buffer releases it back to its chunk. //
+	shared_ptr<uint32_t> Allocate(size_t count);
+	size_t MaxAllocation() const;
+	size_t NumAllocations() const;
+	// the number of chunks reserved over the arena's lifetime
+	size_t NumChunks() const;
+	// how much memory the arena holds right now, and the most it ever held
+	size_t BytesReserved() const;
+	size_t PeakBytesReserved() const;
+private:
+	struct Chunk
+	{
+		char* memory;
+		size_t size;
+		size_t numLive;
+	};
+	static char* AllocateChunk(size_t size);
+	static void FreeChunk(Chunk& chunk);
+	void Release(size_t chunkIndex);
+	const size_t chunkSize;
+	vector<Chunk> chunks;
+	size_t chunkUsed;
+	size_t numAllocations;
+	size_t numChunksHeld;
+	size_t peakChunksHeld;
+	mutable mutex arenaMutex;
+};
+
+#endif
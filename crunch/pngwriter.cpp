@@ -0,0 +1,588 @@
+/*
+ 
+ MIT License
+ 
+ Copyright (c) 2017 Chevy Ray Johnston
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+#include "pngwriter.hpp"
+#include "threadpool.hpp"
+#include "zlibbackend.hpp"
+#include "flate.hpp"
+#include <fstream>
+#include <vector>
+#include <unordered_set>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+bool ParsePngLevel(string const& name, PngLevel& outLevel)
+{
+	for (PngLevel level : { PngLevel::Store, PngLevel::Fast, PngLevel::Default, PngLevel::Max })
+	{
+		if (name == PngLevelName(level))
+		{
+			outLevel = level;
+			return true;
+		}
+	}
+	return false;
+}
+char const* PngLevelName(PngLevel level)
+{
+	switch (level)
+	{
+	case PngLevel::Store: return "store";
+	case PngLevel::Fast: return "fast";
+	case PngLevel::Default: return "default";
+	case PngLevel::Max: return "max";
+	}
+	return "unknown";
+}
+
+PngWriteSettings::PngWriteSettings(PngLevel level)
+	:autoConvert(true)
+	,filterStrategy(PngFilterStrategy::MinSum)
+	,bandHeight(0)
+	,threadPool(nullptr)
+	,maxParallelBands(0)
+{
+	lodepng_compress_settings_init(&zlib);
+	switch (level)
+	{
+	case PngLevel::Store:
+		zlib.btype = 0;
+		autoConvert = false;
+		filterStrategy = PngFilterStrategy::None;
+		break;
+	case PngLevel::Fast:
+		zlib.windowsize = 512;
+		zlib.nicematch = 32;
+		zlib.lazymatching = 0;
+		autoConvert = false;
+		// paeth does well on sprites & costs a single pass per row
+		filterStrategy = PngFilterStrategy::Paeth;
+		break;
+	case PngLevel::Default:
+		break;
+	case PngLevel::Max:
+		zlib.windowsize = 32768;
+		zlib.nicematch = 258;
+		zlib.lazymatching = 1;
+		filterStrategy = PngFilterStrategy::BruteForce;
+		break;
+	}
+}
+
+namespace
+{
+// The color profile lodepng builds for auto_convert, gathered a band of 
+//	pixels at a time.  Feeding it every pixel in order makes the same choices
+//	lodepng_get_color_profile would for the whole image. //
+struct ColorProfiler
+{
+	LodePNGColorProfile profile;
+	unordered_set<uint32_t> colors;
+	bool coloredDone = false;
+	bool alphaDone = false;
+	bool numColorsDone = false;
+	ColorProfiler()
+	{
+		lodepng_color_profile_init(&profile);
+	}
+	// once this is true, the rest of the pixels can't change the profile
+	bool Done() const
+	{
+		return coloredDone && alphaDone && numColorsDone && profile.bits >= 8;
+	}
+	void SetAlpha()
+	{
+		profile.alpha = 1;
+		profile.key = 0;
+		alphaDone = true;
+		// PNG has no alpha channel modes with less than 8 bits per channel
+		profile.bits = max(profile.bits, 8u);
+	}
+	void Add(uint32_t const* pixels, size_t count)
+	{
+		for (size_t i = 0; i < count && !Done(); i++)
+		{
+			const uint32_t p = pixels[i];
+			const unsigned r = p & 0xFF;
+			const unsigned g = (p >> 8) & 0xFF;
+			const unsigned b = (p >> 16) & 0xFF;
+			const unsigned a = p >> 24;
+			if (profile.bits < 8)
+			{
+				// only r is checked, < 8 bits is only relevant for greyscale
+				//	& the scaling of 2 & 4 bit values uses multiples of 85 & 17
+				const unsigned bits = (r == 0 || r == 255) ? 1 : 
+					(r % 17 == 0 ? (r % 85 == 0 ? 2 : 4) : 8);
+				profile.bits = max(profile.bits, bits);
+			}
+			if (!coloredDone && (r != g || r != b))
+			{
+				profile.colored = 1;
+				coloredDone = true;
+				// PNG has no colored modes with less than 8 bits per channel
+				profile.bits = max(profile.bits, 8u);
+			}
+			if (!alphaDone)
+			{
+				const bool matchKey = 
+					r == profile.key_r && g == profile.key_g && b == profile.key_b;
+				if (a != 255 && (a != 0 || (profile.key && !matchKey)))
+				{
+					SetAlpha();
+				}
+				else if (a == 0 && !profile.alpha && !profile.key)
+				{
+					profile.key = 1;
+					profile.key_r = r;
+					profile.key_g = g;
+					profile.key_b = b;
+				}
+				else if (a == 255 && profile.key && matchKey)
+				{
+					// a color key can't be used if an opaque pixel has its color
+					SetAlpha();
+				}
+			}
+			if (!numColorsDone && colors.insert(p).second)
+			{
+				if (profile.numcolors < 256)
+				{
+					unsigned char*const entry = profile.palette + profile.numcolors * 4;
+					entry[0] = static_cast<unsigned char>(r);
+					entry[1] = static_cast<unsigned char>(g);
+					entry[2] = static_cast<unsigned char>(b);
+					entry[3] = static_cast<unsigned char>(a);
+				}
+				profile.numcolors++;
+				numColorsDone = profile.numcolors >= 257;
+			}
+		}
+	}
+	// The opaque pixels that came before the color key was found have to be 
+	//	checked against it in a second pass. //
+	void CheckKey(uint32_t const* pixels, size_t count)
+	{
+		for (size_t i = 0; i < count && profile.key; i++)
+		{
+			const uint32_t p = pixels[i];
+			if ((p >> 24) != 0 && (p & 0xFF) == profile.key_r && 
+				((p >> 8) & 0xFF) == profile.key_g && ((p >> 16) & 0xFF) == profile.key_b)
+			{
+				SetAlpha();
+			}
+		}
+	}
+};
+// Same decisions as lodepng_auto_choose_color for an 8 bit RGBA image. //
+void ChooseColorMode(LodePNGColorProfile prof, int width, int height, 
+	LodePNGColorMode& mode)
+{
+	const size_t numPixels = static_cast<size_t>(width) * height;
+	if (prof.key && numPixels <= 16)
+	{
+		// too few pixels to justify tRNS chunk overhead
+		prof.alpha = 1;
+		prof.key = 0;
+		prof.bits = max(prof.bits, 8u);
+	}
+	const unsigned n = prof.numcolors;
+	const unsigned paletteBits = n <= 2 ? 1 : (n <= 4 ? 2 : (n <= 16 ? 4 : 8));
+	bool paletteOk = n <= 256 && prof.bits <= 8;
+	// don't add palette overhead if image has only a few pixels
+	if (numPixels < static_cast<size_t>(n) * 2)
+	{
+		paletteOk = false;
+	}
+	// grey is less overhead
+	if (!prof.colored && prof.bits <= paletteBits)
+	{
+		paletteOk = false;
+	}
+	mode.key_defined = 0;
+	if (paletteOk)
+	{
+		lodepng_palette_clear(&mode);
+		for (unsigned i = 0; i < n; i++)
+		{
+			unsigned char const*const p = prof.palette + i * 4;
+			lodepng_palette_add(&mode, p[0], p[1], p[2], p[3]);
+		}
+		mode.colortype = LCT_PALETTE;
+		mode.bitdepth = paletteBits;
+		return;
+	}
+	mode.bitdepth = prof.bits;
+	mode.colortype = prof.alpha ? (prof.colored ? LCT_RGBA : LCT_GREY_ALPHA)
+		: (prof.colored ? LCT_RGB : LCT_GREY);
+	if (prof.key)
+	{
+		const unsigned mask = (1u << mode.bitdepth) - 1u;
+		mode.key_r = prof.key_r & mask;
+		mode.key_g = prof.key_g & mask;
+		mode.key_b = prof.key_b & mask;
+		mode.key_defined = 1;
+	}
+}
+unsigned char PaethPredictor(int a, int b, int c)
+{
+	const int pa = abs(b - c);
+	const int pb = abs(a - c);
+	const int pc = abs(a + b - c - c);
+	if (pc < pa && pc < pb)
+	{
+		return static_cast<unsigned char>(c);
+	}
+	return static_cast<unsigned char>(pb < pa ? b : a);
+}
+// PNG filter method 0; prevLine is null for the first row of the image //
+void FilterScanline(unsigned char* out, unsigned char const* line, 
+	unsigned char const* prevLine, size_t length, size_t byteWidth, 
+	unsigned char filterType)
+{
+	// the first row is filtered as if it had a row of zeroes above it
+	if (!prevLine && (filterType == 2 || filterType == 4))
+	{
+		filterType = filterType == 2 ? 0 : 1;
+	}
+	size_t i = 0;
+	switch (filterType)
+	{
+	case 0:
+		memcpy(out, line, length);
+		break;
+	case 1:
+		for (; i < byteWidth; i++) out[i] = line[i];
+		for (; i < length; i++) out[i] = line[i] - line[i - byteWidth];
+		break;
+	case 2:
+		for (; i < length; i++) out[i] = line[i] - prevLine[i];
+		break;
+	case 3:
+		if (prevLine)
+		{
+			for (; i < byteWidth; i++) out[i] = line[i] - (prevLine[i] >> 1);
+			for (; i < length; i++) out[i] = line[i] - ((line[i - byteWidth] + prevLine[i]) >> 1);
+		}
+		else
+		{
+			for (; i < byteWidth; i++) out[i] = line[i];
+			for (; i < length; i++) out[i] = line[i] - (line[i - byteWidth] >> 1);
+		}
+		break;
+	case 4:
+		for (; i < byteWidth; i++) out[i] = line[i] - prevLine[i];
+		for (; i < length; i++)
+		{
+			out[i] = line[i] - PaethPredictor(line[i - byteWidth], prevLine[i], prevLine[i - byteWidth]);
+		}
+		break;
+	}
+}
+// Writes the filter type byte followed by the filtered row to out, picking 
+//	the filter the same way lodepng's strategy of the same name does.
+//	bruteForceZlib is what the brute force strategy compresses its attempts
+//	with. //
+void FilterRow(unsigned char* out, unsigned char const* line, 
+	unsigned char const* prevLine, size_t lineBytes, size_t byteWidth, 
+	PngFilterStrategy strategy, LodePNGCompressSettings const& bruteForceZlib,
+	vector<unsigned char>& attempt)
+{
+	if (strategy != PngFilterStrategy::MinSum && strategy != PngFilterStrategy::BruteForce)
+	{
+		out[0] = static_cast<unsigned char>(strategy);
+		FilterScanline(out + 1, line, prevLine, lineBytes, byteWidth, out[0]);
+		return;
+	}
+	size_t smallest = 0;
+	for (unsigned char type = 0; type < 5; type++)
+	{
+		FilterScanline(attempt.data(), line, prevLine, lineBytes, byteWidth, type);
+		size_t size = 0;
+		if (strategy == PngFilterStrategy::MinSum)
+		{
+			for (size_t x = 0; x < lineBytes; x++)
+			{
+				// differences are treated as signed, but type 0 isn't a difference
+				const unsigned char s = attempt[x];
+				size += (type == 0 || s < 128) ? s : (255u - s);
+			}
+		}
+		else
+		{
+			unsigned char* deflated = nullptr;
+			DeflatePart(&deflated, &size, attempt.data(), lineBytes, &bruteForceZlib, 1);
+			free(deflated);
+		}
+		if (type == 0 || size < smallest)
+		{
+			smallest = size;
+			out[0] = type;
+			memcpy(out + 1, attempt.data(), lineBytes);
+		}
+	}
+}
+// The adler32 of two buffers joined together, given the adler32 of each 
+//	and the length of the second one (see zlib's adler32_combine). //
+unsigned CombineAdler32(unsigned adler1, unsigned adler2, size_t length2)
+{
+	const uint64_t base = 65521;
+	const uint64_t rem = length2 % base;
+	uint64_t sum1 = adler1 & 0xFFFF;
+	uint64_t sum2 = (rem * sum1) % base;
+	sum1 += (adler2 & 0xFFFF) + base - 1;
+	sum2 += (adler1 >> 16) + (adler2 >> 16) + base - rem;
+	sum1 %= base;
+	sum2 %= base;
+	return static_cast<unsigned>((sum2 << 16) | sum1);
+}
+void AppendBigEndian32(vector<unsigned char>& out, unsigned value)
+{
+	out.push_back(static_cast<unsigned char>(value >> 24));
+	out.push_back(static_cast<unsigned char>(value >> 16));
+	out.push_back(static_cast<unsigned char>(value >> 8));
+	out.push_back(static_cast<unsigned char>(value));
+}
+void WriteChunk(ofstream& out, char const* type, vector<unsigned char> const& data)
+{
+	unsigned char* chunk = nullptr;
+	size_t chunkSize = 0;
+	lodepng_chunk_create(&chunk, &chunkSize, static_cast<unsigned>(data.size()), 
+		type, data.data());
+	out.write(reinterpret_cast<char const*>(chunk), chunkSize);
+	free(chunk);
+}
+}
+
+bool SavePngStreamed(const string& file, int width, int height, 
+	PngRowSource const& source, PngWriteSettings const& settings)
+{
+	const int bandHeight = settings.bandHeight > 0 ? settings.bandHeight :
+		max(1, (1 << 20) / (4 * max(width, 1)));
+	LodePNGColorMode rawMode;
+	lodepng_color_mode_init(&rawMode);
+	LodePNGColorMode pngMode;
+	lodepng_color_mode_init(&pngMode);
+	if (settings.autoConvert)
+	{
+		ColorProfiler profiler;
+		for (int y = 0; y < height && !profiler.Done(); y += bandHeight)
+		{
+			const int numRows = min(bandHeight, height - y);
+			profiler.Add(source(y, numRows), static_cast<size_t>(width) * numRows);
+		}
+		for (int y = 0; y < height && profiler.profile.key && !profiler.profile.alpha; 
+			y += bandHeight)
+		{
+			const int numRows = min(bandHeight, height - y);
+			profiler.CheckKey(source(y, numRows), static_cast<size_t>(width) * numRows);
+		}
+		ChooseColorMode(profiler.profile, width, height, pngMode);
+	}
+	const bool convert = pngMode.colortype != LCT_RGBA || pngMode.bitdepth != 8;
+	const unsigned bpp = lodepng_get_bpp(&pngMode);
+	const size_t lineBytes = (static_cast<size_t>(width) * bpp + 7) / 8;
+	const size_t byteWidth = (bpp + 7) / 8;
+	// palette & low bit depth images compress best unfiltered
+	const PngFilterStrategy filterStrategy = 
+		(pngMode.colortype == LCT_PALETTE || pngMode.bitdepth < 8) ? 
+		PngFilterStrategy::None : settings.filterStrategy;
+	// Like lodepng, brute force tries each filter with a fixed huffman tree, 
+	//	so that the tree isn't adapted to each filter on purpose. //
+	LodePNGCompressSettings bruteForceZlib = settings.zlib;
+	bruteForceZlib.btype = 1;
+
+	ofstream out(file, ios::binary);
+	if (!out)
+	{
+		lodepng_color_mode_cleanup(&pngMode);
+		return false;
+	}
+	static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	out.write(reinterpret_cast<char const*>(signature), sizeof(signature));
+	vector<unsigned char> chunk;
+	AppendBigEndian32(chunk, static_cast<unsigned>(width));
+	AppendBigEndian32(chunk, static_cast<unsigned>(height));
+	chunk.push_back(static_cast<unsigned char>(pngMode.bitdepth));
+	chunk.push_back(static_cast<unsigned char>(pngMode.colortype));
+	chunk.push_back(0); // compression method
+	chunk.push_back(0); // filter method
+	chunk.push_back(0); // interlace method
+	WriteChunk(out, "IHDR", chunk);
+	if (pngMode.colortype == LCT_PALETTE)
+	{
+		chunk.clear();
+		size_t numAlphas = 0;
+		for (size_t i = 0; i < pngMode.palettesize; i++)
+		{
+			chunk.insert(chunk.end(), pngMode.palette + i * 4, pngMode.palette + i * 4 + 3);
+			if (pngMode.palette[i * 4 + 3] != 255)
+			{
+				numAlphas = i + 1;
+			}
+		}
+		WriteChunk(out, "PLTE", chunk);
+		// the tail of palette entries that are fully opaque can be left out
+		if (numAlphas > 0)
+		{
+			chunk.clear();
+			for (size_t i = 0; i < numAlphas; i++)
+			{
+				chunk.push_back(pngMode.palette[i * 4 + 3]);
+			}
+			WriteChunk(out, "tRNS", chunk);
+		}
+	}
+	else if (pngMode.key_defined && 
+		(pngMode.colortype == LCT_GREY || pngMode.colortype == LCT_RGB))
+	{
+		chunk.clear();
+		for (unsigned key : { pngMode.key_r, pngMode.key_g, pngMode.key_b })
+		{
+			chunk.push_back(static_cast<unsigned char>(key >> 8));
+			chunk.push_back(static_cast<unsigned char>(key & 0xFF));
+			if (pngMode.colortype == LCT_GREY)
+			{
+				break;
+			}
+		}
+		WriteChunk(out, "tRNS", chunk);
+	}
+
+	// Each band becomes its own IDAT chunk.  The zlib header goes in front of
+	//	the first one & the adler32 of all the filtered rows after the last.
+	//	Bands don't share an LZ77 window, so a whole batch of them can be 
+	//	filtered & deflated at the same time (like pigz does) w/o changing the
+	//	output. //
+	struct Band
+	{
+		int numRows;
+		vector<unsigned char> raw;
+		// the last raw row of the band before, or empty for the first band
+		vector<unsigned char> above;
+		vector<unsigned char> filtered;
+		size_t filteredSize;
+		bool last;
+		unsigned adler;
+		unsigned char* deflated;
+		size_t deflatedSize;
+		unsigned error;
+	};
+	const int bandsPerBatch = settings.threadPool ? (settings.maxParallelBands > 0 ? 
+		settings.maxParallelBands : settings.threadPool->NumThreads()) : 1;
+	vector<Band> batch(bandsPerBatch);
+	vector<unsigned char> lastRow;
+	unsigned adler = 1;
+	unsigned error = 0;
+	for (int y = 0; y < height && !error; )
+	{
+		// Rows are pulled from the source in order.  Each band remembers the
+		//	row above it, which is all it needs to be filtered on its own. //
+		const bool firstBatch = y == 0;
+		size_t numBands = 0;
+		for (; numBands < batch.size() && y < height; numBands++, y += bandHeight)
+		{
+			Band& band = batch[numBands];
+			band.numRows = min(bandHeight, height - y);
+			band.raw.resize(lineBytes * band.numRows);
+			band.above = lastRow;
+			band.last = y + band.numRows >= height;
+			uint32_t const*const pixels = source(y, band.numRows);
+			for (int r = 0; r < band.numRows; r++)
+			{
+				unsigned char const*const rowPixels = 
+					reinterpret_cast<unsigned char const*>(pixels + static_cast<size_t>(r) * width);
+				unsigned char*const line = band.raw.data() + r * lineBytes;
+				if (convert)
+				{
+					lodepng_convert(line, rowPixels, &pngMode, &rawMode, 
+						static_cast<unsigned>(width), 1);
+				}
+				else
+				{
+					memcpy(line, rowPixels, lineBytes);
+				}
+			}
+			lastRow.assign(band.raw.end() - lineBytes, band.raw.end());
+		}
+		auto deflateBand = [&](size_t b)->void
+		{
+			Band& band = batch[b];
+			band.filteredSize = (lineBytes + 1) * band.numRows;
+			band.filtered.resize(band.filteredSize);
+			vector<unsigned char> attempt(lineBytes);
+			for (int r = 0; r < band.numRows; r++)
+			{
+				unsigned char const*const line = band.raw.data() + r * lineBytes;
+				unsigned char const*const prevLine = r > 0 ? line - lineBytes : 
+					(band.above.empty() ? nullptr : band.above.data());
+				FilterRow(band.filtered.data() + r * (lineBytes + 1), line, prevLine, 
+					lineBytes, byteWidth, filterStrategy, bruteForceZlib, attempt);
+			}
+			band.adler = FlateAdler32(1, band.filtered.data(), band.filteredSize);
+			band.deflated = nullptr;
+			band.deflatedSize = 0;
+			band.error = DeflatePart(&band.deflated, &band.deflatedSize, 
+				band.filtered.data(), band.filteredSize, &settings.zlib, band.last ? 1 : 0);
+		};
+		if (settings.threadPool)
+		{
+			settings.threadPool->ParallelFor(numBands, deflateBand);
+		}
+		else
+		{
+			for (size_t b = 0; b < numBands; b++)
+			{
+				deflateBand(b);
+			}
+		}
+		for (size_t b = 0; b < numBands; b++)
+		{
+			Band& band = batch[b];
+			error = error ? error : band.error;
+			adler = CombineAdler32(adler, band.adler, band.filteredSize);
+			chunk.clear();
+			if (firstBatch && b == 0)
+			{
+				// CM 8 w/ a 32k window, no preset dictionary, FLEVEL 0
+				const unsigned cmfFlg = 256 * 120;
+				chunk.push_back(static_cast<unsigned char>(cmfFlg >> 8));
+				chunk.push_back(static_cast<unsigned char>((cmfFlg & 0xFF) + 31 - cmfFlg % 31));
+			}
+			chunk.insert(chunk.end(), band.deflated, band.deflated + band.deflatedSize);
+			free(band.deflated);
+			if (band.last)
+			{
+				AppendBigEndian32(chunk, adler);
+			}
+			WriteChunk(out, "IDAT", chunk);
+		}
+	}
+	chunk.clear();
+	WriteChunk(out, "IEND", chunk);
+	lodepng_color_mode_cleanup(&pngMode);
+	return !error && out.good();
+}
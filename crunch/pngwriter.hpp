@@ -0,0 +1,100 @@
+/*
+ 
+ MIT License
+ 
+ Copyright (c) 2017 Chevy Ray Johnston
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+#ifndef pngwriter_hpp
+#define pngwriter_hpp
+
+#include <string>
+#include <cstdint>
+#include <functional>
+#include "lodepng.h"
+
+using namespace std;
+
+class ThreadPool;
+
+// Returns rows [y, y + numRows) of the image as numRows tightly packed rows of
+//	0xAABBGGRR pixels.  The pointer only has to stay valid until the next call.
+typedef function<uint32_t const*(int y, int numRows)> PngRowSource;
+
+// How each row's PNG filter gets picked.  The first five always use the
+//	filter of the same number. //
+enum class PngFilterStrategy
+{
+	None,
+	Sub,
+	Up,
+	Average,
+	Paeth,
+	// the minimum sum of absolute differences heuristic
+	MinSum,
+	// deflate the row w/ every filter & keep the smallest; very slow
+	BruteForce
+};
+
+// Presets trading encoding speed for file size, picked w/ --png-level
+enum class PngLevel
+{
+	// no compression at all
+	Store,
+	// for iterating: fixed filter, small window, no color type analysis
+	Fast,
+	// lodepng's default encoder settings
+	Default,
+	// for shipping: 32k window & brute force filter choice
+	Max
+};
+// returns false if name isn't one of "store", "fast", "default" or "max"
+bool ParsePngLevel(string const& name, PngLevel& outLevel);
+char const* PngLevelName(PngLevel level);
+
+struct PngWriteSettings
+{
+	LodePNGCompressSettings zlib;
+	// Store the image in the smallest color type that can hold it, just like 
+	//	lodepng's auto_convert.  This costs an extra pass over the rows. //
+	bool autoConvert;
+	// palette & low bit depth images are never filtered, like lodepng does
+	PngFilterStrategy filterStrategy;
+	// number of rows generated & compressed at a time; 0 picks enough rows 
+	//	for roughly a megabyte of pixels
+	int bandHeight;
+	// if set, this many bands are compressed at the same time on the pool
+	//	(0 means one per thread).  The output is the same either way. //
+	ThreadPool* threadPool;
+	int maxParallelBands;
+	explicit PngWriteSettings(PngLevel level = PngLevel::Default);
+};
+
+// Writes a width x height PNG without ever holding the whole image in memory.
+//	Rows are pulled from source one band at a time, filtered, and compressed
+//	into their own IDAT chunk, so memory use is O(width * bandHeight) per band
+//	being compressed at once.
+//	Returns false if the file couldn't be written. //
+bool SavePngStreamed(const string& file, int width, int height, 
+	PngRowSource const& source, PngWriteSettings const& settings = PngWriteSettings());
+
+#endif
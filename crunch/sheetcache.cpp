@@ -0,0 +1,88 @@
+/*
+ 
+ MIT License
+ 
+ Copyright (c) 2017 Chevy Ray Johnston
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+#include "sheetcache.hpp"
+
+SheetCache::SheetCache()
+	:numDecoded(0)
+	,numShared(0)
+{
+}
+shared_ptr<SheetCache::Sheet> SheetCache::Find(const string& file, const string& name, bool premultiply)
+{
+	// the name goes into the key too, since the same file can be reached 
+	//	through different input directories
+	const string key = file + '\n' + name + '\n' + (premultiply ? '1' : '0');
+	lock_guard<mutex> lock(sheetsMutex);
+	shared_ptr<Sheet>& sheet = sheets[key];
+	if (!sheet)
+	{
+		sheet = make_shared<Sheet>();
+	}
+	return sheet;
+}
+void SheetCache::Expect(const string& file, const string& name, bool premultiply)
+{
+	shared_ptr<Sheet> sheet = Find(file, name, premultiply);
+	lock_guard<mutex> lock(sheet->sheetMutex);
+	sheet->numExpected++;
+}
+shared_ptr<Bitmap const> SheetCache::Acquire(const string& file, const string& name, bool premultiply)
+{
+	shared_ptr<Sheet> sheet = Find(file, name, premultiply);
+	lock_guard<mutex> lock(sheet->sheetMutex);
+	shared_ptr<Bitmap const> bitmap = sheet->bitmap;
+	if (bitmap)
+	{
+		numShared++;
+	}
+	else if (!sheet->failed)
+	{
+		// specifically do NOT trim the sheet; each frame is trimmed instead
+		bitmap = Bitmap::Load(file, name, premultiply, false);
+		sheet->failed = !bitmap;
+		numDecoded++;
+	}
+	sheet->bitmap = --sheet->numExpected > 0 ? bitmap : nullptr;
+	return bitmap;
+}
+void SheetCache::Release(const string& file, const string& name, bool premultiply)
+{
+	shared_ptr<Sheet> sheet = Find(file, name, premultiply);
+	lock_guard<mutex> lock(sheet->sheetMutex);
+	if (--sheet->numExpected <= 0)
+	{
+		sheet->bitmap = nullptr;
+	}
+}
+size_t SheetCache::NumDecoded() const
+{
+	return numDecoded;
+}
+size_t SheetCache::NumShared() const
+{
+	return numShared;
+}
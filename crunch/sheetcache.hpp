@@ -0,0 +1,72 @@
+/*
+ 
+ MIT License
+ 
+ Copyright (c) 2017 Chevy Ray Johnston
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+#ifndef sheetcache_hpp
+#define sheetcache_hpp
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include "bitmap.hpp"
+
+using namespace std;
+
+// Decoded flipbook & vfont sheets, shared between every atlas built in the 
+//	same run so that a sheet several atlases use is only decoded once.  Each 
+//	atlas announces the sheets it will need up front; a sheet is dropped from 
+//	the cache once the last of them has picked it up (or let it go), so it 
+//	lives no longer than it would have in a single atlas run. //
+class SheetCache
+{
+public:
+	SheetCache();
+	// one call per atlas that will need the sheet, before anyone acquires it
+	void Expect(const string& file, const string& name, bool premultiply);
+	// Decodes the sheet, or waits for whoever is already decoding it.  Returns
+	//	null if the sheet can't be decoded; the error is only printed once. //
+	shared_ptr<Bitmap const> Acquire(const string& file, const string& name, bool premultiply);
+	// the atlas turned out not to need the sheet, e.g. its frames were cached
+	void Release(const string& file, const string& name, bool premultiply);
+	size_t NumDecoded() const;
+	size_t NumShared() const;
+private:
+	struct Sheet
+	{
+		mutex sheetMutex;
+		shared_ptr<Bitmap const> bitmap;
+		int numExpected = 0;
+		bool failed = false;
+	};
+	shared_ptr<Sheet> Find(const string& file, const string& name, bool premultiply);
+	unordered_map<string, shared_ptr<Sheet>> sheets;
+	mutex sheetsMutex;
+	atomic<size_t> numDecoded;
+	atomic<size_t> numShared;
+};
+
+#endif
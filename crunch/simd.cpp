@@ -0,0 +1,556 @@
+/*
+ 
+ MIT License
+ 
+ Copyright (c) 2017 Chevy Ray Johnston
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+#include "simd.hpp"
+#include <atomic>
+#include <vector>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(_M_X64) || \
+	((defined(__i386__) || defined(_M_IX86)) && (defined(__SSE2__) || _M_IX86_FP >= 2))
+#define CRUNCH_SIMD_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+// MSVC lets any function use AVX2 intrinsics
+#define CRUNCH_TARGET_AVX2
+#else
+#define CRUNCH_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// Scalar reference implementations.  The vector paths below must match 
+//	these bit for bit. //
+static void PremultiplyPixelsScalar(uint32_t* pixels, size_t count)
+{
+	uint32_t c, a, r, g, b;
+	float m;
+	for (size_t i = 0; i < count; ++i)
+	{
+		c = pixels[i];
+		a = c >> 24;
+		m = static_cast<float>(a) / 255.0f;
+		r = static_cast<uint32_t>((c & 0xff) * m);
+		g = static_cast<uint32_t>(((c >> 8) & 0xff) * m);
+		b = static_cast<uint32_t>(((c >> 16) & 0xff) * m);
+		pixels[i] = (a << 24) | (b << 16) | (g << 8) | r;
+	}
+}
+static void MaskPixelsScalar(uint32_t* pixels, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		if ((pixels[i] >> 24) == 0)
+		{
+			continue;
+		}
+		pixels[i] = 0xFFFFFFFF;
+	}
+}
+static void OutlinePixelsScalar(uint32_t* pixels, size_t count)
+{
+	uint32_t p, a, b, g, r;
+	for (size_t i = 0; i < count; i++)
+	{
+		p = pixels[i];
+		a = p >> 24;
+		b = (p >> 16) & 0xFF;
+		g = (p >> 8 ) & 0xFF;
+		r = p & 0xFF;
+		if (a == 0 || r != 0 || g != 0 || b != 0)
+		{
+			pixels[i] = 0;
+			continue;
+		}
+		pixels[i] = 0xFFFFFFFF;
+	}
+}
+
+// index of the first pixel in [begin, end) with a non-zero alpha, or end
+static int FirstOpaqueScalar(uint32_t const* row, int begin, int end)
+{
+	for (int x = begin; x < end; x++)
+	{
+		if ((row[x] >> 24) > 0)
+		{
+			return x;
+		}
+	}
+	return end;
+}
+// index of the last pixel in [begin, end) with a non-zero alpha, or begin - 1
+static int LastOpaqueScalar(uint32_t const* row, int begin, int end)
+{
+	for (int x = end - 1; x >= begin; x--)
+	{
+		if ((row[x] >> 24) > 0)
+		{
+			return x;
+		}
+	}
+	return begin - 1;
+}
+
+#ifdef CRUNCH_SIMD_X86
+// The premultiply paths do the same single precision float math as the scalar
+//	code: a / 255 is correctly rounded by both divss & divps, the products
+//	are correctly rounded, and the conversion back truncates. //
+static void PremultiplyPixelsSSE2(uint32_t* pixels, size_t count)
+{
+	const __m128i byteMask = _mm_set1_epi32(0xFF);
+	const __m128 inv = _mm_set1_ps(255.0f);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128i c = _mm_loadu_si128(reinterpret_cast<__m128i const*>(pixels + i));
+		const __m128i a = _mm_srli_epi32(c, 24);
+		const __m128 m = _mm_div_ps(_mm_cvtepi32_ps(a), inv);
+		const __m128i r = _mm_cvttps_epi32(_mm_mul_ps(
+			_mm_cvtepi32_ps(_mm_and_si128(c, byteMask)), m));
+		const __m128i g = _mm_cvttps_epi32(_mm_mul_ps(
+			_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(c, 8), byteMask)), m));
+		const __m128i b = _mm_cvttps_epi32(_mm_mul_ps(
+			_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(c, 16), byteMask)), m));
+		const __m128i result = _mm_or_si128(
+			_mm_or_si128(_mm_slli_epi32(a, 24), _mm_slli_epi32(b, 16)),
+			_mm_or_si128(_mm_slli_epi32(g, 8), r));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + i), result);
+	}
+	PremultiplyPixelsScalar(pixels + i, count - i);
+}
+static void MaskPixelsSSE2(uint32_t* pixels, size_t count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128i p = _mm_loadu_si128(reinterpret_cast<__m128i const*>(pixels + i));
+		// transparent pixels keep their value, everything else becomes all ones
+		const __m128i transparent = _mm_cmpeq_epi32(_mm_srli_epi32(p, 24), zero);
+		const __m128i result = _mm_or_si128(p, _mm_xor_si128(transparent, 
+			_mm_cmpeq_epi32(zero, zero)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + i), result);
+	}
+	MaskPixelsScalar(pixels + i, count - i);
+}
+static void OutlinePixelsSSE2(uint32_t* pixels, size_t count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rgbMask = _mm_set1_epi32(0x00FFFFFF);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128i p = _mm_loadu_si128(reinterpret_cast<__m128i const*>(pixels + i));
+		const __m128i transparent = _mm_cmpeq_epi32(_mm_srli_epi32(p, 24), zero);
+		const __m128i black = _mm_cmpeq_epi32(_mm_and_si128(p, rgbMask), zero);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + i), 
+			_mm_andnot_si128(transparent, black));
+	}
+	OutlinePixelsScalar(pixels + i, count - i);
+}
+// bit n of the result is set if pixel n of the 4 has a zero alpha
+static int TransparentBitsSSE2(uint32_t const* pixels)
+{
+	const __m128i p = _mm_loadu_si128(reinterpret_cast<__m128i const*>(pixels));
+	const __m128i transparent = _mm_cmpeq_epi32(_mm_srli_epi32(p, 24), _mm_setzero_si128());
+	return _mm_movemask_ps(_mm_castsi128_ps(transparent));
+}
+static int FirstOpaqueSSE2(uint32_t const* row, int begin, int end)
+{
+	int x = begin;
+	for (; x + 4 <= end; x += 4)
+	{
+		const int transparent = TransparentBitsSSE2(row + x);
+		if (transparent != 0xF)
+		{
+			int i = 0;
+			while (transparent & (1 << i))
+			{
+				i++;
+			}
+			return x + i;
+		}
+	}
+	return FirstOpaqueScalar(row, x, end);
+}
+static int LastOpaqueSSE2(uint32_t const* row, int begin, int end)
+{
+	int x = end;
+	for (; x - 4 >= begin; x -= 4)
+	{
+		const int transparent = TransparentBitsSSE2(row + x - 4);
+		if (transparent != 0xF)
+		{
+			int i = 3;
+			while (transparent & (1 << i))
+			{
+				i--;
+			}
+			return x - 4 + i;
+		}
+	}
+	return LastOpaqueScalar(row, begin, x);
+}
+CRUNCH_TARGET_AVX2 static void PremultiplyPixelsAVX2(uint32_t* pixels, size_t count)
+{
+	const __m256i byteMask = _mm256_set1_epi32(0xFF);
+	const __m256 inv = _mm256_set1_ps(255.0f);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m256i c = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(pixels + i));
+		const __m256i a = _mm256_srli_epi32(c, 24);
+		const __m256 m = _mm256_div_ps(_mm256_cvtepi32_ps(a), inv);
+		const __m256i r = _mm256_cvttps_epi32(_mm256_mul_ps(
+			_mm256_cvtepi32_ps(_mm256_and_si256(c, byteMask)), m));
+		const __m256i g = _mm256_cvttps_epi32(_mm256_mul_ps(
+			_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(c, 8), byteMask)), m));
+		const __m256i b = _mm256_cvttps_epi32(_mm256_mul_ps(
+			_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(c, 16), byteMask)), m));
+		const __m256i result = _mm256_or_si256(
+			_mm256_or_si256(_mm256_slli_epi32(a, 24), _mm256_slli_epi32(b, 16)),
+			_mm256_or_si256(_mm256_slli_epi32(g, 8), r));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + i), result);
+	}
+	PremultiplyPixelsSSE2(pixels + i, count - i);
+}
+CRUNCH_TARGET_AVX2 static void MaskPixelsAVX2(uint32_t* pixels, size_t count)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i ones = _mm256_cmpeq_epi32(zero, zero);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m256i p = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(pixels + i));
+		const __m256i transparent = _mm256_cmpeq_epi32(_mm256_srli_epi32(p, 24), zero);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + i), 
+			_mm256_or_si256(p, _mm256_xor_si256(transparent, ones)));
+	}
+	MaskPixelsSSE2(pixels + i, count - i);
+}
+CRUNCH_TARGET_AVX2 static void OutlinePixelsAVX2(uint32_t* pixels, size_t count)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i rgbMask = _mm256_set1_epi32(0x00FFFFFF);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m256i p = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(pixels + i));
+		const __m256i transparent = _mm256_cmpeq_epi32(_mm256_srli_epi32(p, 24), zero);
+		const __m256i black = _mm256_cmpeq_epi32(_mm256_and_si256(p, rgbMask), zero);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + i), 
+			_mm256_andnot_si256(transparent, black));
+	}
+	OutlinePixelsSSE2(pixels + i, count - i);
+}
+CRUNCH_TARGET_AVX2 static int TransparentBitsAVX2(uint32_t const* pixels)
+{
+	const __m256i p = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(pixels));
+	const __m256i transparent = _mm256_cmpeq_epi32(_mm256_srli_epi32(p, 24), _mm256_setzero_si256());
+	return _mm256_movemask_ps(_mm256_castsi256_ps(transparent));
+}
+CRUNCH_TARGET_AVX2 static int FirstOpaqueAVX2(uint32_t const* row, int begin, int end)
+{
+	int x = begin;
+	for (; x + 8 <= end; x += 8)
+	{
+		const int transparent = TransparentBitsAVX2(row + x);
+		if (transparent != 0xFF)
+		{
+			int i = 0;
+			while (transparent & (1 << i))
+			{
+				i++;
+			}
+			return x + i;
+		}
+	}
+	return FirstOpaqueSSE2(row, x, end);
+}
+CRUNCH_TARGET_AVX2 static int LastOpaqueAVX2(uint32_t const* row, int begin, int end)
+{
+	int x = end;
+	for (; x - 8 >= begin; x -= 8)
+	{
+		const int transparent = TransparentBitsAVX2(row + x - 8);
+		if (transparent != 0xFF)
+		{
+			int i = 7;
+			while (transparent & (1 << i))
+			{
+				i--;
+			}
+			return x - 8 + i;
+		}
+	}
+	return LastOpaqueSSE2(row, begin, x);
+}
+#endif
+
+SimdLevel DetectSimdLevel()
+{
+#ifdef CRUNCH_SIMD_X86
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] >= 7)
+	{
+		__cpuid(info, 1);
+		// the OS has to save the ymm registers for us (OSXSAVE + AVX)
+		const bool osxsave = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0;
+		__cpuidex(info, 7, 0);
+		if (osxsave && (info[1] & (1 << 5)) != 0 && (_xgetbv(0) & 0x6) == 0x6)
+		{
+			return SimdLevel::AVX2;
+		}
+	}
+	return SimdLevel::SSE2;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return SimdLevel::AVX2;
+	}
+	return SimdLevel::SSE2;
+#endif
+#else
+	return SimdLevel::Scalar;
+#endif
+}
+
+static atomic<int> currentSimdLevel(-1);
+SimdLevel GetSimdLevel()
+{
+	int level = currentSimdLevel.load(memory_order_relaxed);
+	if (level < 0)
+	{
+		level = static_cast<int>(DetectSimdLevel());
+		currentSimdLevel.store(level, memory_order_relaxed);
+	}
+	return static_cast<SimdLevel>(level);
+}
+void SetSimdLevel(SimdLevel level)
+{
+	const SimdLevel best = DetectSimdLevel();
+	if (static_cast<int>(level) > static_cast<int>(best))
+	{
+		level = best;
+	}
+	currentSimdLevel.store(static_cast<int>(level), memory_order_relaxed);
+}
+char const* SimdLevelName(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::SSE2: return "SSE2";
+	case SimdLevel::AVX2: return "AVX2";
+	default: return "scalar";
+	}
+}
+
+void PremultiplyPixels(uint32_t* pixels, size_t count)
+{
+	switch (GetSimdLevel())
+	{
+#ifdef CRUNCH_SIMD_X86
+	case SimdLevel::AVX2: PremultiplyPixelsAVX2(pixels, count); break;
+	case SimdLevel::SSE2: PremultiplyPixelsSSE2(pixels, count); break;
+#endif
+	default: PremultiplyPixelsScalar(pixels, count); break;
+	}
+}
+void MaskPixels(uint32_t* pixels, size_t count)
+{
+	switch (GetSimdLevel())
+	{
+#ifdef CRUNCH_SIMD_X86
+	case SimdLevel::AVX2: MaskPixelsAVX2(pixels, count); break;
+	case SimdLevel::SSE2: MaskPixelsSSE2(pixels, count); break;
+#endif
+	default: MaskPixelsScalar(pixels, count); break;
+	}
+}
+void OutlinePixels(uint32_t* pixels, size_t count)
+{
+	switch (GetSimdLevel())
+	{
+#ifdef CRUNCH_SIMD_X86
+	case SimdLevel::AVX2: OutlinePixelsAVX2(pixels, count); break;
+	case SimdLevel::SSE2: OutlinePixelsSSE2(pixels, count); break;
+#endif
+	default: OutlinePixelsScalar(pixels, count); break;
+	}
+}
+bool FindOpaqueBounds(uint32_t const* pixels, int width, int height, int stride,
+	int& minX, int& minY, int& maxX, int& maxY)
+{
+	int (*firstOpaque)(uint32_t const*, int, int) = FirstOpaqueScalar;
+	int (*lastOpaque)(uint32_t const*, int, int) = LastOpaqueScalar;
+#ifdef CRUNCH_SIMD_X86
+	switch (GetSimdLevel())
+	{
+	case SimdLevel::AVX2: firstOpaque = FirstOpaqueAVX2; lastOpaque = LastOpaqueAVX2; break;
+	case SimdLevel::SSE2: firstOpaque = FirstOpaqueSSE2; lastOpaque = LastOpaqueSSE2; break;
+	default: break;
+	}
+#endif
+	auto row = [pixels, stride](int y)->uint32_t const*
+	{
+		return pixels + static_cast<size_t>(y) * stride;
+	};
+	// top: the first row with anything in it also gives us a first guess at
+	//	the horizontal bounds //
+	minY = 0;
+	for (; minY < height; minY++)
+	{
+		minX = firstOpaque(row(minY), 0, width);
+		if (minX < width)
+		{
+			break;
+		}
+	}
+	if (minY == height)
+	{
+		return false;
+	}
+	maxX = lastOpaque(row(minY), minX, width);
+	// bottom: we know row minY is not empty, so this always stops //
+	maxY = height - 1;
+	while (firstOpaque(row(maxY), 0, width) == width)
+	{
+		maxY--;
+	}
+	// sides: every other row only has to be checked outside of the current bounds //
+	for (int y = minY + 1; y <= maxY; y++)
+	{
+		uint32_t const*const r = row(y);
+		if (minX > 0)
+		{
+			const int x = firstOpaque(r, 0, minX);
+			if (x < minX)
+			{
+				minX = x;
+			}
+		}
+		if (maxX < width - 1)
+		{
+			const int x = lastOpaque(r, maxX + 1, width);
+			if (x > maxX)
+			{
+				maxX = x;
+			}
+		}
+	}
+	return true;
+}
+
+// what each pass does to a single pixel, straight from the definitions above
+static uint32_t PremultiplyReference(uint32_t c)
+{
+	const uint32_t a = c >> 24;
+	const float m = static_cast<float>(a) / 255.0f;
+	const uint32_t r = static_cast<uint32_t>((c & 0xff) * m);
+	const uint32_t g = static_cast<uint32_t>(((c >> 8) & 0xff) * m);
+	const uint32_t b = static_cast<uint32_t>(((c >> 16) & 0xff) * m);
+	return (a << 24) | (b << 16) | (g << 8) | r;
+}
+static uint32_t MaskReference(uint32_t c)
+{
+	return (c >> 24) == 0 ? c : 0xFFFFFFFF;
+}
+static uint32_t OutlineReference(uint32_t c)
+{
+	return (c >> 24) != 0 && (c & 0x00FFFFFF) == 0 ? 0xFFFFFFFF : 0;
+}
+bool SimdSelfTest()
+{
+	// every alpha w/ every channel value, once as a gray (so pure black is
+	//	covered for every alpha) & once w/ the channels all different //
+	vector<uint32_t> input;
+	input.reserve(256 * 256 * 2);
+	for (uint32_t a = 0; a < 256; a++)
+	{
+		for (uint32_t c = 0; c < 256; c++)
+		{
+			input.push_back((a << 24) | (c << 16) | (c << 8) | c);
+			input.push_back((a << 24) | ((c ^ 0x5A) << 16) | ((255 - c) << 8) | c);
+		}
+	}
+	struct Pass
+	{
+		char const* name;
+		void (*run)(uint32_t*, size_t);
+		uint32_t (*reference)(uint32_t);
+	};
+	const Pass passes[] = {
+		{ "premultiply", PremultiplyPixels, PremultiplyReference },
+		{ "mask", MaskPixels, MaskReference },
+		{ "outline", OutlinePixels, OutlineReference },
+	};
+	const SimdLevel previous = GetSimdLevel();
+	const SimdLevel best = DetectSimdLevel();
+	bool ok = true;
+	for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2 })
+	{
+		if (static_cast<int>(level) > static_cast<int>(best))
+		{
+			cout << "simd self-test: " << SimdLevelName(level) << " skipped, not supported by this CPU\n";
+			continue;
+		}
+		SetSimdLevel(level);
+		for (Pass const& pass : passes)
+		{
+			bool passOk = true;
+			// starts & ends that aren't a multiple of any vector width, so 
+			//	the unaligned heads & the tails are covered too //
+			for (size_t start = 0; start < 9 && passOk; start++)
+			{
+				const size_t count = input.size() - start - start % 5;
+				vector<uint32_t> pixels(input);
+				pass.run(pixels.data() + start, count);
+				for (size_t i = 0; i < pixels.size(); i++)
+				{
+					const bool inside = i >= start && i < start + count;
+					const uint32_t expected = inside ? pass.reference(input[i]) : input[i];
+					if (pixels[i] != expected)
+					{
+						cout << "simd self-test: " << pass.name << " (" << SimdLevelName(level) << 
+							") turned pixel 0x" << hex << input[i] << " into 0x" << pixels[i] << 
+							", expected 0x" << expected << dec << " (start " << start << ", index " << i << ")\n";
+						passOk = false;
+						break;
+					}
+				}
+			}
+			cout << "simd self-test: " << pass.name << " (" << SimdLevelName(level) << ") " << 
+				(passOk ? "ok" : "FAILED") << "\n";
+			ok = ok && passOk;
+		}
+	}
+	SetSimdLevel(previous);
+	return ok;
+}
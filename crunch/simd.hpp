@@ -0,0 +1,77 @@
+/*
+ 
+ MIT License
+ 
+ Copyright (c) 2017 Chevy Ray Johnston
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+#ifndef simd_hpp
+#define simd_hpp
+
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+// Per-pixel passes over 0xAABBGGRR pixel data.  Each pass picks the widest
+//	instruction set the CPU supports (AVX2, SSE2 or plain C++) the first time
+//	it's called, and every path produces exactly the same output as the
+//	scalar reference. //
+
+// multiplies the color channels by alpha / 255, truncating the result
+void PremultiplyPixels(uint32_t* pixels, size_t count);
+// every pixel with a non-zero alpha becomes solid white
+void MaskPixels(uint32_t* pixels, size_t count);
+// pure black opaque pixels become solid white, everything else is cleared
+void OutlinePixels(uint32_t* pixels, size_t count);
+// Finds the bounding box of every pixel with a non-zero alpha inside a 
+//	width x height image whose rows are stride pixels apart.  Rows are scanned 
+//	in from the top & bottom and then each remaining row only from its ends 
+//	toward the current bounds, so mostly opaque or mostly empty images exit 
+//	early.  Returns false if the image is completely transparent. //
+bool FindOpaqueBounds(uint32_t const* pixels, int width, int height, int stride,
+	int& minX, int& minY, int& maxX, int& maxY);
+
+enum class SimdLevel
+{
+	Scalar,
+	SSE2,
+	AVX2
+};
+// the best level this CPU supports
+SimdLevel DetectSimdLevel();
+// the level the passes above are currently using
+SimdLevel GetSimdLevel();
+// forces the passes to a lower level, mostly so that they can be compared
+//	against each other.  Levels the CPU doesn't support are clamped. //
+void SetSimdLevel(SimdLevel level);
+char const* SimdLevelName(SimdLevel level);
+
+// Runs the premultiply, mask & outline passes at every level over each of 
+//	the 256 x 256 alpha/channel combinations, from unaligned starts & w/ 
+//	ragged tails, and compares them pixel for pixel against a per-pixel 
+//	reference.  Prints a line per pass & level (levels this CPU can't run are
+//	reported as skipped) and the first mismatch, if any.  Returns false if 
+//	anything didn't match.  The level in use is restored afterwards. //
+bool SimdSelfTest();
+
+#endif
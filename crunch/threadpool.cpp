@@ -0,0 +1,167 @@
+/*
+ 
+ MIT License
+ 
+ Copyright (c) 2017 Chevy Ray Johnston
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+#include "threadpool.hpp"
+
+ThreadPool::ThreadPool(int numThreads)
+	:stopping(false)
+{
+	for (int t = 1; t < numThreads; t++)
+	{
+		workers.emplace_back(&ThreadPool::WorkerMain, this);
+	}
+}
+ThreadPool::~ThreadPool()
+{
+	{
+		lock_guard<mutex> lock(batchMutex);
+		stopping = true;
+	}
+	batchCv.notify_all();
+	for (thread& worker : workers)
+	{
+		worker.join();
+	}
+}
+int ThreadPool::NumThreads() const
+{
+	return static_cast<int>(workers.size()) + 1;
+}
+int ThreadPool::HardwareConcurrency()
+{
+	const unsigned hc = thread::hardware_concurrency();
+	return hc > 0 ? static_cast<int>(hc) : 1;
+}
+bool ThreadPool::RunOne(Batch& batch)
+{
+	const size_t i = batch.next.fetch_add(1);
+	if (i >= batch.count)
+	{
+		return false;
+	}
+	if (!batch.failed)
+	{
+		try
+		{
+			(*batch.body)(i);
+		}
+		catch (...)
+		{
+			// only the first one is kept; failed is what publishes it //
+			lock_guard<mutex> lock(doneMutex);
+			if (!batch.failed)
+			{
+				batch.error = current_exception();
+				batch.failed = true;
+			}
+		}
+	}
+	if (batch.done.fetch_add(1) + 1 == batch.count)
+	{
+		lock_guard<mutex> lock(doneMutex);
+		doneCv.notify_all();
+	}
+	return true;
+}
+void ThreadPool::ParallelFor(size_t count, function<void(size_t)> const& body)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	if (workers.empty() || count == 1)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			body(i);
+		}
+		return;
+	}
+	auto batch = make_shared<Batch>();
+	batch->body  = &body;
+	batch->count = count;
+	batch->next  = 0;
+	batch->done  = 0;
+	batch->failed = false;
+	{
+		lock_guard<mutex> lock(batchMutex);
+		batches.push_back(batch);
+	}
+	batchCv.notify_all();
+	// help out with our own batch until every index has been handed out //
+	while (RunOne(*batch))
+	{
+	}
+	{
+		lock_guard<mutex> lock(batchMutex);
+		for (auto it = batches.begin(); it != batches.end(); ++it)
+		{
+			if (*it == batch)
+			{
+				batches.erase(it);
+				break;
+			}
+		}
+	}
+	// then wait for the indices other threads are still working on //
+	unique_lock<mutex> lock(doneMutex);
+	doneCv.wait(lock, [&batch]() { return batch->done.load() == batch->count; });
+	if (batch->error)
+	{
+		rethrow_exception(batch->error);
+	}
+}
+void ThreadPool::WorkerMain()
+{
+	for (;;)
+	{
+		shared_ptr<Batch> batch;
+		{
+			unique_lock<mutex> lock(batchMutex);
+			batchCv.wait(lock, [this]() { return stopping || !batches.empty(); });
+			if (stopping)
+			{
+				return;
+			}
+			// prefer the most recently queued batch so that nested
+			//	ParallelFor calls finish before their parents pick up more work //
+			batch = batches.back();
+		}
+		if (!RunOne(*batch))
+		{
+			// every index of this batch is taken, so retire it //
+			lock_guard<mutex> lock(batchMutex);
+			for (auto it = batches.begin(); it != batches.end(); ++it)
+			{
+				if (*it == batch)
+				{
+					batches.erase(it);
+					break;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,83 @@
+/*
+ 
+ MIT License
+ 
+ Copyright (c) 2017 Chevy Ray Johnston
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+#ifndef threadpool_hpp
+#define threadpool_hpp
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <exception>
+
+using namespace std;
+
+// A fixed set of worker threads that run ParallelFor batches.
+//	The calling thread always helps drain its own batch, so ParallelFor may be
+//	called from inside another ParallelFor body without deadlocking. //
+class ThreadPool
+{
+public:
+	// numThreads is the total number of threads doing work, including the
+	//	caller of ParallelFor, so a value <= 1 runs everything serially. //
+	explicit ThreadPool(int numThreads);
+	~ThreadPool();
+	ThreadPool(ThreadPool const&) = delete;
+	ThreadPool& operator=(ThreadPool const&) = delete;
+	int NumThreads() const;
+	// Calls body(i) for every i in [0, count) and returns once all of them
+	//	are finished.  The order in which the indices run is unspecified.
+	//	If a body throws, the indices not yet started are skipped & the first
+	//	exception is rethrown here once the others have finished. //
+	void ParallelFor(size_t count, function<void(size_t)> const& body);
+	// Default number of jobs when the user does not supply --jobs //
+	static int HardwareConcurrency();
+private:
+	struct Batch
+	{
+		function<void(size_t)> const* body;
+		size_t count;
+		atomic<size_t> next;
+		atomic<size_t> done;
+		atomic<bool> failed;
+		exception_ptr error;
+	};
+	bool RunOne(Batch& batch);
+	void WorkerMain();
+	vector<thread> workers;
+	deque<shared_ptr<Batch>> batches;
+	mutex batchMutex;
+	condition_variable batchCv;
+	mutex doneMutex;
+	condition_variable doneCv;
+	bool stopping;
+};
+
+#endif
@@ -0,0 +1,166 @@
+/*
+ 
+ MIT License
+ 
+ Copyright (c) 2017 Chevy Ray Johnston
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+#include "xxhash.hpp"
+#include <cstring>
+
+static const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+static const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t RotateLeft(uint64_t value, int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+// byte by byte so big endian machines agree; compilers turn these into loads
+static inline uint64_t Read64(unsigned char const* p)
+{
+	uint64_t value = 0;
+	for (int i = 7; i >= 0; i--)
+	{
+		value = (value << 8) | p[i];
+	}
+	return value;
+}
+static inline uint32_t Read32(unsigned char const* p)
+{
+	return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | 
+		(static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+static inline uint64_t Round(uint64_t accumulator, uint64_t input)
+{
+	accumulator += input * PRIME64_2;
+	accumulator = RotateLeft(accumulator, 31);
+	return accumulator * PRIME64_1;
+}
+static inline uint64_t MergeRound(uint64_t hash, uint64_t accumulator)
+{
+	hash ^= Round(0, accumulator);
+	return hash * PRIME64_1 + PRIME64_4;
+}
+// consumes as many whole 32 byte stripes of data as there are
+static inline size_t ConsumeStripes(uint64_t accumulators[4], unsigned char const* data, size_t size)
+{
+	size_t offset = 0;
+	for (; offset + 32 <= size; offset += 32)
+	{
+		accumulators[0] = Round(accumulators[0], Read64(data + offset));
+		accumulators[1] = Round(accumulators[1], Read64(data + offset + 8));
+		accumulators[2] = Round(accumulators[2], Read64(data + offset + 16));
+		accumulators[3] = Round(accumulators[3], Read64(data + offset + 24));
+	}
+	return offset;
+}
+
+XXH64Hasher::XXH64Hasher(uint64_t seed)
+	:seed(seed)
+	,totalSize(0)
+	,bufferSize(0)
+{
+	accumulators[0] = seed + PRIME64_1 + PRIME64_2;
+	accumulators[1] = seed + PRIME64_2;
+	accumulators[2] = seed;
+	accumulators[3] = seed - PRIME64_1;
+}
+void XXH64Hasher::Update(void const* data, size_t size)
+{
+	unsigned char const* bytes = reinterpret_cast<unsigned char const*>(data);
+	totalSize += size;
+	if (bufferSize + size < sizeof(buffer))
+	{
+		if (size > 0)
+		{
+			memcpy(buffer + bufferSize, bytes, size);
+		}
+		bufferSize += size;
+		return;
+	}
+	if (bufferSize > 0)
+	{
+		const size_t fill = sizeof(buffer) - bufferSize;
+		memcpy(buffer + bufferSize, bytes, fill);
+		ConsumeStripes(accumulators, buffer, sizeof(buffer));
+		bytes += fill;
+		size -= fill;
+		bufferSize = 0;
+	}
+	const size_t consumed = ConsumeStripes(accumulators, bytes, size);
+	bufferSize = size - consumed;
+	if (bufferSize > 0)
+	{
+		memcpy(buffer, bytes + consumed, bufferSize);
+	}
+}
+uint64_t XXH64Hasher::Digest() const
+{
+	uint64_t hash;
+	if (totalSize >= 32)
+	{
+		hash = RotateLeft(accumulators[0], 1) + RotateLeft(accumulators[1], 7) +
+			RotateLeft(accumulators[2], 12) + RotateLeft(accumulators[3], 18);
+		for (int i = 0; i < 4; i++)
+		{
+			hash = MergeRound(hash, accumulators[i]);
+		}
+	}
+	else
+	{
+		hash = seed + PRIME64_5;
+	}
+	hash += totalSize;
+	size_t offset = 0;
+	for (; offset + 8 <= bufferSize; offset += 8)
+	{
+		hash ^= Round(0, Read64(buffer + offset));
+		hash = RotateLeft(hash, 27) * PRIME64_1 + PRIME64_4;
+	}
+	if (offset + 4 <= bufferSize)
+	{
+		hash ^= static_cast<uint64_t>(Read32(buffer + offset)) * PRIME64_1;
+		hash = RotateLeft(hash, 23) * PRIME64_2 + PRIME64_3;
+		offset += 4;
+	}
+	for (; offset < bufferSize; offset++)
+	{
+		hash ^= buffer[offset] * PRIME64_5;
+		hash = RotateLeft(hash, 11) * PRIME64_1;
+	}
+	hash ^= hash >> 33;
+	hash *= PRIME64_2;
+	hash ^= hash >> 29;
+	hash *= PRIME64_3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+uint64_t XXH64(void const* data, size_t size, uint64_t seed)
+{
+	XXH64Hasher hasher(seed);
+	hasher.Update(data, size);
+	return hasher.Digest();
+}
@@ -0,0 +1,56 @@
+/*
+ 
+ MIT License
+ 
+ Copyright (c) 2017 Chevy Ray Johnston
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+#ifndef xxhash_hpp
+#define xxhash_hpp
+
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+// XXH64 (https://github.com/Cyan4973/xxHash), written out here so crunch's 
+//	hashes are the same on every platform & standard library, which 
+//	std::hash doesn't promise.  Input is read as little endian bytes. //
+class XXH64Hasher
+{
+public:
+	explicit XXH64Hasher(uint64_t seed = 0);
+	// data can be fed in pieces of any size; the digest is the same as if it
+	//	had all been passed at once
+	void Update(void const* data, size_t size);
+	uint64_t Digest() const;
+private:
+	uint64_t seed;
+	uint64_t accumulators[4];
+	uint64_t totalSize;
+	unsigned char buffer[32];
+	size_t bufferSize;
+};
+
+uint64_t XXH64(void const* data, size_t size, uint64_t seed = 0);
+
+#endif
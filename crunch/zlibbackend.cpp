@@ -0,0 +1,292 @@
+/*
+ 
+ MIT License
+ 
+ Copyright (c) 2017 Chevy Ray Johnston
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+#include "zlibbackend.hpp"
+#include "flate.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#ifdef CRUNCH_USE_ZLIB
+#include <zlib.h>
+#endif
+
+static ZlibBackend currentBackend = DefaultZlibBackend();
+
+bool ParseZlibBackend(string const& name, ZlibBackend& outBackend)
+{
+	if (name == "lodepng")
+		outBackend = ZlibBackend::LodePNG;
+	else if (name == "zlib")
+		outBackend = ZlibBackend::Zlib;
+	else if (name == "flate")
+		outBackend = ZlibBackend::Flate;
+	else
+		return false;
+	return true;
+}
+
+char const* ZlibBackendName(ZlibBackend backend)
+{
+	switch (backend)
+	{
+	case ZlibBackend::LodePNG: return "lodepng";
+	case ZlibBackend::Zlib: return "zlib";
+	case ZlibBackend::Flate: return "flate";
+	}
+	return "";
+}
+
+bool ZlibBackendAvailable(ZlibBackend backend)
+{
+#ifdef CRUNCH_USE_ZLIB
+	return true;
+#else
+	return backend != ZlibBackend::Zlib;
+#endif
+}
+
+ZlibBackend DefaultZlibBackend()
+{
+	return ZlibBackend::Flate;
+}
+
+void SetZlibBackend(ZlibBackend backend)
+{
+	currentBackend = backend;
+}
+
+ZlibBackend CurrentZlibBackend()
+{
+	return currentBackend;
+}
+
+#ifdef CRUNCH_USE_ZLIB
+
+// The closest zlib level to each of the --png-level presets
+static int ZlibLevel(LodePNGCompressSettings const& settings)
+{
+	if (settings.btype == 0)
+		return Z_NO_COMPRESSION;
+	if (!settings.lazymatching && settings.windowsize <= 512)
+		return Z_BEST_SPEED;
+	if (settings.lazymatching && settings.nicematch >= 258)
+		return Z_BEST_COMPRESSION;
+	return Z_DEFAULT_COMPRESSION;
+}
+
+static int ZlibWindowBits(LodePNGCompressSettings const& settings)
+{
+	int bits = 9;
+	while (bits < MAX_WBITS && (1u << bits) < settings.windowsize)
+		bits++;
+	return bits;
+}
+
+// Runs one deflate stream over in, appending it to the malloc'd *out.  
+//	windowBits < 0 means raw deflate, as in deflateInit2. //
+static unsigned ZlibDeflate(unsigned char** out, size_t* outsize,
+	const unsigned char* in, size_t insize,
+	LodePNGCompressSettings const& settings, int windowBits, int flush)
+{
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (deflateInit2(&stream, ZlibLevel(settings), Z_DEFLATED, windowBits, 8, 
+		settings.btype == 1 ? Z_FIXED : Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		return 83;
+	}
+	// deflateBound covers Z_FINISH; a full flush adds at most an empty stored block
+	const size_t bound = deflateBound(&stream, static_cast<uLong>(insize)) + 16;
+	unsigned char* grown = static_cast<unsigned char*>(realloc(*out, *outsize + bound));
+	if (!grown)
+	{
+		deflateEnd(&stream);
+		return 83;
+	}
+	*out = grown;
+	stream.next_in = const_cast<Bytef*>(in);
+	stream.avail_in = static_cast<uInt>(insize);
+	stream.next_out = grown + *outsize;
+	stream.avail_out = static_cast<uInt>(bound);
+	const int result = deflate(&stream, flush);
+	*outsize += bound - stream.avail_out;
+	deflateEnd(&stream);
+	const bool done = flush == Z_FINISH ? result == Z_STREAM_END : 
+		(result == Z_OK && stream.avail_in == 0);
+	return done ? 0 : 86;
+}
+
+static unsigned ZlibCompress(unsigned char** out, size_t* outsize,
+	const unsigned char* in, size_t insize, const LodePNGCompressSettings* settings)
+{
+	if (insize > UINT_MAX)
+		return 92;
+	return ZlibDeflate(out, outsize, in, insize, *settings, ZlibWindowBits(*settings), Z_FINISH);
+}
+
+// lodepng hands over a buffer reserved for the exact image size, but can't 
+//	say how big it is, so it's grown from a guess. //
+static unsigned ZlibDecompress(unsigned char** out, size_t* outsize,
+	const unsigned char* in, size_t insize, const LodePNGDecompressSettings*)
+{
+	if (insize > UINT_MAX)
+		return 92;
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (inflateInit(&stream) != Z_OK)
+		return 83;
+	stream.next_in = const_cast<Bytef*>(in);
+	stream.avail_in = static_cast<uInt>(insize);
+	size_t capacity = max<size_t>(insize * 4, 1 << 16);
+	size_t size = 0;
+	unsigned error = 0;
+	for (;;)
+	{
+		unsigned char* grown = static_cast<unsigned char*>(realloc(*out, capacity));
+		if (!grown)
+		{
+			error = 83;
+			break;
+		}
+		*out = grown;
+		stream.next_out = grown + size;
+		stream.avail_out = static_cast<uInt>(min<size_t>(capacity - size, UINT_MAX));
+		const uInt avail = stream.avail_out;
+		const int result = inflate(&stream, Z_NO_FLUSH);
+		size += avail - stream.avail_out;
+		if (result == Z_STREAM_END)
+			break;
+		if (result != Z_OK && result != Z_BUF_ERROR)
+		{
+			error = result == Z_MEM_ERROR ? 83 : 52;
+			break;
+		}
+		if (stream.avail_out != 0)
+		{
+			// ran out of input before the end of the stream
+			error = 53;
+			break;
+		}
+		capacity *= 2;
+	}
+	inflateEnd(&stream);
+	*outsize = size;
+	return error;
+}
+
+#endif
+
+// The flate settings closest to each of the --png-level presets
+static FlateSettings GetFlateSettings(LodePNGCompressSettings const& settings)
+{
+	FlateSettings flate;
+	if (settings.btype == 0)
+		flate.level = FlateLevel::Store;
+	else if (!settings.lazymatching && settings.windowsize <= 512)
+		flate.level = FlateLevel::Fastest;
+	else if (settings.lazymatching && settings.nicematch >= 258)
+		flate.level = FlateLevel::Best;
+	else
+		flate.level = FlateLevel::Default;
+	flate.maxDistance = settings.windowsize;
+	flate.fixedCodes = settings.btype == 1;
+	return flate;
+}
+
+static unsigned FlateCustomCompress(unsigned char** out, size_t* outsize,
+	const unsigned char* in, size_t insize, const LodePNGCompressSettings* settings)
+{
+	return FlateZlibCompress(out, outsize, in, insize, GetFlateSettings(*settings));
+}
+
+static unsigned FlateCustomDecompress(unsigned char** out, size_t* outsize,
+	const unsigned char* in, size_t insize, const LodePNGDecompressSettings* settings)
+{
+	return FlateZlibDecompress(out, outsize, in, insize, !settings->ignore_adler32);
+}
+
+void UseZlibBackend(LodePNGDecompressSettings& settings)
+{
+	settings.custom_zlib = nullptr;
+	if (currentBackend == ZlibBackend::Flate)
+		settings.custom_zlib = FlateCustomDecompress;
+#ifdef CRUNCH_USE_ZLIB
+	if (currentBackend == ZlibBackend::Zlib)
+		settings.custom_zlib = ZlibDecompress;
+#endif
+}
+
+void UseZlibBackend(LodePNGCompressSettings& settings)
+{
+	settings.custom_zlib = nullptr;
+	if (currentBackend == ZlibBackend::Flate)
+		settings.custom_zlib = FlateCustomCompress;
+#ifdef CRUNCH_USE_ZLIB
+	if (currentBackend == ZlibBackend::Zlib)
+		settings.custom_zlib = ZlibCompress;
+#endif
+}
+
+unsigned DecodePng32File(unsigned char** out, unsigned* w, unsigned* h, const string& file)
+{
+	unsigned char* buffer = nullptr;
+	size_t bufferSize = 0;
+	*out = nullptr;
+	unsigned error = lodepng_load_file(&buffer, &bufferSize, file.c_str());
+	if (!error)
+	{
+		LodePNGState state;
+		lodepng_state_init(&state);
+		state.info_raw.colortype = LCT_RGBA;
+		state.info_raw.bitdepth = 8;
+		UseZlibBackend(state.decoder.zlibsettings);
+		error = lodepng_decode(out, w, h, &state, buffer, bufferSize);
+		lodepng_state_cleanup(&state);
+	}
+	free(buffer);
+	return error;
+}
+
+unsigned DeflatePart(unsigned char** out, size_t* outsize,
+	const unsigned char* in, size_t insize,
+	const LodePNGCompressSettings* settings, unsigned final)
+{
+#ifdef CRUNCH_USE_ZLIB
+	if (currentBackend == ZlibBackend::Zlib)
+	{
+		if (insize > UINT_MAX)
+			return 92;
+		// A full flush ends the part on a byte boundary w/ no dictionary carried
+		//	over, so the parts can be concatenated, same as lodepng's. //
+		return ZlibDeflate(out, outsize, in, insize, *settings, 
+			-ZlibWindowBits(*settings), final ? Z_FINISH : Z_FULL_FLUSH);
+	}
+#endif
+	if (currentBackend == ZlibBackend::Flate)
+		return FlateCompress(out, outsize, in, insize, GetFlateSettings(*settings), final != 0);
+	return lodepng_deflate_part(out, outsize, in, insize, settings, final);
+}
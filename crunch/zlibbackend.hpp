@@ -0,0 +1,70 @@
+/*
+ 
+ MIT License
+ 
+ Copyright (c) 2017 Chevy Ray Johnston
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+#ifndef zlibbackend_hpp
+#define zlibbackend_hpp
+
+#include <string>
+#include <cstddef>
+#include "lodepng.h"
+
+using namespace std;
+
+// The deflate & inflate implementation crunch's PNGs are read and written 
+//	with.  flate (see flate.hpp) and lodepng's own are always there; zlib is 
+//	only compiled in when crunch is built with CRUNCH_USE_ZLIB defined (and 
+//	linked against zlib).  All of them read and write standard PNGs. //
+enum class ZlibBackend
+{
+	LodePNG,
+	Zlib,
+	Flate
+};
+// returns false if name isn't "lodepng", "zlib" or "flate"
+bool ParseZlibBackend(string const& name, ZlibBackend& outBackend);
+char const* ZlibBackendName(ZlibBackend backend);
+bool ZlibBackendAvailable(ZlibBackend backend);
+// the fastest backend compiled in
+ZlibBackend DefaultZlibBackend();
+
+// Picks the backend every decode & encode after this uses.  Call it before
+//	any threads start decoding. //
+void SetZlibBackend(ZlibBackend backend);
+ZlibBackend CurrentZlibBackend();
+
+// Points lodepng's custom_zlib hooks at the current backend
+void UseZlibBackend(LodePNGDecompressSettings& settings);
+void UseZlibBackend(LodePNGCompressSettings& settings);
+
+// lodepng_decode32_file, inflating w/ the current backend
+unsigned DecodePng32File(unsigned char** out, unsigned* w, unsigned* h, const string& file);
+// lodepng_deflate_part, done by the current backend.  zlib & flate map the
+//	settings' window size, lazy matching & btype onto their own levels. //
+unsigned DeflatePart(unsigned char** out, size_t* outsize,
+	const unsigned char* in, size_t insize,
+	const LodePNGCompressSettings* settings, unsigned final);
+
+#endif